@@ -0,0 +1,73 @@
+#include "Aggregation.h"
+
+#include <math.h>
+
+namespace {
+
+const char* const SUFFIXES[Aggregation::MAX_FIELDS] = {"_min", "_max", "_mean", "_count", "_last", "_stddev"};
+
+} // namespace
+
+Aggregation::Aggregation()
+    : window(0), withStddev(false), windowStart(0), count(0), minimum(0), maximum(0), mean(0), squares(0), last(0) {}
+
+void Aggregation::configure(const char* measurement, const char* field, uint32_t window, bool stddev) {
+    measurementName = measurement;
+    fieldKey = field;
+    for (size_t i = 0; i < MAX_FIELDS; i++) {
+        keys[i] = fieldKey;
+        keys[i] += SUFFIXES[i];
+    }
+    this->window = window;
+    withStddev = stddev;
+    count = 0;
+}
+
+void Aggregation::add(double value, uint64_t now) {
+    if (count == 0) {
+        windowStart = now - now % window;
+        minimum = value;
+        maximum = value;
+        mean = 0;
+        squares = 0;
+    }
+    count++;
+    // Welford: stable for long windows of large values with small variation
+    double delta = value - mean;
+    mean += delta / count;
+    squares += delta * (value - mean);
+    if (value < minimum) {
+        minimum = value;
+    }
+    if (value > maximum) {
+        maximum = value;
+    }
+    last = value;
+}
+
+Aggregation::Summary Aggregation::take() {
+    Summary summary;
+    summary.start = windowStart;
+    summary.count = count;
+    summary.min = minimum;
+    summary.max = maximum;
+    summary.mean = mean;
+    summary.last = last;
+    summary.stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+    count = 0;
+    return summary;
+}
+
+size_t Aggregation::render(const Summary& summary, LineProtocol::Field* fields) const {
+    // Floats throughout, so a field keeps one type whatever was sampled
+    fields[0] = LineProtocol::Field(keys[0].c_str(), summary.min);
+    fields[1] = LineProtocol::Field(keys[1].c_str(), summary.max);
+    fields[2] = LineProtocol::Field(keys[2].c_str(), summary.mean);
+    fields[3] = LineProtocol::Field(keys[3].c_str(), (long)summary.count);
+    fields[4] = LineProtocol::Field(keys[4].c_str(), summary.last);
+    if (!withStddev) {
+        return 5;
+    }
+    fields[5] = LineProtocol::Field(keys[5].c_str(), summary.stddev);
+    return 6;
+}
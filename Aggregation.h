@@ -0,0 +1,114 @@
+#ifndef LIGHTWEIGHT_IOT_AGGREGATION_H
+#define LIGHTWEIGHT_IOT_AGGREGATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO
+    #include <Arduino.h>
+#else
+    #include <string>
+#endif
+
+#include "LineProtocol.h"
+
+/**
+ * @brief Running statistics of one numeric series over tumbling windows
+ *
+ * Samples are folded into count, minimum, maximum, last value and a
+ * Welford mean and sum of squared deviations, so a window takes the same
+ * few bytes whether it sees ten samples or a million, and adding one
+ * allocates nothing. Windows are aligned to multiples of their length on
+ * the device clock. A closed window is taken as a Summary and written as
+ * one point with the fields <field>_min, _max, _mean, _count, _last and
+ * optionally _stddev.
+ */
+class Aggregation {
+public:
+#ifdef ARDUINO
+    using String = ::String;
+#else
+    using String = std::string;
+#endif
+
+    static const size_t MAX_FIELDS = 6;
+
+    /**
+     * @brief Statistics of one closed window
+     */
+    struct Summary {
+        uint64_t start;   ///< Clock time the window began (ms)
+        uint32_t count;   ///< Samples, 0 for an empty window
+        double min;
+        double max;
+        double mean;
+        double last;
+        double stddev;    ///< Sample standard deviation, 0 below two samples
+    };
+
+    Aggregation();
+
+    /**
+     * @brief Sets the series and window, discarding the open window
+     * @param measurement Measurement name
+     * @param field Numeric field key
+     * @param window Window length (ms, > 0)
+     * @param stddev Also write <field>_stddev
+     */
+    void configure(const char* measurement, const char* field, uint32_t window, bool stddev);
+
+    /**
+     * @brief Checks whether a field of a measurement belongs to this series
+     */
+    bool matches(const char* measurement, const char* field) const {
+        return fieldKey == field && measurementName == measurement;
+    }
+
+    /**
+     * @brief Folds a sample into the window that contains `now`
+     *
+     * A sample past the end of the open window does not close it; call
+     * take() first when due() says so.
+     */
+    void add(double value, uint64_t now);
+
+    /**
+     * @brief Checks whether the open window has samples and has ended
+     */
+    bool due(uint64_t now) const { return count > 0 && now - windowStart >= window; }
+
+    bool empty() const { return count == 0; }
+
+    /**
+     * @brief Closes the open window
+     * @return Its statistics; count is 0 if there were no samples
+     */
+    Summary take();
+
+    /**
+     * @brief Fills in the fields of the point written for a window
+     * @param fields At least MAX_FIELDS entries; keys point into this object
+     * @return Number of fields
+     */
+    size_t render(const Summary& summary, LineProtocol::Field* fields) const;
+
+    const char* measurement() const { return measurementName.c_str(); }
+    const char* field() const { return fieldKey.c_str(); }
+
+private:
+    String measurementName;
+    String fieldKey;
+    String keys[MAX_FIELDS];  ///< <field>_min ... <field>_stddev, built once by configure()
+    uint32_t window;
+    bool withStddev;
+
+    uint64_t windowStart;
+    uint32_t count;
+    double minimum;
+    double maximum;
+    double mean;
+    double squares;  ///< Sum of squared deviations from the mean
+    double last;
+};
+
+#endif
@@ -0,0 +1,46 @@
+#include "Arena.h"
+
+#include <new>
+
+#if defined(ESP32) || !defined(ARDUINO)
+    #define ARENA_LOCK() std::lock_guard<std::mutex> guard(lock)
+#else
+    #define ARENA_LOCK()
+#endif
+
+Arena::Arena() : region(nullptr), size(0), next(0) {}
+
+Arena::~Arena() {
+    release();
+}
+
+bool Arena::reserve(size_t capacity) {
+    release();
+    capacity &= ~(ALIGNMENT - 1);
+    // new[] returns memory aligned for any type, so offsets that are
+    // multiples of ALIGNMENT are aligned too
+    region = new (std::nothrow) char[capacity];
+    if (region == nullptr) {
+        return false;
+    }
+    size = capacity;
+    return true;
+}
+
+void Arena::release() {
+    delete[] region;
+    region = nullptr;
+    size = 0;
+    next = 0;
+}
+
+void* Arena::allocate(size_t length) {
+    ARENA_LOCK();
+    length = padded(length);
+    if (region == nullptr || length > size - next) {
+        return nullptr;
+    }
+    void* pointer = region + next;
+    next += length;
+    return pointer;
+}
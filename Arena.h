@@ -0,0 +1,73 @@
+#ifndef LIGHTWEIGHT_IOT_ARENA_H
+#define LIGHTWEIGHT_IOT_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ESP32) || !defined(ARDUINO)
+    #include <mutex>
+#endif
+
+/**
+ * @brief One region of memory that buffers are carved from
+ *
+ * The region is allocated once by reserve(). Buffers are taken from it in
+ * order with allocate() and all stay until release(); nothing is given
+ * back on its own. Payloads are streamed from the batch as they are sent,
+ * so no buffer is needed per flush. Carving never touches the heap, so a
+ * device that reserves its region at startup cannot fragment the heap
+ * later on.
+ */
+class Arena {
+public:
+    static const size_t ALIGNMENT = 8;
+
+    Arena();
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * @brief Allocates the region, discarding everything carved from a previous one
+     * @return true if the region was allocated
+     */
+    bool reserve(size_t capacity);
+
+    /**
+     * @brief Frees the region
+     */
+    void release();
+
+    /**
+     * @brief Takes a buffer from the region
+     * @return ALIGNMENT-aligned memory, nullptr if it does not fit
+     */
+    void* allocate(size_t size);
+
+    /**
+     * @brief Checks whether memory was carved from this region
+     */
+    bool owns(const void* pointer) const {
+        return region != nullptr && (const char*)pointer >= region && (const char*)pointer < region + size;
+    }
+
+    /**
+     * @brief Rounds a size up to the alignment of every buffer
+     */
+    static size_t padded(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+    bool reserved() const { return region != nullptr; }
+    size_t capacity() const { return size; }
+    size_t used() const { return next; }
+
+private:
+    char* region;
+    size_t size;
+    size_t next;      ///< End of the buffers taken so far
+#if defined(ESP32) || !defined(ARDUINO)
+    std::mutex lock;  ///< The sender carves the compressor on first use while writers carve their buffers
+#endif
+};
+
+#endif
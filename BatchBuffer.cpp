@@ -0,0 +1,140 @@
+#include "BatchBuffer.h"
+
+#include <new>
+#include <string.h>
+#include <utility>
+
+BatchBuffer::BatchBuffer()
+    : data(nullptr), size(0), head(0), tail(0), wrap(0), used(0), count(0), claimed(0), owned(false) {}
+
+BatchBuffer::~BatchBuffer() {
+    release();
+}
+
+bool BatchBuffer::allocate(size_t capacity, char* storage) {
+    release();
+    owned = storage == nullptr;
+    data = owned ? new (std::nothrow) char[capacity] : storage;
+    if (data == nullptr) {
+        return false;
+    }
+    size = capacity;
+    return true;
+}
+
+void BatchBuffer::release() {
+    if (owned) {
+        delete[] data;
+    }
+    data = nullptr;
+    size = 0;
+    owned = false;
+    clear();
+}
+
+bool BatchBuffer::append(const char* line, size_t length) {
+    char* room = claim(length);
+    if (room == nullptr) {
+        return false;
+    }
+    memcpy(room, line, length);
+    commit(length);
+    return true;
+}
+
+char* BatchBuffer::claim(size_t length) {
+    size_t needed = length + 1;
+
+    if (wrap != 0) {
+        // Wrapped: the free space lies between tail and head
+        if (tail + needed > head) {
+            return nullptr;
+        }
+        claimed = tail;
+    } else if (tail + needed <= size) {
+        claimed = tail;
+    } else if (needed < head) {
+        // Start a new run at the front once the old bytes there are consumed
+        claimed = 0;
+    } else {
+        return nullptr;
+    }
+    return data + claimed;
+}
+
+void BatchBuffer::commit(size_t length) {
+    if (wrap == 0 && claimed < tail) {
+        // The room is at the front; the upper run ends here
+        wrap = tail;
+    }
+    data[claimed + length] = '\n';
+    tail = claimed + length + 1;
+    used += length + 1;
+    count++;
+}
+
+size_t BatchBuffer::peek(const char** out) const {
+    *out = data + head;
+    if (used == 0) {
+        return 0;
+    }
+    return (wrap != 0 ? wrap : tail) - head;
+}
+
+size_t BatchBuffer::peekRuns(const char* out[2], size_t lengths[2]) const {
+    lengths[0] = peek(&out[0]);
+    if (lengths[0] == 0) {
+        return 0;
+    }
+    if (wrap == 0) {
+        return 1;
+    }
+    // Wrapped: the newer points start at the front of the region
+    out[1] = data;
+    lengths[1] = tail;
+    return 2;
+}
+
+void BatchBuffer::consume(size_t length) {
+    if (length == 0 || used == 0) {
+        return;
+    }
+
+    const char* p = data + head;
+    const char* end = p + length;
+    while ((p = (const char*)memchr(p, '\n', end - p)) != nullptr) {
+        count--;
+        p++;
+    }
+
+    head += length;
+    used -= length;
+
+    if (wrap != 0 && head == wrap) {
+        head = 0;
+        wrap = 0;
+    }
+    if (used == 0) {
+        // Restart at the front so the next batch is a single run
+        clear();
+    }
+}
+
+void BatchBuffer::clear() {
+    head = 0;
+    tail = 0;
+    wrap = 0;
+    used = 0;
+    count = 0;
+}
+
+void BatchBuffer::swap(BatchBuffer& other) {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    std::swap(head, other.head);
+    std::swap(tail, other.tail);
+    std::swap(wrap, other.wrap);
+    std::swap(used, other.used);
+    std::swap(count, other.count);
+    std::swap(owned, other.owned);
+}
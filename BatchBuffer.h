@@ -0,0 +1,108 @@
+#ifndef LIGHTWEIGHT_IOT_BATCH_BUFFER_H
+#define LIGHTWEIGHT_IOT_BATCH_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Contiguous byte ring holding newline-terminated points
+ *
+ * Points are appended to a single fixed-size region and never split, so the
+ * oldest data can always be handed to the HTTP client in place. When a point
+ * does not fit at the end of the region it wraps to the front, provided the
+ * space there has already been consumed.
+ */
+class BatchBuffer {
+public:
+    BatchBuffer();
+    ~BatchBuffer();
+
+    BatchBuffer(const BatchBuffer&) = delete;
+    BatchBuffer& operator=(const BatchBuffer&) = delete;
+
+    /**
+     * @brief Allocates the storage region, discarding any queued points
+     * @param capacity Region size in bytes
+     * @param storage Caller-owned region of `capacity` bytes to use instead of the heap
+     * @return true if the region was allocated
+     */
+    bool allocate(size_t capacity, char* storage = nullptr);
+
+    /**
+     * @brief Frees the storage region
+     */
+    void release();
+
+    /**
+     * @brief Appends a point followed by a newline
+     * @return false if the point does not fit in the free space
+     */
+    bool append(const char* line, size_t length);
+
+    /**
+     * @brief Returns room for a point to be encoded in place
+     *
+     * The room holds `length` bytes and one more for the newline, so an
+     * encoder may NUL-terminate a point of up to `length` bytes. Follow with
+     * commit(); claiming again instead abandons the room.
+     *
+     * @param length Longest the point can be
+     * @return nullptr if a point that long does not fit in the free space
+     */
+    char* claim(size_t length);
+
+    /**
+     * @brief Appends the point encoded into the room from claim(), followed by a newline
+     * @param length Encoded length, at most the length claimed
+     */
+    void commit(size_t length);
+
+    /**
+     * @brief Returns the oldest contiguous run of whole points
+     * @param data Set to the start of the run
+     * @return Length of the run in bytes, 0 if the buffer is empty
+     */
+    size_t peek(const char** data) const;
+
+    /**
+     * @brief Returns all queued points as up to two runs, oldest first
+     * @param data Set to the start of each run
+     * @param lengths Set to the length of each run
+     * @return Number of runs, 0 if the buffer is empty
+     */
+    size_t peekRuns(const char* data[2], size_t lengths[2]) const;
+
+    /**
+     * @brief Drops bytes from the front after they have been sent
+     * @param length Number of bytes, must end on a point boundary
+     */
+    void consume(size_t length);
+
+    /**
+     * @brief Drops all queued points
+     */
+    void clear();
+
+    /**
+     * @brief Exchanges storage and contents with another buffer in O(1)
+     */
+    void swap(BatchBuffer& other);
+
+    size_t points() const { return count; }
+    size_t bytes() const { return used; }
+    size_t capacity() const { return size; }
+    bool empty() const { return used == 0; }
+
+private:
+    char* data;
+    size_t size;
+    size_t head;   ///< Offset of the oldest byte
+    size_t tail;   ///< Offset one past the newest byte
+    size_t wrap;   ///< End of the upper run while wrapped, 0 otherwise
+    size_t used;
+    size_t count;
+    size_t claimed;  ///< Offset of the room returned by claim()
+    bool owned;    ///< data was allocated by allocate() rather than passed in
+};
+
+#endif
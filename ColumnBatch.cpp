@@ -0,0 +1,155 @@
+#include "ColumnBatch.h"
+
+#include <new>
+#include <string.h>
+
+ColumnBatch::ColumnBatch()
+    : records(nullptr), size(0), head(0), tail(0), count(0), headTime(0), tailTime(0), seriesCount(0),
+      lastSeries(0), owned(false) {}
+
+ColumnBatch::~ColumnBatch() {
+    release();
+}
+
+bool ColumnBatch::allocate(size_t bytes, void* storage) {
+    static_assert(sizeof(Record) == RECORD_SIZE, "A sample is meant to take 8 bytes");
+    release();
+    size_t length = bytes / sizeof(Record);
+    owned = storage == nullptr;
+    records = owned ? new (std::nothrow) Record[length] : (Record*)storage;
+    if (records == nullptr) {
+        return false;
+    }
+    size = length;
+    return true;
+}
+
+void ColumnBatch::release() {
+    if (owned) {
+        delete[] records;
+    }
+    records = nullptr;
+    size = 0;
+    owned = false;
+    clear();
+}
+
+ColumnBatch::Status ColumnBatch::add(KeyTable::Id name, KeyTable::Id field, const LineProtocol::Field& value,
+                                     uint64_t now) {
+    if (value.type != LineProtocol::FIELD_FLOAT &&
+        (value.type != LineProtocol::FIELD_INT || (long)(int32_t)value.i != value.i)) {
+        return UNTRACKED;
+    }
+    if (count == 0) {
+        clear();
+        headTime = now;
+        tailTime = now;
+    }
+    size_t index = findSeries(name, field, value.type);
+    if (index == MAX_SERIES) {
+        return UNTRACKED;
+    }
+
+    // One record, plus one per 49 days of pause beyond 65 s
+    uint64_t delta = now > tailTime ? now - tailTime : 0;
+    size_t needed = 1;
+    if (delta > 0xFFFF) {
+        needed += (size_t)(delta / 0xFFFFFFFFu) + 1;
+    }
+    if (tail + needed > size) {
+        compact();
+        if (tail + needed > size) {
+            return FULL;
+        }
+    }
+    while (delta > 0xFFFF) {
+        Record& pause = records[tail++];
+        pause.value.gap = delta > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)delta;
+        pause.series = GAP;
+        pause.delta = 0;
+        delta -= pause.value.gap;
+    }
+
+    Record& record = records[tail++];
+    if (value.type == LineProtocol::FIELD_FLOAT) {
+        record.value.f = value.f;
+    } else {
+        record.value.i = (int32_t)value.i;
+    }
+    record.series = (uint16_t)index;
+    record.delta = (uint16_t)delta;
+    tailTime = now;
+    count++;
+    return ADDED;
+}
+
+bool ColumnBatch::front(Sample* sample) {
+    // Pauses carry no sample; fold them into the time of the next one
+    while (head < tail && records[head].series == GAP) {
+        headTime += records[head].value.gap;
+        head++;
+    }
+    if (head == tail) {
+        return false;
+    }
+    const Record& record = records[head];
+    sample->series = &series[record.series];
+    if (series[record.series].type == LineProtocol::FIELD_FLOAT) {
+        sample->value.f = record.value.f;
+    } else {
+        sample->value.i = record.value.i;
+    }
+    sample->time = headTime + record.delta;
+    return true;
+}
+
+void ColumnBatch::pop() {
+    headTime += records[head].delta;
+    head++;
+    count--;
+    if (count == 0) {
+        clear();
+    }
+}
+
+void ColumnBatch::clear() {
+    head = 0;
+    tail = 0;
+    count = 0;
+    seriesCount = 0;
+    lastSeries = 0;
+}
+
+size_t ColumnBatch::findSeries(KeyTable::Id name, KeyTable::Id field, uint8_t type) {
+    // Usually the same series as last time, else one of a handful
+    if (lastSeries < seriesCount) {
+        const Series& last = series[lastSeries];
+        if (last.name == name && last.field == field && last.type == type) {
+            return lastSeries;
+        }
+    }
+    for (size_t i = 0; i < seriesCount; i++) {
+        if (series[i].name == name && series[i].field == field && series[i].type == type) {
+            lastSeries = i;
+            return i;
+        }
+    }
+    if (seriesCount == MAX_SERIES) {
+        return MAX_SERIES;
+    }
+    series[seriesCount].name = name;
+    series[seriesCount].field = field;
+    series[seriesCount].type = type;
+    lastSeries = seriesCount;
+    return seriesCount++;
+}
+
+void ColumnBatch::compact() {
+    // Samples rendered by a partial flush leave room at the front
+    if (head == 0) {
+        return;
+    }
+    memmove(records, records + head, (tail - head) * sizeof(Record));
+    tail -= head;
+    head = 0;
+}
@@ -0,0 +1,131 @@
+#ifndef LIGHTWEIGHT_IOT_COLUMN_BATCH_H
+#define LIGHTWEIGHT_IOT_COLUMN_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "KeyTable.h"
+#include "LineProtocol.h"
+
+/**
+ * @brief Batched single-field numeric samples, kept raw until they are sent
+ *
+ * A sample takes one 8-byte record: its float or integer value, the index
+ * of its series (measurement, field key and type) in a small table, and the
+ * milliseconds since the previous sample. A longer pause is stored as an
+ * extra record holding the full gap. Records are kept in the order they
+ * were added and turned into line protocol only when the batch is flushed,
+ * so a sample costs 8 bytes of RAM instead of its 60-120 bytes of text, and
+ * samples that are cleared are never formatted at all.
+ */
+class ColumnBatch {
+public:
+    static const size_t MAX_SERIES = 16;
+    static const size_t RECORD_SIZE = 8;  ///< Bytes per sample or pause
+
+    /**
+     * @brief Measurement and field a sample belongs to
+     */
+    struct Series {
+        KeyTable::Id name;   ///< Interned with LineProtocol::ESCAPE_MEASUREMENT
+        KeyTable::Id field;  ///< Interned with LineProtocol::ESCAPE_KEY
+        uint8_t type;        ///< LineProtocol::FIELD_FLOAT or FIELD_INT
+    };
+
+    /**
+     * @brief Oldest sample, as returned by front()
+     */
+    struct Sample {
+        const Series* series;
+        union {
+            float f;
+            int32_t i;
+        } value;
+        uint64_t time;  ///< Clock time it was added at (ms)
+    };
+
+    enum Status {
+        ADDED,
+        FULL,       ///< No room for another record
+        UNTRACKED   ///< Not a float or integer field, or no room for another series
+    };
+
+    ColumnBatch();
+    ~ColumnBatch();
+
+    ColumnBatch(const ColumnBatch&) = delete;
+    ColumnBatch& operator=(const ColumnBatch&) = delete;
+
+    /**
+     * @brief Allocates the record storage, discarding any samples
+     * @param bytes Storage size, rounded down to a multiple of RECORD_SIZE
+     * @param storage Caller-owned region of `bytes` bytes to use instead of the heap
+     * @return true if the storage was allocated
+     */
+    bool allocate(size_t bytes, void* storage = nullptr);
+
+    /**
+     * @brief Frees the record storage
+     */
+    void release();
+
+    /**
+     * @brief Adds a sample
+     *
+     * Integers are held in 32 bits; larger ones are UNTRACKED.
+     *
+     * @param now Current clock time (ms), never less than that of the previous sample
+     */
+    Status add(KeyTable::Id name, KeyTable::Id field, const LineProtocol::Field& value, uint64_t now);
+
+    /**
+     * @brief Returns the oldest sample
+     * @return false if there is none
+     */
+    bool front(Sample* sample);
+
+    /**
+     * @brief Drops the sample returned by front()
+     */
+    void pop();
+
+    /**
+     * @brief Drops all samples and forgets the series
+     */
+    void clear();
+
+    size_t samples() const { return count; }
+    size_t bytes() const { return (tail - head) * sizeof(Record); }
+    size_t capacity() const { return size * sizeof(Record); }
+    bool empty() const { return count == 0; }
+
+private:
+    static const uint16_t GAP = 0xFFFF;  ///< Series index of a record holding a long pause
+
+    struct Record {
+        union {
+            float f;
+            int32_t i;
+            uint32_t gap;   ///< Pause before the next record (ms)
+        } value;
+        uint16_t series;    ///< Index into the series table, GAP for a pause
+        uint16_t delta;     ///< Time since the previous record (ms)
+    };
+
+    Record* records;
+    size_t size;
+    size_t head;            ///< Oldest record
+    size_t tail;            ///< One past the newest record
+    size_t count;           ///< Samples held, pause records aside
+    uint64_t headTime;      ///< Time of the record before head
+    uint64_t tailTime;      ///< Time of the newest record
+    Series series[MAX_SERIES];
+    size_t seriesCount;
+    size_t lastSeries;      ///< Series of the previous add(), tried first
+    bool owned;             ///< records were allocated by allocate() rather than passed in
+
+    size_t findSeries(KeyTable::Id name, KeyTable::Id field, uint8_t type);
+    void compact();
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include "GzipWriter.h"
+
+#include <string.h>
+
+namespace {
+
+const size_t MIN_MATCH = 3;
+const size_t MAX_MATCH = 258;
+
+const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+const uint16_t DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+const uint8_t DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// CRC-32 (IEEE) in four-bit steps to keep the table small
+const uint32_t CRC_TABLE[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ CRC_TABLE[crc & 0x0f];
+        crc = (crc >> 4) ^ CRC_TABLE[crc & 0x0f];
+    }
+    return crc;
+}
+
+} // namespace
+
+uint32_t GzipWriter::crc32(const uint8_t* data, size_t length, uint32_t crc) {
+    return ~crc32Update(~crc, data, length);
+}
+
+namespace {
+
+// Huffman codes are defined most significant bit first but packed LSB first
+uint16_t reverseBits(uint16_t code, uint8_t length) {
+    uint16_t reversed = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        reversed = (reversed << 1) | (code & 1);
+        code >>= 1;
+    }
+    return reversed;
+}
+
+} // namespace
+
+GzipWriter::GzipWriter()
+    : sink(nullptr), context(nullptr), fill(0), pos(0), bitBuffer(0), bitCount(0),
+      outLength(0), crc(0), totalIn(0), totalOut(0), failed(false) {}
+
+void GzipWriter::begin(Sink sink, void* context) {
+    this->sink = sink;
+    this->context = context;
+    fill = 0;
+    pos = 0;
+    bitBuffer = 0;
+    bitCount = 0;
+    outLength = 0;
+    crc = 0xffffffff;
+    totalIn = 0;
+    totalOut = 0;
+    failed = false;
+    memset(head, 0, sizeof(head));
+
+    // Member header: magic, deflate, no flags, no mtime, unknown OS
+    static const uint8_t header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff};
+    for (size_t i = 0; i < sizeof(header); i++) {
+        putByte(header[i]);
+    }
+
+    // One final block using the fixed Huffman code
+    putBits(1, 1);
+    putBits(1, 2);
+}
+
+bool GzipWriter::write(const uint8_t* data, size_t length) {
+    crc = crc32Update(crc, data, length);
+    totalIn += length;
+
+    while (length > 0 && !failed) {
+        if (fill == sizeof(window)) {
+            slide();
+        }
+        size_t n = sizeof(window) - fill;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(window + fill, data, n);
+        fill += n;
+        data += n;
+        length -= n;
+        compress(false);
+    }
+    return !failed;
+}
+
+bool GzipWriter::finish() {
+    compress(true);
+    putCode(reverseBits(0, 7), 7);  // End of block (symbol 256)
+    if (bitCount > 0) {
+        putBits(0, 8 - bitCount);
+    }
+
+    uint32_t checksum = ~crc;
+    for (int i = 0; i < 4; i++) {
+        putByte((uint8_t)(checksum >> (8 * i)));
+    }
+    for (int i = 0; i < 4; i++) {
+        putByte((uint8_t)(totalIn >> (8 * i)));
+    }
+    flushOutput();
+    return !failed;
+}
+
+void GzipWriter::compress(bool flush) {
+    while (!failed) {
+        size_t available = fill - pos;
+        // Keep a full match of lookahead until the input is complete
+        if (available == 0 || (!flush && available < MAX_MATCH)) {
+            break;
+        }
+
+        size_t bestLength = 0;
+        size_t bestDistance = 0;
+        if (available >= MIN_MATCH) {
+            const uint8_t* p = window + pos;
+            uint32_t hash = hash3(p);
+            size_t candidate = head[hash];
+            head[hash] = (uint16_t)(pos + 1);
+
+            if (candidate != 0) {
+                const uint8_t* match = window + candidate - 1;
+                size_t limit = available < MAX_MATCH ? available : MAX_MATCH;
+                size_t length = 0;
+                while (length < limit && match[length] == p[length]) {
+                    length++;
+                }
+                if (length >= MIN_MATCH) {
+                    bestLength = length;
+                    bestDistance = p - match;
+                }
+            }
+        }
+
+        if (bestLength > 0) {
+            putMatch(bestLength, bestDistance);
+            // Index the positions inside the match so later lines can refer to them
+            for (size_t i = 1; i < bestLength && pos + i + MIN_MATCH <= fill; i++) {
+                const uint8_t* q = window + pos + i;
+                uint32_t hash = hash3(q);
+                head[hash] = (uint16_t)(pos + i + 1);
+            }
+            pos += bestLength;
+        } else {
+            putLiteral(window[pos]);
+            pos++;
+        }
+    }
+}
+
+void GzipWriter::slide() {
+    // Keep the most recent WINDOW bytes as history for the next input
+    memmove(window, window + WINDOW, fill - WINDOW);
+    fill -= WINDOW;
+    pos -= WINDOW;
+    for (size_t i = 0; i < (1u << HASH_BITS); i++) {
+        head[i] = head[i] > WINDOW ? (uint16_t)(head[i] - WINDOW) : 0;
+    }
+}
+
+void GzipWriter::putBits(uint32_t bits, uint8_t count) {
+    bitBuffer |= bits << bitCount;
+    bitCount += count;
+    while (bitCount >= 8) {
+        putByte((uint8_t)bitBuffer);
+        bitBuffer >>= 8;
+        bitCount -= 8;
+    }
+}
+
+void GzipWriter::putCode(uint16_t code, uint8_t length) {
+    putBits(code, length);
+}
+
+void GzipWriter::putLiteral(uint8_t value) {
+    if (value < 144) {
+        putCode(reverseBits(0x30 + value, 8), 8);
+    } else {
+        putCode(reverseBits(0x190 + value - 144, 9), 9);
+    }
+}
+
+void GzipWriter::putMatch(size_t length, size_t distance) {
+    int code = 28;
+    while (LENGTH_BASE[code] > length) {
+        code--;
+    }
+    uint16_t symbol = 257 + code;
+    if (symbol < 280) {
+        putCode(reverseBits(symbol - 256, 7), 7);
+    } else {
+        putCode(reverseBits(0xc0 + symbol - 280, 8), 8);
+    }
+    putBits(length - LENGTH_BASE[code], LENGTH_EXTRA[code]);
+
+    code = 29;
+    while (DISTANCE_BASE[code] > distance) {
+        code--;
+    }
+    putCode(reverseBits(code, 5), 5);
+    putBits(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code]);
+}
+
+void GzipWriter::putByte(uint8_t value) {
+    out[outLength++] = value;
+    if (outLength == OUT_SIZE) {
+        flushOutput();
+    }
+}
+
+void GzipWriter::flushOutput() {
+    if (outLength == 0 || failed) {
+        outLength = 0;
+        return;
+    }
+    if (sink == nullptr || !sink(context, out, outLength)) {
+        failed = true;
+    }
+    totalOut += outLength;
+    outLength = 0;
+}
@@ -0,0 +1,100 @@
+#ifndef LIGHTWEIGHT_IOT_GZIP_WRITER_H
+#define LIGHTWEIGHT_IOT_GZIP_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef LWIOT_GZIP_WINDOW
+#define LWIOT_GZIP_WINDOW 2048   ///< LZ77 history size in bytes (power of two, at most 16384)
+#endif
+
+/**
+ * @brief Streaming gzip compressor with a small fixed window
+ *
+ * Produces a single deflate block with the fixed Huffman code and a greedy
+ * LZ77 matcher over a LWIOT_GZIP_WINDOW byte history. Line protocol repeats
+ * the measurement and tag set on every line, so even this simple scheme
+ * compresses it several times over while using about 6 KB of RAM with the
+ * default window.
+ *
+ * Compressed bytes are handed to a sink callback in small pieces as they are
+ * produced, so the output never needs to be held in full.
+ */
+class GzipWriter {
+public:
+    /**
+     * @brief Receives compressed output
+     * @return false to abort compression
+     */
+    typedef bool (*Sink)(void* context, const uint8_t* data, size_t length);
+
+    GzipWriter();
+
+    /**
+     * @brief Starts a new gzip member
+     */
+    void begin(Sink sink, void* context);
+
+    /**
+     * @brief Compresses more input
+     * @return false if the sink rejected output
+     */
+    bool write(const uint8_t* data, size_t length);
+
+    /**
+     * @brief Compresses the remaining input and writes the gzip trailer
+     * @return false if the sink rejected output
+     */
+    bool finish();
+
+    /**
+     * @brief Computes a CRC-32 (IEEE), as used in the gzip trailer
+     * @param crc Result of the previous call when checksumming in pieces
+     */
+    static uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+    size_t bytesIn() const { return totalIn; }
+    size_t bytesOut() const { return totalOut; }
+
+private:
+    static const size_t WINDOW = LWIOT_GZIP_WINDOW;
+    // Matches reach up to 2 * WINDOW - 1 bytes back, and deflate distances
+    // and the 16-bit positions in head[] stop at 32768
+    static_assert(WINDOW <= 16384 && (WINDOW & (WINDOW - 1)) == 0,
+                  "LWIOT_GZIP_WINDOW must be a power of two of at most 16384");
+    static const size_t HASH_BITS = 10;
+    static const size_t OUT_SIZE = 128;
+
+    uint8_t window[2 * WINDOW];
+    uint16_t head[1 << HASH_BITS];  ///< Last position + 1 for each 3-byte hash
+    uint8_t out[OUT_SIZE];
+
+    // Index of the 3-byte string at p: multiplicative hashing spreads all
+    // 24 bits over the HASH_BITS the table has
+    static uint32_t hash3(const uint8_t* p) {
+        return (((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    Sink sink;
+    void* context;
+    size_t fill;       ///< Bytes of input held in window
+    size_t pos;        ///< Next window position to compress
+    uint32_t bitBuffer;
+    uint8_t bitCount;
+    size_t outLength;
+    uint32_t crc;
+    size_t totalIn;
+    size_t totalOut;
+    bool failed;
+
+    void compress(bool flush);
+    void slide();
+    void putBits(uint32_t bits, uint8_t count);
+    void putCode(uint16_t code, uint8_t length);
+    void putLiteral(uint8_t value);
+    void putMatch(size_t length, size_t distance);
+    void putByte(uint8_t value);
+    void flushOutput();
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "HTTPClientTransport.h"
+
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+
+#ifndef ARDUINO
+    // The host HTTPClient stand-in in extras/host works with std::string
+    #include <string>
+    using String = std::string;
+#endif
+
+namespace {
+
+// Presents the body slices or the body source of a request to HTTPClient as
+// one stream, so the body is written piece by piece from where it lies
+class BodyStream : public Stream {
+public:
+    explicit BodyStream(const Transport::Request& request)
+        : request(request), slice(0), offset(0), start(0), end(0), failed(false) {}
+
+    // -1 ends HTTPClient's write loop when the body cannot be produced
+    int available() override {
+        const char* data;
+        size_t length = current(&data);
+        return failed ? -1 : (int)length;
+    }
+
+    size_t readBytes(char* buffer, size_t length) override {
+        size_t copied = 0;
+        const char* data;
+        size_t available;
+        while (copied < length && (available = current(&data)) > 0) {
+            size_t n = available < length - copied ? available : length - copied;
+            memcpy(buffer + copied, data, n);
+            copied += n;
+            consume(n);
+        }
+        return copied;
+    }
+
+    int read() override {
+        char value;
+        return readBytes(&value, 1) == 1 ? (uint8_t)value : -1;
+    }
+
+    int peek() override {
+        const char* data;
+        return current(&data) > 0 ? (uint8_t)*data : -1;
+    }
+
+    size_t write(uint8_t) override { return 0; }
+
+private:
+    // The unread bytes of the current slice, or of the source's last piece
+    size_t current(const char** data) {
+        if (request.source != nullptr) {
+            if (start == end && !failed) {
+                long n = request.source->read(pending, sizeof(pending));
+                failed = n < 0;
+                start = 0;
+                end = n > 0 ? n : 0;
+            }
+            *data = pending + start;
+            return end - start;
+        }
+        while (slice < request.bodyCount && offset == request.body[slice].length) {
+            slice++;
+            offset = 0;
+        }
+        if (slice == request.bodyCount) {
+            return 0;
+        }
+        *data = request.body[slice].data + offset;
+        return request.body[slice].length - offset;
+    }
+
+    void consume(size_t n) {
+        if (request.source != nullptr) {
+            start += n;
+        } else {
+            offset += n;
+        }
+    }
+
+    const Transport::Request& request;
+    size_t slice;
+    size_t offset;
+    char pending[512];  ///< Last piece read from a source
+    size_t start;
+    size_t end;
+    bool failed;
+};
+
+} // namespace
+
+HTTPClientTransport::HTTPClientTransport() : http(nullptr), netClient(nullptr), secure(false), lastRequestAt(0) {}
+
+HTTPClientTransport::~HTTPClientTransport() {
+    close();
+    delete http;
+    delete netClient;
+}
+
+bool HTTPClientTransport::linkUp() {
+    return WiFi.status() == WL_CONNECTED;
+}
+
+bool HTTPClientTransport::open(const Request& request, Response* response) {
+    bool https = strncmp(request.url, "https://", 8) == 0;
+    if (http != nullptr && https != secure) {
+        // The client type depends on the scheme
+        close();
+        delete http;
+        delete netClient;
+        http = nullptr;
+        netClient = nullptr;
+    }
+
+    if (http == nullptr) {
+        if (https) {
+            WiFiClientSecure* tls = new (std::nothrow) WiFiClientSecure();
+            if (tls != nullptr) {
+                if (request.caCert != nullptr) {
+#if defined(ESP8266)
+                    tls->setTrustAnchors(new BearSSL::X509List(request.caCert));
+#else
+                    tls->setCACert(request.caCert);
+#endif
+                } else {
+                    tls->setInsecure();
+                }
+            }
+            netClient = tls;
+        } else {
+            netClient = new (std::nothrow) WiFiClient();
+        }
+        http = new (std::nothrow) HTTPClient();
+        if (http == nullptr || netClient == nullptr) {
+            delete http;
+            delete netClient;
+            http = nullptr;
+            netClient = nullptr;
+            response->status = ERROR_MEMORY;
+            return false;
+        }
+        secure = https;
+        static const char* responseHeaders[] = {"Retry-After"};
+        http->collectHeaders(responseHeaders, 1);
+    }
+    http->setReuse(request.keepAlive);
+
+    // Servers drop idle keep-alive connections; reconnect rather than write into a dead socket
+    if (netClient->connected() && request.idleTimeout > 0 && millis() - lastRequestAt >= request.idleTimeout) {
+        netClient->stop();
+        response->idleClosed = true;
+    }
+    response->reused = netClient->connected();
+
+    // begin() on the same client keeps an open connection
+    if (!http->begin(*netClient, request.url)) {
+        response->status = ERROR_INVALID_URL;
+        return false;
+    }
+    http->setTimeout(request.timeout);
+    http->addHeader("Content-Type", "text/plain");
+    http->addHeader("Authorization", String("Token ") + request.token);
+    return true;
+}
+
+int HTTPClientTransport::send(const Request& request, Response* response) {
+    *response = Response();
+    if (!open(request, response)) {
+        return response->status;
+    }
+    if (request.contentEncoding != nullptr) {
+        http->addHeader("Content-Encoding", request.contentEncoding);
+    }
+
+    int status;
+    if (strcmp(request.method, "GET") == 0) {
+        status = http->GET();
+    } else if (request.source == nullptr && request.bodyCount <= 1) {
+        status = http->POST(request.bodyCount == 1 ? (uint8_t*)request.body[0].data : nullptr,
+                            request.bodyCount == 1 ? request.body[0].length : 0);
+    } else {
+        // Several slices or a source: written as they are read, never joined
+        size_t length = request.sourceLength;
+        for (size_t i = 0; request.source == nullptr && i < request.bodyCount; i++) {
+            length += request.body[i].length;
+        }
+        if (request.source != nullptr && (length == 0 || !request.source->rewind())) {
+            // HTTPClient needs the length up front
+            http->end();
+            response->status = ERROR_SEND;
+            return response->status;
+        }
+        BodyStream body(request);
+        status = http->sendRequest("POST", &body, length);
+    }
+    lastRequestAt = millis();
+    response->status = status;
+
+    if (status > 0 && (status < 200 || status >= 300)) {
+        String body = http->getString();
+        size_t n = body.length() < sizeof(response->body) - 1 ? body.length() : sizeof(response->body) - 1;
+        memcpy(response->body, body.c_str(), n);
+        response->body[n] = '\0';
+
+        // Only the delay-seconds form is supported; an HTTP date falls back to the backoff
+        String value = http->header("Retry-After");
+        if (value.length() > 0 && value[0] >= '0' && value[0] <= '9') {
+            response->retryAfter = strtoul(value.c_str(), nullptr, 10) * 1000UL;
+        }
+    }
+
+    // end() keeps the connection open when keep-alive is enabled and the server allows it
+    http->end();
+    if (status < 0 || !request.keepAlive) {
+        // After a transport error the connection state is unknown; start fresh next time
+        netClient->stop();
+    }
+    return status;
+}
+
+void HTTPClientTransport::close() {
+    if (http != nullptr) {
+        http->end();
+    }
+    if (netClient != nullptr) {
+        netClient->stop();
+    }
+}
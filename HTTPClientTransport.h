@@ -0,0 +1,46 @@
+#ifndef LIGHTWEIGHT_IOT_HTTP_CLIENT_TRANSPORT_H
+#define LIGHTWEIGHT_IOT_HTTP_CLIENT_TRANSPORT_H
+
+#include "Transport.h"
+
+class HTTPClient;
+class WiFiClient;
+
+/**
+ * @brief Transport over the Arduino HTTPClient and WiFi
+ *
+ * The default transport. https:// URLs use WiFiClientSecure, verified
+ * against Request::caCert when one is given. One client and connection
+ * are kept for all requests and reopened when the URL's scheme changes.
+ * A body of several slices, or a body source of known length, is streamed
+ * to HTTPClient with its Content-Length rather than joined first. A body
+ * source of unknown length is refused, since HTTPClient cannot send chunked
+ * requests.
+ *
+ * HTTPClient itself uses the heap on every request, for its header Strings
+ * and for the buffer it copies a streamed body through, so this transport
+ * is outside Config::useStaticBuffer's promise of no heap use.
+ */
+class HTTPClientTransport : public Transport {
+public:
+    HTTPClientTransport();
+    ~HTTPClientTransport();
+
+    HTTPClientTransport(const HTTPClientTransport&) = delete;
+    HTTPClientTransport& operator=(const HTTPClientTransport&) = delete;
+
+    bool linkUp() override;
+    int send(const Request& request, Response* response) override;
+    void close() override;
+    bool gathers() const override { return true; }
+
+private:
+    bool open(const Request& request, Response* response);
+
+    HTTPClient* http;
+    WiFiClient* netClient;
+    bool secure;
+    unsigned long lastRequestAt;
+};
+
+#endif
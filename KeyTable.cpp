@@ -0,0 +1,64 @@
+#include "KeyTable.h"
+
+#include <string.h>
+
+#include "ReportFilter.h"
+
+KeyTable::KeyTable() : count(0), used(1) {
+    // ID 0 is the empty string
+    memset(entries, 0, sizeof(entries));
+    memset(slots, 0, sizeof(slots));
+    storage[0] = '\0';
+}
+
+KeyTable& KeyTable::shared() {
+    static KeyTable table;
+    return table;
+}
+
+KeyTable::Id KeyTable::intern(const char* text, LineProtocol::EscapeContext context) {
+    if (text == nullptr || *text == '\0') {
+        return NONE;
+    }
+    uint32_t hash = ReportFilter::hash(text, ReportFilter::FNV_OFFSET ^ (uint32_t)context);
+    const size_t mask = keyTableSlots() - 1;
+
+#if defined(ESP32) || !defined(ARDUINO)
+    std::lock_guard<std::mutex> guard(lock);
+#endif
+    size_t slot = hash & mask;
+    for (; slots[slot] != NONE; slot = (slot + 1) & mask) {
+        const Entry& entry = entries[slots[slot]];
+        if (entry.hash == hash && entry.context == context && strcmp(storage + entry.text, text) == 0) {
+            return slots[slot];
+        }
+    }
+
+    size_t length = strlen(text);
+    size_t escapedLength = LineProtocol::escapedLength(text, length, context);
+    // The escaped form is only stored when it differs
+    size_t needed = length + 1 + (escapedLength != length ? escapedLength + 1 : 0);
+    if (count >= LWIOT_KEY_IDS || used + needed > LWIOT_KEY_BYTES) {
+        return FULL;
+    }
+
+    Id id = (Id)(count + 1);
+    Entry& entry = entries[id];
+    entry.hash = hash;
+    entry.context = (uint8_t)context;
+    entry.length = (uint16_t)length;
+    entry.escapedLength = (uint16_t)escapedLength;
+    entry.text = (uint16_t)used;
+    memcpy(storage + used, text, length + 1);
+    used += length + 1;
+    entry.escaped = entry.text;
+    if (escapedLength != length) {
+        entry.escaped = (uint16_t)used;
+        char* end = LineProtocol::escape(storage + used, text, length, context);
+        *end = '\0';
+        used += escapedLength + 1;
+    }
+    slots[slot] = id;
+    count++;
+    return id;
+}
@@ -0,0 +1,97 @@
+#ifndef LIGHTWEIGHT_IOT_KEY_TABLE_H
+#define LIGHTWEIGHT_IOT_KEY_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(ESP32) || !defined(ARDUINO)
+    #include <mutex>
+#endif
+
+#include "LineProtocol.h"
+
+#ifndef LWIOT_KEY_IDS
+#define LWIOT_KEY_IDS 64      ///< Distinct strings the shared key table holds (at most 4094)
+#endif
+
+#ifndef LWIOT_KEY_BYTES
+#define LWIOT_KEY_BYTES 1024  ///< Characters the shared key table holds, escaped forms included
+#endif
+
+// Hash slots of the key table: a power of two at least a third above
+// LWIOT_KEY_IDS, which keeps probes short
+constexpr size_t keyTableSlots(size_t count = 1) {
+    return count >= LWIOT_KEY_IDS + LWIOT_KEY_IDS / 3 ? count : keyTableSlots(count * 2);
+}
+
+/**
+ * @brief Interning table for measurement names and field keys
+ *
+ * Each distinct string is stored once, together with its escaped form for
+ * the line protocol element it is used as, and is referred to by a small
+ * integer ID. Records such as LightweightIoT::Measurement then hold IDs
+ * instead of strings, and writing them copies names that were escaped when
+ * they were first seen. Strings are never removed, so the table only
+ * takes names from a fixed set, never tag values or string field values;
+ * it lives in static storage of LWIOT_KEY_IDS entries and LWIOT_KEY_BYTES characters
+ * and never touches the heap.
+ */
+class KeyTable {
+public:
+    typedef uint16_t Id;
+
+    static const Id NONE = 0;           ///< Empty string
+    static const Id FULL = 0xFFF;       ///< No room left in the table
+    static const size_t MAX_IDS = 4094; ///< IDs fit in 12 bits, next to FULL
+
+    /**
+     * @brief Checks whether an ID refers to a stored string
+     */
+    static bool isKey(Id id) { return id != NONE && id != FULL; }
+
+    /**
+     * @brief Returns the table shared by all clients
+     */
+    static KeyTable& shared();
+
+    /**
+     * @brief Returns the ID of a string, adding the string if it is new (any thread)
+     * @param context Element the string is used as; the same text in another context has another ID
+     * @return The ID, NONE if the string is empty, or FULL if it does not fit
+     */
+    Id intern(const char* text, LineProtocol::EscapeContext context);
+
+    const char* text(Id id) const { return storage + entries[id].text; }
+    size_t length(Id id) const { return entries[id].length; }
+    const char* escaped(Id id) const { return storage + entries[id].escaped; }
+    size_t escapedLength(Id id) const { return entries[id].escapedLength; }
+
+    size_t size() const { return count; }
+    size_t bytes() const { return used; }
+
+private:
+    static_assert(LWIOT_KEY_IDS <= MAX_IDS, "LWIOT_KEY_IDS must not exceed 4094");
+    static_assert(LWIOT_KEY_BYTES <= 65535, "LWIOT_KEY_BYTES must fit 16-bit offsets");
+
+    struct Entry {
+        uint32_t hash;
+        uint16_t text;           ///< Offset of the NUL-terminated string
+        uint16_t escaped;        ///< Offset of the escaped form; equal to text if nothing needs escaping
+        uint16_t length;
+        uint16_t escapedLength;
+        uint8_t context;
+    };
+
+    KeyTable();
+
+    Entry entries[LWIOT_KEY_IDS + 1];  ///< Indexed by ID; entry 0 is the empty string
+    Id slots[keyTableSlots()];         ///< Hash index of IDs, NONE for a free slot
+    char storage[LWIOT_KEY_BYTES];
+    size_t count;                      ///< Strings held, i.e. the highest ID handed out
+    size_t used;
+#if defined(ESP32) || !defined(ARDUINO)
+    std::mutex lock;
+#endif
+};
+
+#endif
@@ -1,337 +1,2385 @@
 #include "LightweightIoT.h"
 
-// Helper method to escape special characters in measurement names and string values
-String escapeString(String str) {
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP32
+    #include <esp_timer.h>
+#endif
+
+namespace {
+
+// Points in a payload, one per line
+size_t countLines(const char* data, size_t length) {
+    size_t lines = 0;
+    const char* end = data + length;
+    while ((data = (const char*)memchr(data, '\n', end - data)) != nullptr) {
+        lines++;
+        data++;
+    }
+    return lines;
+}
+
+} // namespace
+
+LightweightIoT::LightweightIoT(String token, String org, String bucket) {
+    this->token = token;
+    this->org = org;
+    this->bucket = bucket;
+    this->tagCount = 0;
+    this->tagTextLength = 0;
+    this->fieldPrecisionCount = 0;
+    this->tagSet = nullptr;
+    this->tagSetLength = 0;
+    this->tagSetCapacity = 0;
+    this->tagSetHash = ReportFilter::FNV_OFFSET;
+    this->tagSetDirty = false;
+    this->deadbandCount = 0;
+    this->aggregationCount = 0;
+    this->batchMode = false;
+    this->batchStartedAt = 0;
+    this->lastError = NO_ERROR;
+    this->pointBuffer = nullptr;
+    this->pointBufferSize = 0;
+    this->gzip = nullptr;
+    this->spool = nullptr;
+    this->spoolBuffer = nullptr;
+    this->spoolBufferSize = 0;
+    this->spoolBytes = 0;
+    this->spoolDropped = 0;
+    this->lastSpoolDrainAt = 0;
+    this->lastStatsAt = 0;
+#ifdef LWIOT_HAS_THREADS
+    this->sendPending = false;
+    this->senderStop = false;
+    this->senderActive = false;
+    this->ingestRejected = 0;
+    this->ingestDropped = 0;
+    this->ingestWake = false;
+    this->flushRequested = false;
+    this->ingestWakeMask = 0;
+#ifdef ARDUINO
+    this->senderTask = nullptr;
+#endif
+#endif
+}
+
+LightweightIoT::~LightweightIoT() {
+#ifdef LWIOT_HAS_THREADS
+    stopSender();
+#endif
+    releaseBuffers();
+}
+
+bool LightweightIoT::carveBuffer(size_t size, void** storage) {
+    // Without a reserved region the caller allocates; nullptr tells it to
+    *storage = nullptr;
+    if (!arena.reserved()) {
+        return true;
+    }
+    *storage = arena.allocate(size);
+    return *storage != nullptr;
+}
+
+char* LightweightIoT::allocateBuffer(size_t size) {
+    void* storage;
+    if (!carveBuffer(size, &storage)) {
+        return nullptr;
+    }
+    return storage != nullptr ? (char*)storage : new (std::nothrow) char[size];
+}
+
+void LightweightIoT::releaseBuffer(char* buffer) {
+    // Carved buffers go back with the whole region
+    if (!arena.owns(buffer)) {
+        delete[] buffer;
+    }
+}
+
+bool LightweightIoT::carveBuffers() {
+    // Everything the write and send paths use, so none of it is allocated later
+    tagSetDirty = true;
+    if (!ensurePointBuffer() || !refreshTagSet() || !ensureBatchBuffer()) {
+        return false;
+    }
+#ifdef LWIOT_HAS_THREADS
+    if (config.asyncSend && !ensureSendBuffer()) {
+        return false;
+    }
+#endif
+    if (config.compress && !ensureGzip()) {
+        setError(MEMORY_ERROR, "Failed to allocate compressor");
+        return false;
+    }
+    if (deadbandCount > 0 && !allocateReportFilter()) {
+        setError(MEMORY_ERROR, "Failed to allocate deadband table");
+        return false;
+    }
+    return config.columnBatchSize == 0 || ensureColumns();
+}
+
+void LightweightIoT::releaseBuffers() {
+    // Objects carved from the region are destroyed in place; GzipWriter has nothing to destroy
+    if (arena.owns(spool)) {
+        spool->~Spool();
+    } else {
+        delete spool;
+    }
+    spool = nullptr;
+    recordSpool();
+    if (!arena.owns(gzip)) {
+        delete gzip;
+    }
+    gzip = nullptr;
+    releaseBuffer(spoolBuffer);
+    spoolBuffer = nullptr;
+    spoolBufferSize = 0;
+    releaseBuffer(pointBuffer);
+    pointBuffer = nullptr;
+    pointBufferSize = 0;
+    releaseBuffer(tagSet);
+    tagSet = nullptr;
+    tagSetLength = 0;
+    tagSetCapacity = 0;
+    tagSetDirty = true;
+    batch.release();
+    columns.release();
+#ifdef LWIOT_HAS_THREADS
+    sendBuffer.release();
+    ingest.release();
+#endif
+    reportFilter.release();
+}
+
+size_t LightweightIoT::requiredBufferSize() const {
+    size_t size = 2 * Arena::padded(config.maxPointSize) + Arena::padded(config.staticBufferSize) +
+                  Arena::padded(config.columnBatchSize);
+    if (config.asyncSend) {
+        size += Arena::padded(config.staticBufferSize);
+    }
+    if (config.compress) {
+        // Payloads are compressed while they are sent, so only the compressor takes room
+        size += Arena::padded(sizeof(GzipWriter));
+    }
+    if (config.spool) {
+        size += Arena::padded(sizeof(Spool)) + Arena::padded(config.staticBufferSize);
+    }
+#ifdef LWIOT_HAS_THREADS
+    if (config.ingestQueueSize > 0) {
+        size += Arena::padded(PointQueue::storageSize(config.ingestQueueSize, config.maxPointSize));
+    }
+#endif
+    if (deadbandCount > 0) {
+        size += Arena::padded(ReportFilter::storageSize(config.deadbandSeries));
+    }
+    return size;
+}
+
+bool LightweightIoT::reserveBuffer(size_t size) {
+    if (asyncActive() || ingestActive() || !batch.empty() || !columns.empty()) {
+        setError(INVALID_CONFIG, "Buffers are in use; reserve the static buffer before begin()");
+        return false;
+    }
+    if (size == 0) {
+        size = requiredBufferSize();
+    }
+    releaseBuffers();
+    if (!arena.reserve(size)) {
+        setError(MEMORY_ERROR, "Failed to reserve static buffer");
+        return false;
+    }
+    return true;
+}
+
+void LightweightIoT::freeBuffer() {
+#ifdef LWIOT_HAS_THREADS
+    stopSender();
+#endif
+    countDropped(batch.points() + columns.samples());
+    releaseBuffers();
+    arena.release();
+}
+
+bool LightweightIoT::ensurePointBuffer() {
+    if (pointBuffer != nullptr && pointBufferSize == config.maxPointSize) {
+        return true;
+    }
+
+    releaseBuffer(pointBuffer);
+    pointBuffer = allocateBuffer(config.maxPointSize);
+    pointBufferSize = pointBuffer != nullptr ? config.maxPointSize : 0;
+    if (pointBuffer == nullptr) {
+        setError(MEMORY_ERROR, "Failed to allocate point buffer");
+        return false;
+    }
+    return true;
+}
+
+bool LightweightIoT::refreshTagSet() {
+    if (!tagSetDirty) {
+        return true;
+    }
+
+    LineProtocol::Tag tagRefs[MAX_TAGS];
+    for (int i = 0; i < tagCount; i++) {
+        tagRefs[i].key = tagText + tags[i].key;
+        tagRefs[i].value = tagText + tags[i].value;
+    }
+
+    size_t length = LineProtocol::tagSetLength(tagRefs, tagCount);
+    if (tagSet == nullptr || length + 1 > tagSetCapacity) {
+        // A carved tag set is sized for the longest that fits in a point, so it is carved once
+        size_t capacity = arena.reserved() && length < config.maxPointSize ? config.maxPointSize : length + 1;
+        releaseBuffer(tagSet);
+        tagSet = allocateBuffer(capacity);
+        tagSetCapacity = tagSet != nullptr ? capacity : 0;
+        if (tagSet == nullptr) {
+            tagSetLength = 0;
+            setError(MEMORY_ERROR, "Failed to allocate tag set");
+            return false;
+        }
+    }
+
+    tagSetLength = LineProtocol::renderTagSet(tagSet, length + 1, tagRefs, tagCount);
+    tagSetHash = ReportFilter::hash(tagSet);
+    tagSetDirty = false;
+    return true;
+}
+
+size_t LightweightIoT::encodeFields(char* buffer, size_t capacity, const char* measurement,
+                                    const LineProtocol::Field* fields, size_t count, uint64_t timestamp) {
+    if (count > Point::MAX_FIELDS || !refreshTagSet()) {
+        return 0;
+    }
+    LineProtocol::Field values[Point::MAX_FIELDS];
+    resolvePrecisions(fields, count, values);
+    return LineProtocol::encode(buffer, capacity, measurement, tagSet, tagSetLength, values, count, timestamp);
+}
+
+void LightweightIoT::resolvePrecisions(const LineProtocol::Field* fields, size_t count,
+                                       LineProtocol::Field* values) const {
+    // Float fields without an explicit precision take the configured one
+    for (size_t i = 0; i < count; i++) {
+        values[i] = fields[i];
+        if (values[i].type == LineProtocol::FIELD_FLOAT && values[i].precision == LineProtocol::PRECISION_SHORTEST) {
+            values[i].precision = precisionFor(values[i].key);
+        }
+    }
+}
+
+size_t LightweightIoT::encodedSize(const char* measurement, const LineProtocol::Field* fields, size_t count,
+                                   uint64_t timestamp) {
+    bool writable = false;
+    for (size_t i = 0; i < count && !writable; i++) {
+        writable = LineProtocol::isWritable(fields[i]);
+    }
+    if (!writable || count > Point::MAX_FIELDS || !refreshTagSet()) {
+        return 0;
+    }
+    LineProtocol::Field values[Point::MAX_FIELDS];
+    resolvePrecisions(fields, count, values);
+    return LineProtocol::encodedLength(measurement, tagSetLength, values, count, timestamp);
+}
+
+size_t LightweightIoT::getPointSize(String measurement, String field, String value) {
+    LineProtocol::Field fields[] = {LineProtocol::Field(field.c_str(), value.c_str())};
+    return encodedSize(measurement.c_str(), fields, 1, currentTimestamp());
+}
+
+size_t LightweightIoT::getPointSize(const Point& point) {
+    if (point.overflow) {
+        return 0;
+    }
+    uint64_t timestamp = point.timestamp != 0 ? point.timestamp : currentTimestamp();
+    return encodedSize(point.measurement, point.fields, point.count, timestamp);
+}
+
+uint64_t LightweightIoT::currentTimestamp() {
+    if (config.serverTimestamps) {
+        // 0 leaves the timestamp out; InfluxDB uses the time of arrival
+        return 0;
+    }
+    return scaleTimestamp(clockMillis(), MILLISECONDS, config.writePrecision);
+}
+
+uint64_t LightweightIoT::clockMillis() {
+#ifdef ESP32
+    // 64-bit timer; millis() wraps after 49 days
+    return (uint64_t)(esp_timer_get_time() / 1000);
+#else
+    return millis();
+#endif
+}
+
+size_t LightweightIoT::encodePoint(char* buffer, size_t capacity, const char* measurement, const char* field, float value) {
+    LineProtocol::Field fields[] = {LineProtocol::Field(field, value)};
+    return encodeFields(buffer, capacity, measurement, fields, 1, currentTimestamp());
+}
+
+size_t LightweightIoT::encodePoint(char* buffer, size_t capacity, const char* measurement, const char* field, int value) {
+    LineProtocol::Field fields[] = {LineProtocol::Field(field, value)};
+    return encodeFields(buffer, capacity, measurement, fields, 1, currentTimestamp());
+}
+
+size_t LightweightIoT::encodePoint(char* buffer, size_t capacity, const char* measurement, const char* field, const char* value) {
+    LineProtocol::Field fields[] = {LineProtocol::Field(field, value)};
+    return encodeFields(buffer, capacity, measurement, fields, 1, currentTimestamp());
+}
+
+size_t LightweightIoT::encodePoint(char* buffer, size_t capacity, const Point& point) {
+    if (point.overflow) {
+        return 0;
+    }
+    uint64_t timestamp = point.timestamp != 0 ? point.timestamp : currentTimestamp();
+    return encodeFields(buffer, capacity, point.measurement, point.fields, point.count, timestamp);
+}
+
+size_t LightweightIoT::encodePoint(char* buffer, size_t capacity, const Measurement& measurement) {
+    return encodeMeasurement(buffer, capacity, measurement, measurementTimestamp(measurement));
+}
+
+bool LightweightIoT::begin(String influxUrl) {
+    // Timestamps are written in the configured unit rather than always in nanoseconds
+    static const char* const precisions[] = {"s", "ms", "us", "ns"};
+    this->url = influxUrl + "/api/v2/write?org=" + this->org + "&bucket=" + this->bucket +
+                "&precision=" + precisions[config.writePrecision];
+
+#ifdef LWIOT_HAS_THREADS
+    // The sender owns the connection while it runs
+    stopSender();
+#endif
+
+    // With a static buffer every buffer is carved before anything else allocates
+    if (config.useStaticBuffer && !arena.reserved() && !reserveBuffer()) {
+        return false;
+    }
+    if (arena.reserved() && !carveBuffers()) {
+        return false;
+    }
+
+    // A transport that could not set itself up would fail every request like an outage
+    if (!activeTransport()->ready()) {
+        setError(INVALID_CONFIG, "Transport could not be set up");
+        return false;
+    }
+
+    // The server may have changed; drop any connection to the previous one
+    activeTransport()->close();
+
+    // The spool and the sender must be running before the first outage
+    if (config.spool && !openSpool()) {
+        return false;
+    }
+#ifdef LWIOT_HAS_THREADS
+    if (config.ingestQueueSize == 0) {
+        ingest.release();
+    } else {
+        void* storage;
+        if ((!ingest.allocated() || ingest.slots() < config.ingestQueueSize ||
+             ingest.slotSize() != config.maxPointSize) &&
+            (!carveBuffer(PointQueue::storageSize(config.ingestQueueSize, config.maxPointSize), &storage) ||
+             !ingest.allocate(config.ingestQueueSize, config.maxPointSize, storage))) {
+            setError(MEMORY_ERROR, "Failed to allocate ingest queue");
+            return false;
+        }
+        // Producers only read the tag set; render it before they start
+        refreshTagSet();
+
+        // Without a flush policy every point wakes the sender. With one, a
+        // producer wakes it once a quarter of the queue (or flushPoints) has
+        // filled, sparing a context switch per point; the sender also
+        // collects on its own at least every second and every flushInterval.
+        size_t wakeEvery = 1;
+        if (config.flushBytes > 0 || config.flushPoints > 0 || config.flushInterval > 0) {
+            size_t limit = ingest.slots() / 4;
+            if (config.flushPoints > 0 && config.flushPoints < limit) {
+                limit = config.flushPoints;
+            }
+            while (wakeEvery * 2 <= limit) {
+                wakeEvery *= 2;
+            }
+        }
+        ingestWakeMask = wakeEvery - 1;
+    }
+    if (config.asyncSend && !startSender()) {
+        return false;
+    }
+#endif
+
+    // Check WiFi connection
+    if (!isConnected()) {
+        Serial.println("Error: WiFi not connected");
+        return false;
+    }
+    return true;
+}
+
+bool LightweightIoT::isConnected() {
+    return activeTransport()->linkUp();
+}
+
+Transport* LightweightIoT::activeTransport() {
+    return config.transport != nullptr ? config.transport : &defaultTransport;
+}
+
+void LightweightIoT::setError(ErrorCode code, String message) {
+#ifdef LWIOT_HAS_THREADS
+    // The background sender reports errors too
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    lastError = code;
+    lastErrorMessage = message;
+    if (config.debugMode) {
+        Serial.print("Error (");
+        Serial.print(code);
+        Serial.print("): ");
+        Serial.println(message);
+    }
+}
+
+void LightweightIoT::clearError() {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    lastError = NO_ERROR;
+    lastErrorMessage = "";
+}
+
+String LightweightIoT::getLastErrorMessage() {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    return lastErrorMessage;
+}
+
+bool LightweightIoT::isRetryable(int httpCode) {
+    // Transport errors, timeouts, rate limiting and server errors may succeed
+    // later; anything else (bad line protocol, bad token, ...) never will
+    return httpCode < 0 || httpCode == 408 || httpCode == 429 || (httpCode >= 500 && httpCode != 501);
+}
+
+LightweightIoT::SendStatus LightweightIoT::scheduleRetry(int httpCode, unsigned long retryAfter) {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    unsigned long now = millis();
+    if (!retry.pending) {
+        retry.attempts = 0;
+        retry.firstFailureAt = now;
+    }
+
+    bool budgetSpent = config.retryBudget > 0 && now - retry.firstFailureAt >= config.retryBudget;
+    if (!isRetryable(httpCode) || retry.attempts >= config.maxRetries || budgetSpent) {
+        bool fatal = !isRetryable(httpCode);
+        retry = RetryState();
+        return fatal ? SEND_FAILED : SEND_GAVE_UP;
+    }
+
+    // Capped exponential backoff. The delay is drawn from its upper half so
+    // that devices which failed together do not all retry at the same moment.
+    unsigned long backoff = config.retryDelay;
+    for (uint8_t i = 0; i < retry.attempts && backoff < config.maxRetryDelay; i++) {
+        backoff *= 2;
+    }
+    if (backoff > config.maxRetryDelay) {
+        backoff = config.maxRetryDelay;
+    }
+    unsigned long wait = backoff / 2 + random(backoff / 2 + 1);
+    if (retryAfter > wait) {
+        wait = retryAfter;
+    }
+
+    if (config.debugMode) {
+        Serial.print("Retry attempt ");
+        Serial.print(retry.attempts + 1);
+        Serial.print(" of ");
+        Serial.print(config.maxRetries);
+        Serial.print(" in ");
+        Serial.print(wait);
+        Serial.println(" ms");
+    }
+
+    retry.pending = true;
+    retry.attempts++;
+    retry.nextAttemptAt = now + wait;
+    stats.retries++;
+    return SEND_RETRY;
+}
+
+void LightweightIoT::deferRetry(unsigned long delayMs) {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    unsigned long now = millis();
+    if (!retry.pending) {
+        retry.attempts = 0;
+        retry.firstFailureAt = now;
+    }
+    retry.pending = true;
+    retry.nextAttemptAt = now + delayMs;
+}
+
+void LightweightIoT::resetRetry() {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    retry = RetryState();
+}
+
+unsigned long LightweightIoT::getNextRetryTime() const {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    if (!retry.pending) {
+        return 0;
+    }
+    // 0 means "nothing waiting", so never report it as a time
+    return retry.nextAttemptAt != 0 ? retry.nextAttemptAt : 1;
+}
+
+bool LightweightIoT::retryDue() const {
+    unsigned long next = getNextRetryTime();
+    return next == 0 || (long)(millis() - next) >= 0;
+}
+
+LightweightIoT::SendStatus LightweightIoT::sendToInfluxDB(const Transport::Slice* body, size_t count) {
+    Transport::Request request;
+    request.body = body;
+    request.bodyCount = count;
+    return sendToInfluxDB(request);
+}
+
+LightweightIoT::SendStatus LightweightIoT::sendToInfluxDB(Transport::Request& request) {
+    if (!isConnected()) {
+        setError(NOT_CONNECTED, "WiFi not connected");
+        // Nothing was sent, so waiting for the link does not use up an attempt
+        deferRetry(config.reconnectDelay);
+        return SEND_RETRY;
+    }
+
+    unsigned long retryAfter = 0;
+    int httpResponseCode = postPayload(request, &retryAfter);
+    if (httpResponseCode >= 200 && httpResponseCode < 300) {
+        resetRetry();
+        return SEND_OK;
+    }
+    return scheduleRetry(httpResponseCode, retryAfter);
+}
+
+int LightweightIoT::postPayload(Transport::Request& request, unsigned long* retryAfter) {
+    request.url = url.c_str();
+    request.token = token.c_str();
+    request.timeout = config.timeout;
+    request.keepAlive = config.keepAlive;
+    request.idleTimeout = config.keepAliveIdleTimeout;
+    request.caCert = config.caCert;
+
+    Transport::Response response;
+    unsigned long startedAt = millis();
+    {
+#ifdef LWIOT_HAS_THREADS
+        std::lock_guard<std::mutex> guard(transportLock);
+#endif
+        activeTransport()->send(request, &response);
+    }
+    int httpResponseCode = response.status;
+    *retryAfter = response.retryAfter;
+
+    if (httpResponseCode == Transport::ERROR_MEMORY) {
+        setError(MEMORY_ERROR, "Failed to allocate HTTP client");
+        return httpResponseCode;
+    }
+    if (httpResponseCode == Transport::ERROR_INVALID_URL) {
+        setError(INVALID_CONFIG, "Invalid InfluxDB URL");
+        return httpResponseCode;
+    }
+    if (httpResponseCode == Transport::ERROR_SETUP) {
+        setError(INVALID_CONFIG, "Transport could not be set up");
+        return httpResponseCode;
+    }
+
+    {
+#ifdef LWIOT_HAS_THREADS
+        // The sender updates these while writers read them
+        std::lock_guard<std::mutex> guard(stateLock);
+#endif
+        connectionStats.requests++;
+        if (response.idleClosed) {
+            connectionStats.idleCloses++;
+        }
+        if (response.reused) {
+            connectionStats.reused++;
+        } else {
+            connectionStats.handshakes++;
+        }
+        if (httpResponseCode < 0) {
+            // Transport error: the connection state is unknown, the transport starts fresh next time
+            connectionStats.brokenCloses++;
+        }
+        stats.requestMillis.add(millis() - startedAt);
+    }
+    // TLS handshakes are the largest transient allocation
+    sampleHeap();
+
+    if (httpResponseCode < 200 || httpResponseCode >= 300) {
+        char status[24];
+        snprintf(status, sizeof(status), "HTTP error %d", httpResponseCode);
+        String error = status;
+        if (response.body[0] != '\0') {
+            error += ": ";
+            error += response.body;
+        }
+        setError(HTTP_ERROR, error);
+    }
+    return httpResponseCode;
+}
+
+bool LightweightIoT::ensureBatchBuffer() {
+    if (batch.capacity() == config.staticBufferSize) {
+        return true;
+    }
+    if (!batch.empty()) {
+        // Resize once the queued points have been sent
+        return batch.capacity() > 0;
+    }
+    void* storage;
+    if (!carveBuffer(config.staticBufferSize, &storage) || !batch.allocate(config.staticBufferSize, (char*)storage)) {
+        setError(MEMORY_ERROR, "Failed to allocate batch buffer");
+        return false;
+    }
+    return true;
+}
+
+bool LightweightIoT::addToBatch(const char* lineProtocol, size_t length) {
+    if (!ensureBatchBuffer()) {
+        return false;
+    }
+    if (!batch.append(lineProtocol, length)) {
+        // Make room by sending what is queued rather than rejecting the point
+        flush(FLUSH_FULL);
+        if (!batch.append(lineProtocol, length)) {
+            setError(BATCH_FULL, "Point does not fit in the batch buffer");
+            countDropped(1);
+            return false;
+        }
+    }
+    if (batch.points() + columns.samples() == 1) {
+        batchStartedAt = millis();
+    }
+
+    // A failed flush is reported through getLastError(); the point itself was accepted
+    FlushReason reason = flushDue();
+    if (reason != FLUSH_NONE) {
+        flush(reason);
+    }
+    return true;
+}
+
+bool LightweightIoT::isBatching() const {
+    return batchMode || config.flushBytes > 0 || config.flushPoints > 0 || config.flushInterval > 0 ||
+           asyncActive();
+}
+
+LightweightIoT::FlushReason LightweightIoT::flushDue() const {
+    size_t points = batch.points() + columns.samples();
+    if (points == 0) {
+        return FLUSH_NONE;
+    }
+    if (!asyncActive() && getNextRetryTime() != 0) {
+        // A failed send is waiting; it goes out again once its backoff has passed.
+        // With a spool the flush policy still applies and moves the points to flash.
+        if (retryDue()) {
+            return FLUSH_RETRY;
+        }
+        if (spool == nullptr || !config.spool) {
+            return FLUSH_NONE;
+        }
+    }
+    bool hasPolicy = config.flushBytes > 0 || config.flushPoints > 0 || config.flushInterval > 0;
+    if (!hasPolicy && !batchMode && (asyncActive() || ingestActive())) {
+        // Without a policy every write goes out as soon as the sender or loop() gets to it
+        return FLUSH_IMMEDIATE;
+    }
+    // Held samples count at their raw size, so a budget holds many more of them
+    if (config.flushPoints > 0 && points >= config.flushPoints) {
+        return FLUSH_POINTS;
+    }
+    if (config.flushBytes > 0 && batch.bytes() + columns.bytes() >= config.flushBytes) {
+        return FLUSH_BYTES;
+    }
+    if (config.flushInterval > 0 && millis() - batchStartedAt >= config.flushInterval) {
+        return FLUSH_INTERVAL;
+    }
+    return FLUSH_NONE;
+}
+
+void LightweightIoT::loop() {
+    if (aggregationCount > 0) {
+        closeWindows(false);
+    }
+    // With concurrent writes the background sender owns the batch
+    if (!ingestActive() || !asyncActive()) {
+        collectIngest();
+        FlushReason reason = flushDue();
+        if (reason != FLUSH_NONE) {
+            flush(reason);
+        }
+    }
+    if (!asyncActive()) {
+        drainSpool();
+    }
+    sampleHeap();
+    if (config.statsInterval > 0 && millis() - lastStatsAt >= config.statsInterval) {
+        lastStatsAt = millis();
+        writeStats();
+    }
+}
+
+void LightweightIoT::setConfig(Config config) {
+    this->config = config;
+}
+
+void LightweightIoT::beginBatch() {
+    batchMode = true;
+}
+
+bool LightweightIoT::endBatch() {
+    if (!batchMode || (batch.empty() && columns.empty() && !ingestActive())) {
+        return false;
+    }
+    bool result = flushBatch();
+    batchMode = false;
+    return result;
+}
+
+void LightweightIoT::clearBatch() {
+    batch.clear();
+    columns.clear();
+}
+
+bool LightweightIoT::flushBatch() {
+#ifdef LWIOT_HAS_THREADS
+    if (ingestActive()) {
+        if (asyncActive()) {
+            // The sender owns the batch; it flushes on its next pass
+            flushRequested.store(true, std::memory_order_release);
+            wakeSender();
+            return true;
+        }
+        collectIngest();
+    }
+#endif
+    return flush(FLUSH_MANUAL);
+}
+
+bool LightweightIoT::flush(FlushReason reason) {
+    // Held samples become text as far as the batch has room
+    renderColumns();
+    if (!batch.empty()) {
+#ifdef LWIOT_HAS_THREADS
+        // With concurrent writes this runs on the sender while producers read the statistics
+        std::lock_guard<std::mutex> guard(stateLock);
+#endif
+        stats.flushes[reason]++;
+        stats.flushBytes.add(batch.bytes());
+    }
+#ifdef LWIOT_HAS_THREADS
+    if (asyncActive()) {
+        // The sender takes one payload at a time; samples left over go with the next flush
+        return handOffBatch();
+    }
+#endif
+    bool result = drainBatch(batch);
+    while (result && !columns.empty()) {
+        // Samples that did not fit go out in further payloads
+        renderColumns();
+        result = drainBatch(batch);
+    }
+    return result;
+}
+
+bool LightweightIoT::ensureColumns() {
+    size_t bytes = config.columnBatchSize - config.columnBatchSize % ColumnBatch::RECORD_SIZE;
+    if (columns.capacity() == bytes) {
+        return true;
+    }
+    if (!columns.empty()) {
+        // Resize once the held samples have been sent
+        return columns.capacity() > 0;
+    }
+    void* storage;
+    if (!carveBuffer(bytes, &storage) || !columns.allocate(bytes, storage)) {
+        setError(MEMORY_ERROR, "Failed to allocate column batch");
+        return false;
+    }
+    return true;
+}
+
+bool LightweightIoT::queueSample(const char* measurement, const LineProtocol::Field& field) {
+    if (config.columnBatchSize == 0 || !isBatching() || ingestActive()) {
+        return false;
+    }
+    KeyTable& keys = KeyTable::shared();
+    return queueSample(keys.intern(measurement, LineProtocol::ESCAPE_MEASUREMENT),
+                       keys.intern(field.key, LineProtocol::ESCAPE_KEY), field);
+}
+
+bool LightweightIoT::queueSample(KeyTable::Id name, KeyTable::Id field, const LineProtocol::Field& value) {
+    // Concurrent writers encode into the ingest queue; only the single writer holds samples
+    if (config.columnBatchSize == 0 || !isBatching() || ingestActive() || !KeyTable::isKey(name) ||
+        !KeyTable::isKey(field) || !ensureColumns()) {
+        return false;
+    }
+    clearError();
+    ColumnBatch::Status status = columns.add(name, field, value, clockMillis());
+    if (status == ColumnBatch::FULL) {
+        // Make room by sending what is held, as for a full text batch
+        flush(FLUSH_FULL);
+        status = columns.add(name, field, value, clockMillis());
+    }
+    if (status != ColumnBatch::ADDED) {
+        // Written as text instead
+        return false;
+    }
+    if (batch.points() + columns.samples() == 1) {
+        batchStartedAt = millis();
+    }
+
+    FlushReason reason = flushDue();
+    if (reason != FLUSH_NONE) {
+        flush(reason);
+    }
+    return true;
+}
+
+void LightweightIoT::renderColumns() {
+    if (columns.empty() || !ensureBatchBuffer() || !refreshTagSet()) {
+        return;
+    }
+    const KeyTable& keys = KeyTable::shared();
+    ColumnBatch::Sample sample;
+    while (columns.front(&sample)) {
+        const ColumnBatch::Series& series = *sample.series;
+        const char* key = keys.text(series.field);
+        LineProtocol::Field value = series.type == LineProtocol::FIELD_FLOAT
+                                        ? LineProtocol::Field(key, sample.value.f)
+                                        : LineProtocol::Field(key, (long)sample.value.i);
+        if (value.type == LineProtocol::FIELD_FLOAT) {
+            value.precision = precisionFor(key);
+        }
+
+        // Room for the names, the value, two separators, '=' and a 20-digit timestamp
+        size_t longest = keys.escapedLength(series.name) + tagSetLength + keys.escapedLength(series.field) +
+                         LineProtocol::MAX_NUMBER_LENGTH + 23;
+        char* line = batch.claim(longest);
+        if (line == nullptr) {
+            if (!batch.empty()) {
+                // The rest goes in the next payload
+                return;
+            }
+            // Would not fit even in an empty batch
+            setError(BATCH_FULL, "Point does not fit in the batch buffer");
+            countDropped(1);
+            columns.pop();
+            continue;
+        }
+
+        unsigned long startedAt = micros();
+        uint64_t timestamp =
+            config.serverTimestamps ? 0 : scaleTimestamp(sample.time, MILLISECONDS, config.writePrecision);
+        size_t length = LineProtocol::encodeEscaped(line, longest + 1, keys.escaped(series.name),
+                                                    keys.escapedLength(series.name), tagSet, tagSetLength,
+                                                    keys.escaped(series.field), keys.escapedLength(series.field),
+                                                    value, timestamp);
+        columns.pop();
+        if (length > 0) {
+            batch.commit(length);
+            recordEncode(startedAt, length);
+        }
+    }
+}
+
+void LightweightIoT::closeColumns() {
+    // Held samples belong to the tag set they were written under
+    renderColumns();
+    if (columns.empty()) {
+        return;
+    }
+    flush(FLUSH_FULL);
+    if (!columns.empty()) {
+        setError(BATCH_FULL, "Batch full; held samples dropped on tag change");
+        countDropped(columns.samples());
+        columns.clear();
+    }
+}
+
+bool LightweightIoT::drainBatch(BatchBuffer& buffer) {
+    // Send the queued points in place. A wrapped ring is two runs; a
+    // transport that gathers sends both in one request, others one at a time.
+    bool result = true;
+    const char* data[2];
+    size_t lengths[2];
+    size_t count;
+    while ((count = buffer.peekRuns(data, lengths)) > 0) {
+        Transport::Slice runs[2];
+        if (!activeTransport()->gathers()) {
+            count = 1;
+        }
+        for (size_t i = 0; i < count; i++) {
+            runs[i].data = data[i];
+            runs[i].length = lengths[i];
+        }
+
+        if (!retryDue()) {
+            // Still backing off; move the runs to flash if possible, else keep them queued
+            if (spoolRuns(buffer, runs, count) < count) {
+                return false;
+            }
+            continue;
+        }
+        SendStatus status = sendBatchRun(runs, count);
+        if (status == SEND_RETRY || status == SEND_GAVE_UP) {
+            size_t spooled = spoolRuns(buffer, runs, count);
+            if (spooled == count) {
+                continue;
+            }
+            if (status == SEND_RETRY) {
+                return false;
+            }
+            runs[0] = runs[spooled];
+            count = spooled == 0 ? count : 1;
+        }
+        result = status == SEND_OK && result;
+        size_t points = buffer.points();
+        for (size_t i = 0; i < count; i++) {
+            buffer.consume(runs[i].length);
+        }
+        if (status != SEND_OK) {
+            countDropped(points - buffer.points());
+        }
+    }
+    return result;
+}
+
+size_t LightweightIoT::spoolRuns(BatchBuffer& buffer, const Transport::Slice* runs, size_t count) {
+    // One spool record per run, so a record never spans the ring's wrap
+    size_t spooled = 0;
+    while (spooled < count && spoolRun(runs[spooled].data, runs[spooled].length)) {
+        buffer.consume(runs[spooled].length);
+        spooled++;
+    }
+    return spooled;
+}
+
+bool LightweightIoT::openSpool() {
+    void* storage;
+    if (spool == nullptr && carveBuffer(sizeof(Spool), &storage)) {
+        spool = storage != nullptr ? new (storage) Spool() : new (std::nothrow) Spool();
+    }
+    if (spoolBuffer == nullptr) {
+        spoolBuffer = allocateBuffer(config.staticBufferSize);
+        spoolBufferSize = spoolBuffer != nullptr ? config.staticBufferSize : 0;
+    }
+    if (spool == nullptr || spoolBuffer == nullptr) {
+        setError(MEMORY_ERROR, "Failed to allocate spool");
+        return false;
+    }
+    if (!spool->begin(config.spoolPath, config.spoolSize, config.spoolSegmentSize)) {
+        setError(SPOOL_ERROR, "Failed to open spool");
+        return false;
+    }
+    recordSpool();
+    return true;
+}
+
+bool LightweightIoT::spoolRun(const char* data, size_t length) {
+    if (spool == nullptr || !config.spool) {
+        return false;
+    }
+    bool appended = spool->append(data, length);
+    recordSpool();
+    if (!appended) {
+        setError(SPOOL_ERROR, "Failed to write to spool");
+        return false;
+    }
+    return true;
+}
+
+void LightweightIoT::recordSpool() {
+    // The spool belongs to the sending thread; others read these copies
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    spoolBytes = spool != nullptr ? spool->bytes() : 0;
+    spoolDropped = spool != nullptr ? spool->dropped() : 0;
+}
+
+void LightweightIoT::drainSpool() {
+    if (spool == nullptr || spool->empty() || !retryDue() ||
+        millis() - lastSpoolDrainAt < config.spoolDrainInterval) {
+        return;
+    }
+    lastSpoolDrainAt = millis();
+
+    // Oldest first, one payload per interval so live data still gets through
+    size_t length = spool->peek(spoolBuffer, spoolBufferSize);
+    if (length == 0) {
+        return;
+    }
+    Transport::Slice run = {spoolBuffer, length};
+    switch (sendBatchRun(&run, 1)) {
+        case SEND_OK:
+            spool->consume();
+            break;
+        case SEND_FAILED:
+            countDropped(countLines(spoolBuffer, length));
+            spool->consume();
+            break;
+        case SEND_GAVE_UP:
+            // Spooled data is only ever dropped by the size bound; try again later
+            deferRetry(config.maxRetryDelay);
+            break;
+        default:
+            break;
+    }
+    recordSpool();
+}
+
+size_t LightweightIoT::getSpoolBytes() const {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    return spoolBytes;
+}
+
+LightweightIoT::ConnectionStats LightweightIoT::getConnectionStats() const {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    return connectionStats;
+}
+
+bool LightweightIoT::asyncActive() const {
+#ifdef LWIOT_HAS_THREADS
+    return senderActive.load(std::memory_order_acquire);
+#else
+    return false;
+#endif
+}
+
+bool LightweightIoT::isSending() const {
+#ifdef LWIOT_HAS_THREADS
+    return sendPending.load(std::memory_order_acquire);
+#else
+    return false;
+#endif
+}
+
+#ifdef LWIOT_HAS_THREADS
+bool LightweightIoT::handOffBatch() {
+    if (batch.empty()) {
+        return true;
+    }
+    if (sendPending.load(std::memory_order_acquire)) {
+        // Sender still busy with the previous batch; keep queuing
+        return false;
+    }
+
+    // The sender is idle, so the spare buffer belongs to this side
+    if (!ensureSendBuffer()) {
+        return false;
+    }
+    batch.swap(sendBuffer);
+    sendPending.store(true, std::memory_order_release);
+    wakeSender();
+    return true;
+}
+
+bool LightweightIoT::ensureSendBuffer() {
+    if (sendBuffer.capacity() == batch.capacity()) {
+        return true;
+    }
+    void* storage;
+    if (!carveBuffer(batch.capacity(), &storage) || !sendBuffer.allocate(batch.capacity(), (char*)storage)) {
+        setError(MEMORY_ERROR, "Failed to allocate send buffer");
+        return false;
+    }
+    return true;
+}
+
+void LightweightIoT::senderMain() {
+    while (!senderStop.load(std::memory_order_acquire)) {
+        // Sleep until woken, a pending retry is due or spooled data can be drained
+        unsigned long waitMs = spool != nullptr && !spool->empty() ? config.spoolDrainInterval : 1000;
+        if (waitMs > 1000) {
+            waitMs = 1000;
+        }
+        if (ingestActive() && config.flushInterval > 0 && config.flushInterval < waitMs) {
+            // No loop() flushes for us
+            waitMs = config.flushInterval;
+        }
+        unsigned long next = getNextRetryTime();
+        if (next != 0) {
+            long remaining = (long)(next - millis());
+            waitMs = remaining <= 0 ? 0 : ((unsigned long)remaining < waitMs ? remaining : waitMs);
+        }
+#ifdef ARDUINO
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+#else
+        {
+            std::unique_lock<std::mutex> lock(senderLock);
+            senderWake.wait_for(lock, std::chrono::milliseconds(waitMs), [this]() {
+                return (sendPending.load(std::memory_order_acquire) && retryDue()) ||
+                       ingestWake.load(std::memory_order_acquire) ||
+                       flushRequested.load(std::memory_order_acquire) ||
+                       senderStop.load(std::memory_order_acquire);
+            });
+        }
+#endif
+        if (ingestActive()) {
+            // Move the producers' points into the batch, then apply the flush policy
+            ingestWake.store(false);
+            collectIngest();
+            FlushReason reason = flushRequested.exchange(false, std::memory_order_acq_rel) ? FLUSH_MANUAL : flushDue();
+            if (reason != FLUSH_NONE) {
+                flush(reason);
+            }
+        }
+        if (sendPending.load(std::memory_order_acquire)) {
+            // A payload waiting for a retry keeps the buffer until it is delivered or dropped
+            drainBatch(sendBuffer);
+            if (sendBuffer.empty()) {
+                sendPending.store(false, std::memory_order_release);
+            }
+        }
+        drainSpool();
+    }
+    senderActive.store(false, std::memory_order_release);
+}
+
+void LightweightIoT::wakeSender() {
+#ifdef ARDUINO
+    xTaskNotifyGive(senderTask);
+#else
+    {
+        std::lock_guard<std::mutex> guard(senderLock);
+    }
+    senderWake.notify_one();
+#endif
+}
+
+bool LightweightIoT::startSender() {
+    if (asyncActive()) {
+        return true;
+    }
+    senderStop.store(false);
+    senderActive.store(true, std::memory_order_release);
+#ifdef ARDUINO
+    if (xTaskCreate(senderTaskMain, "lwiot_sender", config.senderStackSize, this,
+                    config.senderPriority, &senderTask) != pdPASS) {
+        senderActive.store(false);
+        setError(MEMORY_ERROR, "Failed to start sender task");
+        return false;
+    }
+#else
+    senderThread = std::thread(&LightweightIoT::senderMain, this);
+#endif
+    return true;
+}
+
+void LightweightIoT::stopSender() {
+#ifdef ARDUINO
+    if (senderTask == nullptr) {
+        return;
+    }
+    senderStop.store(true, std::memory_order_release);
+    wakeSender();
+    while (senderActive.load(std::memory_order_acquire)) {
+        delay(1);
+    }
+    senderTask = nullptr;
+#else
+    if (!senderThread.joinable()) {
+        return;
+    }
+    senderStop.store(true, std::memory_order_release);
+    wakeSender();
+    senderThread.join();
+#endif
+    // Return points still waiting for a retry so a later flush can send them
+    if (!sendBuffer.empty() && batch.empty()) {
+        batch.swap(sendBuffer);
+    }
+    sendBuffer.clear();
+    sendPending.store(false, std::memory_order_release);
+}
+
 #ifdef ARDUINO
-    str.replace(" ", "\ ");
-    str.replace(",", "\\,");
-    str.replace("=", "\\=");
+void LightweightIoT::senderTaskMain(void* arg) {
+    static_cast<LightweightIoT*>(arg)->senderMain();
+    vTaskDelete(nullptr);
+}
+#endif
+#endif
+
+namespace {
+
+// Compresses the runs of a payload while the transport reads it, so the
+// compressed body is never held in full. Compression is deterministic, so
+// every pass over the body yields the same bytes.
+class GzipSource : public Transport::BodySource {
+public:
+    GzipSource(GzipWriter& gzip, const Transport::Slice* runs, size_t count)
+        : gzip(gzip), runs(runs), count(count) {
+        rewind();
+    }
+
+    // Compressed length, found by a pass that keeps none of the output
+    size_t measure() {
+        gzip.begin(discard, nullptr);
+        for (size_t i = 0; i < count; i++) {
+            gzip.write((const uint8_t*)runs[i].data, runs[i].length);
+        }
+        gzip.finish();
+        size_t length = gzip.bytesOut();
+        rewind();
+        return length;
+    }
+
+    bool rewind() override {
+        gzip.begin(collect, this);
+        run = 0;
+        offset = 0;
+        start = 0;
+        end = 0;
+        finished = false;
+        failed = false;
+        return true;
+    }
+
+    long read(char* buffer, size_t capacity) override {
+        while (start == end && !finished && !failed) {
+            start = 0;
+            end = 0;
+            if (run == count) {
+                gzip.finish();
+                finished = true;
+            } else {
+                // A step of input yields at most a few hundred bytes of output
+                size_t n = runs[run].length - offset < STEP ? runs[run].length - offset : STEP;
+                gzip.write((const uint8_t*)runs[run].data + offset, n);
+                offset += n;
+                if (offset == runs[run].length) {
+                    run++;
+                    offset = 0;
+                }
+            }
+        }
+        if (failed) {
+            return -1;
+        }
+        size_t n = end - start < capacity ? end - start : capacity;
+        memcpy(buffer, pending + start, n);
+        start += n;
+        return (long)n;
+    }
+
+private:
+    static const size_t STEP = 128;  ///< Input compressed per refill
+
+    static bool discard(void*, const uint8_t*, size_t) {
+        return true;
+    }
+
+    static bool collect(void* context, const uint8_t* data, size_t length) {
+        GzipSource* source = (GzipSource*)context;
+        if (source->end + length > sizeof(source->pending)) {
+            source->failed = true;
+            return false;
+        }
+        memcpy(source->pending + source->end, data, length);
+        source->end += length;
+        return true;
+    }
+
+    GzipWriter& gzip;
+    const Transport::Slice* runs;
+    size_t count;
+    size_t run;
+    size_t offset;
+    // Output of one step: up to 9 bits per input byte plus the writer's
+    // 128-byte output buffer; the last step adds the held lookahead and trailer
+    uint8_t pending[640];
+    size_t start;
+    size_t end;
+    bool finished;
+    bool failed;
+};
+
+} // namespace
+
+LightweightIoT::SendStatus LightweightIoT::sendBatchRun(const Transport::Slice* runs, size_t count) {
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+        length += runs[i].length;
+    }
+    if (!config.compress || length < config.compressThreshold || !ensureGzip()) {
+        return sendToInfluxDB(runs, count);
+    }
+
+    // Compressed while it is sent, a fixed piece at a time whatever the batch size
+    GzipSource source(*gzip, runs, count);
+    Transport::Request request;
+    request.contentEncoding = "gzip";
+    request.source = &source;
+    if (!activeTransport()->chunks()) {
+        // The length goes in the header; a counting pass costs time but no memory
+        request.sourceLength = source.measure();
+        if (request.sourceLength >= length) {
+            // Compression is an optimization; not worth it here
+            return sendToInfluxDB(runs, count);
+        }
+    }
+    return sendToInfluxDB(request);
+}
+
+bool LightweightIoT::ensureGzip() {
+    void* storage;
+    if (gzip == nullptr && carveBuffer(sizeof(GzipWriter), &storage)) {
+        gzip = storage != nullptr ? new (storage) GzipWriter() : new (std::nothrow) GzipWriter();
+    }
+    return gzip != nullptr;
+}
+
+bool LightweightIoT::writeFields(const char* measurement, const LineProtocol::Field* fields, size_t count,
+                                 uint64_t timestamp, bool now) {
+    if (count > Point::MAX_FIELDS) {
+        rejectPoint("Too many fields in one point");
+        return false;
+    }
+    bool writable = false;
+    for (size_t i = 0; i < count && !writable; i++) {
+        writable = LineProtocol::isWritable(fields[i]);
+    }
+    if (!writable) {
+        // NaN and infinity have no line protocol form; usually a failed sensor read
+        rejectPoint(count == 0 ? "Point has no fields" : "Field value is NaN or infinite");
+        return false;
+    }
+    LineProtocol::Field remaining[Point::MAX_FIELDS];
+    if (aggregationCount > 0) {
+        count = aggregate(measurement, fields, count, remaining);
+        if (count == 0) {
+            return true;
+        }
+        fields = remaining;
+    }
+    if (!reportDue(measurement, fields, count)) {
+        return true;
+    }
+    // A lone number stamped with the current time can be held raw until the flush
+    if (now && count == 1 && queueSample(measurement, fields[0])) {
+        return true;
+    }
+
+    PointTarget target;
+    if (!beginPoint(&target)) {
+        return false;
+    }
+    unsigned long startedAt = micros();
+    size_t length = encodeFields(target.data, target.capacity, measurement, fields, count, timestamp);
+    return submitPoint(target, length, startedAt);
+}
+
+bool LightweightIoT::beginPoint(PointTarget* target) {
+#ifdef LWIOT_HAS_THREADS
+    if (ingestActive()) {
+        // Producers encode in place and never wait for the flusher or each other
+        target->data = ingest.claim(&target->ticket);
+        target->capacity = ingest.slotSize();
+        target->queued = true;
+        if (target->data == nullptr) {
+            // Reported once per collection round; the count is in Stats::pointsDropped
+            if (ingestDropped.fetch_add(1, std::memory_order_relaxed) == 0) {
+                setError(BATCH_FULL, "Ingest queue full");
+            }
+            return false;
+        }
+        return true;
+    }
+#endif
+    clearError();
+    if (!ensurePointBuffer()) {
+        return false;
+    }
+    target->data = pointBuffer;
+    target->capacity = pointBufferSize;
+    target->ticket = 0;
+    target->queued = false;
+    return true;
+}
+
+bool LightweightIoT::submitPoint(const PointTarget& target, size_t length, unsigned long startMicros) {
+#ifdef LWIOT_HAS_THREADS
+    if (target.queued) {
+        ingest.publish(target.ticket, length, length > 0 ? micros() - startMicros : 0);
+        if (length == 0) {
+            rejectPoint("Point exceeds maxPointSize");
+            return false;
+        }
+        // At most one wake-up per collection round, however many producers write
+        if ((target.ticket & ingestWakeMask) == 0 && asyncActive() && !ingestWake.exchange(true)) {
+            wakeSender();
+        }
+        return true;
+    }
+#endif
+    recordEncode(startMicros, length);
+    return submitPoint(length);
+}
+
+void LightweightIoT::rejectPoint(const char* message, ErrorCode code) {
+#ifdef LWIOT_HAS_THREADS
+    if (ingestActive()) {
+        ingestRejected.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        stats.pointsRejected++;
+    }
+#else
+    stats.pointsRejected++;
+#endif
+    setError(code, message);
+}
+
+bool LightweightIoT::ingestActive() const {
+#ifdef LWIOT_HAS_THREADS
+    return ingest.allocated();
 #else
-    size_t pos = 0;
-    while ((pos = str.find(" ", pos)) != String::npos) {
-        str.replace(pos, 1, "\ ");
-        pos += 2;
+    return false;
+#endif
+}
+
+void LightweightIoT::collectIngest() {
+#ifdef LWIOT_HAS_THREADS
+    // Statistics are merged once per round; getStats() may run on a producer thread
+    uint32_t points = 0;
+    uint32_t bytes = 0;
+    Histogram encodeTimes;
+    const char* data;
+    uint32_t encodeMicros;
+    long length;
+    while ((length = ingest.front(&data, &encodeMicros)) >= 0) {
+        if (length > 0) {
+            if (sendPending.load(std::memory_order_acquire) && !batch.empty() &&
+                batch.bytes() + length + 1 > batch.capacity()) {
+                // The batch is full and the sender still holds the previous one. Leave the
+                // rest queued, so a backlog shows up as a full queue rather than lost points,
+                // and come back as soon as the sender is free.
+                ingestWake.store(true);
+                break;
+            }
+            points++;
+            bytes += length;
+            encodeTimes.add(encodeMicros);
+            addToBatch(data, length);
+        }
+        ingest.pop();
+    }
+
+    uint32_t rejected = ingestRejected.exchange(0, std::memory_order_relaxed);
+    uint32_t dropped = ingestDropped.exchange(0, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(stateLock);
+    stats.pointsEncoded += points;
+    stats.bytesEncoded += bytes;
+    stats.encodeMicros.merge(encodeTimes);
+    stats.pointsRejected += rejected;
+    stats.pointsDropped += dropped;
+    stats.batchBytes = batch.bytes();
+#endif
+}
+
+void LightweightIoT::recordEncode(unsigned long startMicros, size_t length) {
+    if (length > 0) {
+        stats.pointsEncoded++;
+        stats.bytesEncoded += length;
+        stats.encodeMicros.add(micros() - startMicros);
+    }
+}
+
+bool LightweightIoT::submitPoint(size_t length) {
+    if (length == 0) {
+        rejectPoint("Point exceeds maxPointSize");
+        return false;
+    }
+
+    // Points queue behind a payload that is waiting for a retry
+    if (isBatching() || getNextRetryTime() != 0) {
+        return addToBatch(pointBuffer, length);
+    }
+    Transport::Slice point = {pointBuffer, length};
+    switch (sendToInfluxDB(&point, 1)) {
+        case SEND_OK:
+            return true;
+        case SEND_RETRY:
+            // Keep the point; loop() or the next write sends it once the backoff has passed
+            return addToBatch(pointBuffer, length);
+        default:
+            countDropped(1);
+            return false;
+    }
+}
+
+void LightweightIoT::countDropped(size_t points) {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    stats.pointsDropped += points;
+}
+
+void LightweightIoT::sampleHeap() {
+#if defined(ARDUINO) && !defined(ESP32)
+    // ESP32 tracks the low-water mark itself; elsewhere it is sampled
+    uint32_t freeHeap = ESP.getFreeHeap();
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    if (stats.minFreeHeap == 0 || freeHeap < stats.minFreeHeap) {
+        stats.minFreeHeap = freeHeap;
+    }
+#endif
+}
+
+void LightweightIoT::Histogram::add(uint32_t value, uint32_t times) {
+    // Bucket i > 0 starts at 4^(i-1), i.e. holds values of 2i-1 or 2i bits
+    size_t bucket = value == 0 ? 0 : (32 - __builtin_clz(value) + 1) / 2;
+    buckets[bucket < BUCKETS ? bucket : BUCKETS - 1] += times;
+    count += times;
+    sum += (uint64_t)value * times;
+    if (value > max) {
+        max = value;
+    }
+}
+
+void LightweightIoT::Histogram::merge(const Histogram& other) {
+    for (size_t i = 0; i < BUCKETS; i++) {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    if (other.max > max) {
+        max = other.max;
+    }
+}
+
+LightweightIoT::Stats LightweightIoT::getStats() const {
+    Stats snapshot;
+    {
+#ifdef LWIOT_HAS_THREADS
+        std::lock_guard<std::mutex> guard(stateLock);
+#endif
+        snapshot = stats;
+        snapshot.spoolDropped = spoolDropped;
+    }
+#ifdef ESP32
+    snapshot.minFreeHeap = ESP.getMinFreeHeap();
+#endif
+    if (!ingestActive() || !asyncActive()) {
+        // Otherwise the sender owns the batch; collectIngest() records its size
+        snapshot.batchBytes = batch.bytes() + columns.bytes();
+    }
+    return snapshot;
+}
+
+void LightweightIoT::resetStats() {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    stats = Stats();
+}
+
+bool LightweightIoT::writeStats() {
+    Stats current = getStats();
+    ConnectionStats connection = getConnectionStats();
+    uint32_t flushes = 0;
+    for (size_t i = 0; i < FLUSH_REASONS; i++) {
+        flushes += current.flushes[i];
     }
-    pos = 0;
-    while ((pos = str.find(",", pos)) != String::npos) {
-        str.replace(pos, 1, "\\,");
-        pos += 2;
+
+    // Integer fields keep the point exact and cheap to encode
+    Point point("lwiot_stats");
+    point.addField("points", (long)current.pointsEncoded)
+        .addField("bytes", (long)current.bytesEncoded)
+        .addField("rejected", (long)current.pointsRejected)
+        .addField("dropped", (long)current.pointsDropped)
+        .addField("suppressed", (long)current.pointsSuppressed)
+        .addField("aggregated", (long)current.samplesAggregated)
+        .addField("retries", (long)current.retries)
+        .addField("requests", (long)connection.requests)
+        .addField("handshakes", (long)connection.handshakes)
+        .addField("flushes", (long)flushes)
+        .addField("encode_us", (long)current.encodeMicros.mean())
+        .addField("encode_us_max", (long)current.encodeMicros.max)
+        .addField("request_ms", (long)current.requestMillis.mean())
+        .addField("request_ms_max", (long)current.requestMillis.max)
+        .addField("batch_bytes", (long)current.batchBytes)
+        .addField("spool_bytes", (long)getSpoolBytes())
+        .addField("spool_dropped", (long)current.spoolDropped);
+    if (current.minFreeHeap > 0) {
+        point.addField("heap_min", (long)current.minFreeHeap);
     }
-    pos = 0;
-    while ((pos = str.find("=", pos)) != String::npos) {
-        str.replace(pos, 1, "\\=");
-        pos += 2;
+    return writePoint(point);
+}
+
+bool LightweightIoT::writePoint(const char* measurement, const char* field, float value) {
+    LineProtocol::Field fields[] = {LineProtocol::Field(field, value)};
+    return writeFields(measurement, fields, 1, currentTimestamp(), true);
+}
+
+bool LightweightIoT::writePoint(const char* measurement, const char* field, int value) {
+    LineProtocol::Field fields[] = {LineProtocol::Field(field, value)};
+    return writeFields(measurement, fields, 1, currentTimestamp(), true);
+}
+
+bool LightweightIoT::writePoint(const char* measurement, const char* field, const char* value) {
+    LineProtocol::Field fields[] = {LineProtocol::Field(field, value)};
+    return writeFields(measurement, fields, 1, currentTimestamp());
+}
+
+bool LightweightIoT::writePoint(const Point& point) {
+    if (point.overflow) {
+        clearError();
+        setError(INVALID_DATA, "Too many fields in one point");
+        return false;
     }
-#endif
-    return str;
+    uint64_t timestamp = point.timestamp != 0 ? point.timestamp : currentTimestamp();
+    return writeFields(point.measurement, point.fields, point.count, timestamp, point.timestamp == 0);
 }
 
-LightweightIoT::LightweightIoT(String token, String org, String bucket) {
-    this->token = token;
-    this->org = org;
-    this->bucket = bucket;
-    this->tagCount = 0;
-    this->batchCount = 0;
-    this->batchMode = false;
-    this->lastError = NO_ERROR;
+bool LightweightIoT::writePoint(const char* measurement, std::initializer_list<LineProtocol::Field> fields) {
+    return writeFields(measurement, fields.begin(), fields.size(), currentTimestamp(), true);
 }
 
-String LightweightIoT::formatLineProtocol(String measurement, String field, String value) {
-    String line = escapeString(measurement);
-    
-    // Add tags if any exist
-    for (int i = 0; i < tagCount; i++) {
-        line += "," + escapeString(tags[i].key) + "=" + escapeString(tags[i].value);
+bool LightweightIoT::writePoint(String measurement, std::initializer_list<std::pair<String, float>> fields) {
+    Point point(measurement.c_str());
+    for (const std::pair<String, float>& field : fields) {
+        point.addField(field.first.c_str(), field.second);
     }
-    
-    // Add field
-    line += " " + escapeString(field) + "=\"" + escapeString(value) + "\"";
-    
-    // Add timestamp in nanoseconds
-    line += " " + String(millis() * 1000000);
-    
-    return line;
+    return writePoint(point);
 }
 
-String LightweightIoT::formatLineProtocol(String measurement, String field, float value) {
-    String line = escapeString(measurement);
-    
-    // Add tags if any exist
-    for (int i = 0; i < tagCount; i++) {
-        line += "," + escapeString(tags[i].key) + "=" + escapeString(tags[i].value);
+bool LightweightIoT::writePoint(String measurement, std::initializer_list<std::pair<String, int>> fields) {
+    Point point(measurement.c_str());
+    for (const std::pair<String, int>& field : fields) {
+        point.addField(field.first.c_str(), field.second);
     }
-    
-    // Add field (float values don't need escaping)
-    line += " " + escapeString(field) + "=" + String(value);
-    
-    // Add timestamp in nanoseconds
-    line += " " + String(millis() * 1000000);
-    
-    return line;
+    return writePoint(point);
 }
 
-String LightweightIoT::formatLineProtocol(String measurement, String field, int value) {
-    String line = escapeString(measurement);
-    
-    // Add tags if any exist
-    for (int i = 0; i < tagCount; i++) {
-        line += "," + escapeString(tags[i].key) + "=" + escapeString(tags[i].value);
+bool LightweightIoT::writePoint(String measurement, std::initializer_list<std::pair<String, String>> fields) {
+    Point point(measurement.c_str());
+    for (const std::pair<String, String>& field : fields) {
+        point.addField(field.first.c_str(), field.second.c_str());
     }
-    
-    // Add field (integer values don't need escaping)
-    line += " " + escapeString(field) + "=" + String(value) + "i";
-    
-    // Add timestamp in nanoseconds
-    line += " " + String(millis() * 1000000);
-    
-    return line;
+    return writePoint(point);
 }
 
-bool LightweightIoT::begin(String influxUrl) {
-    this->url = influxUrl + "/api/v2/write?org=" + this->org + "&bucket=" + this->bucket;
-    
-    // Check WiFi connection
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("Error: WiFi not connected");
+bool LightweightIoT::addTag(String key, String value) {
+    if (key.length() == 0 || value.length() == 0) {
+        setError(INVALID_DATA, "Tag key and value must not be empty");
         return false;
     }
-    
+    if (tagCount >= MAX_TAGS) {
+        setError(INVALID_CONFIG, "Too many tags");
+        return false;
+    }
+    size_t needed = key.length() + value.length() + 2;
+    if (tagTextLength + needed > MAX_TAG_TEXT) {
+        setError(MEMORY_ERROR, "No room left for tag text");
+        return false;
+    }
+    // Open windows and held samples belong to the old tag set
+    closeWindows(true);
+    closeColumns();
+
+    tags[tagCount].key = (uint16_t)tagTextLength;
+    memcpy(tagText + tagTextLength, key.c_str(), key.length() + 1);
+    tagTextLength += key.length() + 1;
+    tags[tagCount].value = (uint16_t)tagTextLength;
+    memcpy(tagText + tagTextLength, value.c_str(), value.length() + 1);
+    tagTextLength += value.length() + 1;
+    tagCount++;
+    tagSetDirty = true;
     return true;
 }
 
-bool LightweightIoT::isConnected() {
-    return WiFi.status() == WL_CONNECTED;
+void LightweightIoT::clearTags() {
+    closeWindows(true);
+    closeColumns();
+    tagCount = 0;
+    tagTextLength = 0;
+    tagSetDirty = true;
 }
 
-void LightweightIoT::setError(ErrorCode code, String message) {
-    lastError = code;
-    lastErrorMessage = message;
-    if (config.debugMode) {
-        Serial.print("Error (");
-        Serial.print(code);
-        Serial.print("): ");
-        Serial.println(message);
+bool LightweightIoT::setFieldPrecision(const char* field, int8_t decimals) {
+    for (int i = 0; i < fieldPrecisionCount; i++) {
+        if (fieldPrecisions[i].field == field) {
+            fieldPrecisions[i].decimals = decimals;
+            return true;
+        }
+    }
+    if (fieldPrecisionCount >= MAX_FIELD_PRECISIONS) {
+        return false;
     }
+    fieldPrecisions[fieldPrecisionCount].field = field;
+    fieldPrecisions[fieldPrecisionCount].decimals = decimals;
+    fieldPrecisionCount++;
+    return true;
 }
 
-bool LightweightIoT::retryOperation(std::function<bool()> operation) {
-    for (uint8_t attempt = 0; attempt <= config.maxRetries; attempt++) {
-        if (attempt > 0) {
-            if (config.debugMode) {
-                Serial.print("Retry attempt ");
-                Serial.print(attempt);
-                Serial.print(" of ");
-                Serial.println(config.maxRetries);
-            }
-            delay(config.retryDelay);
-        }
-        
-        if (operation()) {
-            return true;
+int8_t LightweightIoT::precisionFor(const char* field) const {
+    for (int i = 0; i < fieldPrecisionCount; i++) {
+        if (fieldPrecisions[i].field == field) {
+            return fieldPrecisions[i].decimals;
         }
     }
-    return false;
+    return config.floatPrecision;
 }
 
-bool LightweightIoT::sendToInfluxDB(String lineProtocol) {
-    if (!isConnected()) {
-        setError(NOT_CONNECTED, "WiFi not connected");
+bool LightweightIoT::setDeadband(const char* measurement, const char* field, const Deadband& deadband) {
+    String measurementName = measurement != nullptr ? measurement : "";
+    String fieldKey = field != nullptr ? field : "";
+    if (!allocateReportFilter()) {
+        // Outside stateLock, which setError() takes
+        setError(MEMORY_ERROR, "Failed to allocate deadband table");
         return false;
     }
-    
-    return retryOperation([this, lineProtocol]() {
-        HTTPClient http;
-        http.begin(this->url);
-        http.setTimeout(config.timeout);
-        
-        // Set headers
-        http.addHeader("Content-Type", "text/plain");
-        http.addHeader("Authorization", "Token " + this->token);
-        
-        // Send POST request
-        int httpResponseCode = http.POST(lineProtocol);
-        
-        // Check response
-        bool success = (httpResponseCode >= 200 && httpResponseCode < 300);
-        
-        if (!success) {
-            String error = "HTTP error " + String(httpResponseCode);
-            if (http.getString().length() > 0) {
-                error += ": " + http.getString();
-            }
-            setError(HTTP_ERROR, error);
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    for (int i = 0; i < deadbandCount; i++) {
+        if (deadbands[i].measurement == measurementName && deadbands[i].field == fieldKey) {
+            deadbands[i].deadband = deadband;
+            return true;
         }
-        
-        http.end();
-        return success;
-    });
-}
-
-bool LightweightIoT::addToBatch(String lineProtocol) {
-    if (batchCount >= MAX_BATCH_SIZE) {
-        setError(BATCH_FULL, "Batch buffer is full");
+    }
+    if (deadbandCount >= MAX_DEADBANDS) {
         return false;
     }
-    batchBuffer[batchCount++] = lineProtocol;
+    deadbands[deadbandCount].measurement = measurementName;
+    deadbands[deadbandCount].field = fieldKey;
+    deadbands[deadbandCount].deadband = deadband;
+    deadbandCount++;
     return true;
 }
 
-void LightweightIoT::setConfig(Config config) {
-    this->config = config;
+void LightweightIoT::clearDeadbands() {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    deadbandCount = 0;
+    if (arena.reserved()) {
+        // Carved space is not given back; keep the table for the next rules
+        reportFilter.reset();
+    } else {
+        reportFilter.release();
+    }
 }
 
-void LightweightIoT::beginBatch() {
-    batchMode = true;
+bool LightweightIoT::allocateReportFilter() {
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    if (reportFilter.allocated()) {
+        return true;
+    }
+    void* storage;
+    return carveBuffer(ReportFilter::storageSize(config.deadbandSeries), &storage) &&
+           reportFilter.allocate(config.deadbandSeries, storage);
 }
 
-bool LightweightIoT::endBatch() {
-    if (!batchMode || batchCount == 0) {
+bool LightweightIoT::setAggregation(const char* measurement, const char* field, uint32_t window, bool stddev) {
+    if (window == 0) {
         return false;
     }
-    bool result = flushBatch();
-    batchMode = false;
-    return result;
+    int index = 0;
+    while (index < aggregationCount && !aggregations[index].matches(measurement, field)) {
+        index++;
+    }
+    if (index >= MAX_AGGREGATIONS) {
+        return false;
+    }
+    if (index < aggregationCount) {
+        // Samples taken under the old window are written before it changes
+        closeWindows(true);
+    }
+
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    aggregations[index].configure(measurement, field, window, stddev);
+    if (index == aggregationCount) {
+        aggregationCount++;
+    }
+    return true;
 }
 
-void LightweightIoT::clearBatch() {
-    batchCount = 0;
+void LightweightIoT::clearAggregations() {
+    closeWindows(true);
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    aggregationCount = 0;
 }
 
-bool LightweightIoT::flushBatch() {
-    if (batchCount == 0) {
-        return true;
-    }
-    
-    // Combine all points with newlines
-    String batchData = "";
-    for (int i = 0; i < batchCount; i++) {
-        if (i > 0) {
-            batchData += "\n";
+size_t LightweightIoT::aggregate(const char* measurement, const LineProtocol::Field* fields, size_t count,
+                                 LineProtocol::Field* remaining) {
+    uint64_t now = clockMillis();
+    size_t kept = 0;
+    Aggregation::Summary closed[MAX_AGGREGATIONS];
+    int closedIndices[MAX_AGGREGATIONS];
+    int closedCount = 0;
+    {
+#ifdef LWIOT_HAS_THREADS
+        std::lock_guard<std::mutex> guard(stateLock);
+#endif
+        // A window that has ended is closed before a sample can start the next one
+        for (int i = 0; i < aggregationCount; i++) {
+            if (aggregations[i].due(now)) {
+                closedIndices[closedCount] = i;
+                closed[closedCount++] = aggregations[i].take();
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            const LineProtocol::Field& field = fields[i];
+            if (!LineProtocol::isWritable(field)) {
+                continue;
+            }
+            Aggregation* aggregation = nullptr;
+            if (field.type == LineProtocol::FIELD_FLOAT || field.type == LineProtocol::FIELD_INT) {
+                for (int j = 0; j < aggregationCount && aggregation == nullptr; j++) {
+                    if (aggregations[j].matches(measurement, field.key)) {
+                        aggregation = &aggregations[j];
+                    }
+                }
+            }
+            if (aggregation == nullptr) {
+                remaining[kept++] = field;
+                continue;
+            }
+            aggregation->add(field.type == LineProtocol::FIELD_FLOAT ? (double)field.f : (double)field.i, now);
+            stats.samplesAggregated++;
         }
-        batchData += batchBuffer[i];
     }
-    
-    // Send the batch
-    bool result = sendToInfluxDB(batchData);
-    clearBatch();
-    return result;
+
+    for (int i = 0; i < closedCount; i++) {
+        writeWindow(aggregations[closedIndices[i]], closed[i]);
+    }
+    return kept;
 }
 
-bool LightweightIoT::writePoint(String measurement, String field, float value) {
-    clearError();
-    String lineProtocol = formatLineProtocol(measurement, field, value);
-    if (batchMode) {
-        if (!addToBatch(lineProtocol)) {
-            setError(BATCH_FULL, "Batch buffer is full");
-            return false;
+void LightweightIoT::closeWindows(bool all) {
+    uint64_t now = clockMillis();
+    Aggregation::Summary closed[MAX_AGGREGATIONS];
+    int closedIndices[MAX_AGGREGATIONS];
+    int closedCount = 0;
+    {
+#ifdef LWIOT_HAS_THREADS
+        std::lock_guard<std::mutex> guard(stateLock);
+#endif
+        for (int i = 0; i < aggregationCount; i++) {
+            if (all ? !aggregations[i].empty() : aggregations[i].due(now)) {
+                closedIndices[closedCount] = i;
+                closed[closedCount++] = aggregations[i].take();
+            }
         }
-        return true;
     }
-    return sendToInfluxDB(lineProtocol);
+    for (int i = 0; i < closedCount; i++) {
+        writeWindow(aggregations[closedIndices[i]], closed[i]);
+    }
 }
 
-bool LightweightIoT::writePoint(String measurement, String field, int value) {
-    String lineProtocol = formatLineProtocol(measurement, field, value);
-    if (batchMode) {
-        return addToBatch(lineProtocol);
-    }
-    return sendToInfluxDB(lineProtocol);
+bool LightweightIoT::writeWindow(const Aggregation& aggregation, const Aggregation::Summary& summary) {
+    LineProtocol::Field fields[Aggregation::MAX_FIELDS];
+    size_t count = aggregation.render(summary, fields);
+    uint64_t timestamp =
+        config.serverTimestamps ? 0 : scaleTimestamp(summary.start, MILLISECONDS, config.writePrecision);
+    return writeFields(aggregation.measurement(), fields, count, timestamp);
 }
 
-bool LightweightIoT::writePoint(String measurement, String field, String value) {
-    String lineProtocol = formatLineProtocol(measurement, field, value);
-    if (batchMode) {
-        return addToBatch(lineProtocol);
+const LightweightIoT::Deadband* LightweightIoT::deadbandFor(const char* measurement, const char* field) const {
+    // A field key is more specific than a measurement name, both more than either
+    const Deadband* match = nullptr;
+    int matchScore = -1;
+    for (int i = 0; i < deadbandCount; i++) {
+        const DeadbandRule& rule = deadbands[i];
+        bool anyMeasurement = rule.measurement.length() == 0;
+        bool anyField = rule.field.length() == 0;
+        int score = (anyMeasurement ? 0 : 1) + (anyField ? 0 : 2);
+        if (score > matchScore && (anyMeasurement || rule.measurement == measurement) &&
+            (anyField || rule.field == field)) {
+            match = &rule.deadband;
+            matchScore = score;
+        }
     }
-    return sendToInfluxDB(lineProtocol);
+    return match;
 }
 
-bool LightweightIoT::addTag(String key, String value) {
-    if (tagCount >= MAX_TAGS) {
+bool LightweightIoT::reportDue(const char* measurement, const LineProtocol::Field* fields, size_t count) {
+    if (deadbandCount == 0 || !refreshTagSet()) {
+        return true;
+    }
+    uint32_t now = (uint32_t)millis();
+    ReportFilter::Entry* entries[Point::MAX_FIELDS];
+    size_t indices[Point::MAX_FIELDS];
+    size_t tracked = 0;
+    bool due = false;
+
+#ifdef LWIOT_HAS_THREADS
+    std::lock_guard<std::mutex> guard(stateLock);
+#endif
+    for (size_t i = 0; i < count; i++) {
+        if (!LineProtocol::isWritable(fields[i])) {
+            continue;
+        }
+        const Deadband* deadband = deadbandFor(measurement, fields[i].key);
+        bool created = false;
+        ReportFilter::Entry* entry =
+            deadband != nullptr ? reportFilter.find(ReportFilter::seriesKey(tagSetHash, measurement, fields[i]), &created)
+                                : nullptr;
+        if (entry == nullptr) {
+            // No deadband, or more series than the table holds
+            due = true;
+            continue;
+        }
+        due = due || created || ReportFilter::due(*entry, fields[i], *deadband, now);
+        entries[tracked] = entry;
+        indices[tracked] = i;
+        tracked++;
+    }
+
+    if (!due) {
+        stats.pointsSuppressed++;
         return false;
     }
-    
-    tags[tagCount].key = key;
-    tags[tagCount].value = value;
-    tagCount++;
+    for (size_t i = 0; i < tracked; i++) {
+        ReportFilter::record(*entries[i], fields[indices[i]], now);
+    }
     return true;
 }
 
-void LightweightIoT::clearTags() {
-    tagCount = 0;
-}
-
 void LightweightIoT::setDevice(const Device& device) {
     currentDevice = device;
     clearTags();
     if (device.id.length() > 0) {
         addTag("device", device.id);
     }
-    if (device.location.length() > 0) {
-        addTag("location", device.location);
+    if (device.type.length() > 0) {
+        addTag("type", device.type);
+    }
+    if (device.location.building.length() > 0) {
+        addTag("building", device.location.building);
+    }
+    if (device.location.floor.length() > 0) {
+        addTag("floor", device.location.floor);
+    }
+    if (device.location.room.length() > 0) {
+        addTag("room", device.location.room);
+    }
+    if (device.location.zone.length() > 0) {
+        addTag("zone", device.location.zone);
     }
 }
 
-unsigned long LightweightIoT::getCurrentTimestamp() {
-    unsigned long current = millis();
-    switch (timeUnit) {
-        case SECONDS:
-            return current / 1000;
-        case MILLISECONDS:
-            return current;
-        case MICROSECONDS:
-            return current * 1000;
-        case NANOSECONDS:
-            return current * 1000000;
-        default:
-            return current;
+uint64_t LightweightIoT::getCurrentTimestamp() {
+    return scaleTimestamp(clockMillis(), MILLISECONDS, timeUnit);
+}
+
+uint64_t LightweightIoT::scaleTimestamp(uint64_t timestamp, TimeUnit from, TimeUnit to) const {
+    // Each unit is a thousand times finer than the one before
+    for (int unit = from; unit < to; unit++) {
+        timestamp *= 1000;
     }
+    for (int unit = from; unit > to; unit--) {
+        timestamp /= 1000;
+    }
+    return timestamp;
 }
 
-String LightweightIoT::formatTimestamp(unsigned long timestamp, TimeUnit unit) {
-    switch (unit) {
-        case SECONDS:
-            return String(timestamp * 1000000000);
-        case MILLISECONDS:
-            return String(timestamp * 1000000);
-        case MICROSECONDS:
-            return String(timestamp * 1000);
-        case NANOSECONDS:
-            return String(timestamp);
-        default:
-            return String(timestamp * 1000000); // Default to milliseconds
+namespace {
+
+// The value of a measurement as a field
+LineProtocol::Field measurementField(const LightweightIoT::Measurement& measurement, const char* key) {
+    switch (measurement.type) {
+    case LineProtocol::FIELD_FLOAT:
+        return LineProtocol::Field(key, measurement.value.f);
+    case LineProtocol::FIELD_INT:
+        return LineProtocol::Field(key, (long)measurement.value.i);
+    case LineProtocol::FIELD_BOOL:
+        return LineProtocol::Field(key, measurement.value.b);
+    default:
+        return LineProtocol::Field(key, measurement.value.s);
+    }
+}
+
+} // namespace
+
+LightweightIoT::Measurement::Measurement() : time(0), name(KeyTable::NONE), field(KeyTable::NONE), type(0), unit(0) {
+    value.i = 0;
+}
+
+LightweightIoT::Measurement::Measurement(const char* name, const char* field, float value, uint64_t time,
+                                         TimeUnit unit) {
+    setKeys(name, field, LineProtocol::FIELD_FLOAT, time, unit);
+    this->value.f = value;
+}
+
+LightweightIoT::Measurement::Measurement(const char* name, const char* field, double value, uint64_t time,
+                                         TimeUnit unit) {
+    setKeys(name, field, LineProtocol::FIELD_FLOAT, time, unit);
+    this->value.f = (float)value;
+}
+
+LightweightIoT::Measurement::Measurement(const char* name, const char* field, int value, uint64_t time,
+                                         TimeUnit unit) {
+    setKeys(name, field, LineProtocol::FIELD_INT, time, unit);
+    this->value.i = value;
+}
+
+LightweightIoT::Measurement::Measurement(const char* name, const char* field, long value, uint64_t time,
+                                         TimeUnit unit) {
+    setKeys(name, field, LineProtocol::FIELD_INT, time, unit);
+    this->value.i = (int32_t)value;
+}
+
+LightweightIoT::Measurement::Measurement(const char* name, const char* field, bool value, uint64_t time,
+                                         TimeUnit unit) {
+    setKeys(name, field, LineProtocol::FIELD_BOOL, time, unit);
+    this->value.b = value;
+}
+
+LightweightIoT::Measurement::Measurement(const char* name, const char* field, const char* value, uint64_t time,
+                                         TimeUnit unit) {
+    setKeys(name, field, LineProtocol::FIELD_STRING, time, unit);
+    this->value.s = value;
+}
+
+void LightweightIoT::Measurement::setKeys(const char* name, const char* field, LineProtocol::FieldType type,
+                                          uint64_t time, TimeUnit unit) {
+    // The string value pointer widens the record on 64-bit hosts
+    static_assert(sizeof(Measurement) == (sizeof(void*) > 4 ? 24 : 16),
+                  "Measurement is meant to be a 16-byte record on 32-bit targets");
+    KeyTable& keys = KeyTable::shared();
+    this->time = time;
+    this->name = keys.intern(name, LineProtocol::ESCAPE_MEASUREMENT);
+    this->field = keys.intern(field, LineProtocol::ESCAPE_KEY);
+    this->type = type;
+    this->unit = unit;
+    this->value.s = nullptr;
+}
+
+bool LightweightIoT::Measurement::isValid() const {
+    const KeyTable& keys = KeyTable::shared();
+    return KeyTable::isKey(name) && keys.length(name) <= 64 &&
+           KeyTable::isKey(field) && keys.length(field) <= 32 &&
+           (type != LineProtocol::FIELD_STRING || (value.s != nullptr && strlen(value.s) <= 64));
+}
+
+uint64_t LightweightIoT::measurementTimestamp(const Measurement& measurement) {
+    return measurement.time > 0 ? scaleTimestamp(measurement.time, (TimeUnit)measurement.unit, config.writePrecision)
+                                : currentTimestamp();
+}
+
+size_t LightweightIoT::encodeMeasurement(char* buffer, size_t capacity, const Measurement& measurement,
+                                         uint64_t timestamp) {
+    if (!measurement.isValid() || !refreshTagSet()) {
+        return 0;
+    }
+    // Names were escaped when they were interned
+    const KeyTable& keys = KeyTable::shared();
+    LineProtocol::Field field = measurementField(measurement, keys.text(measurement.field));
+    if (field.type == LineProtocol::FIELD_FLOAT) {
+        field.precision = precisionFor(field.key);
     }
+    return LineProtocol::encodeEscaped(buffer, capacity, keys.escaped(measurement.name),
+                                       keys.escapedLength(measurement.name), tagSet, tagSetLength,
+                                       keys.escaped(measurement.field), keys.escapedLength(measurement.field), field,
+                                       timestamp);
 }
 
 bool LightweightIoT::writeMeasurement(const Measurement& measurement) {
-    String lineProtocol = escapeString(measurement.name);
-    
-    // Add tags if any exist
-    for (int i = 0; i < tagCount; i++) {
-        lineProtocol += "," + escapeString(tags[i].key) + "=" + escapeString(tags[i].value);
+    if (measurement.name == KeyTable::FULL || measurement.field == KeyTable::FULL) {
+        rejectPoint("Key table full; raise LWIOT_KEY_IDS or LWIOT_KEY_BYTES", MEMORY_ERROR);
+        return false;
     }
-    
-    // Add field
-    lineProtocol += " " + escapeString(measurement.field) + "=\"" + escapeString(measurement.value) + "\"";
-    
-    // Add timestamp
-    unsigned long timestamp = measurement.time > 0 ? measurement.time : getCurrentTimestamp();
-    lineProtocol += " " + formatTimestamp(timestamp, measurement.unit);
-    
-    if (batchMode) {
-        return addToBatch(lineProtocol);
+    if (!measurement.isValid()) {
+        rejectPoint("Invalid measurement");
+        return false;
+    }
+    uint64_t timestamp = measurementTimestamp(measurement);
+    if (deadbandCount > 0 || aggregationCount > 0) {
+        // Filtering and aggregation work on plain names; take the general path
+        const KeyTable& keys = KeyTable::shared();
+        LineProtocol::Field fields[] = {measurementField(measurement, keys.text(measurement.field))};
+        return writeFields(keys.text(measurement.name), fields, 1, timestamp, measurement.time == 0);
     }
-    return sendToInfluxDB(lineProtocol);
+    if (measurement.type == LineProtocol::FIELD_FLOAT && !LineProtocol::isFinite(measurement.value.f)) {
+        rejectPoint("Field value is NaN or infinite");
+        return false;
+    }
+    if (measurement.time == 0 &&
+        queueSample(measurement.name, measurement.field, measurementField(measurement, ""))) {
+        return true;
+    }
+
+    PointTarget target;
+    if (!beginPoint(&target)) {
+        return false;
+    }
+    unsigned long startedAt = micros();
+    size_t length = encodeMeasurement(target.data, target.capacity, measurement, timestamp);
+    return submitPoint(target, length, startedAt);
 }
 
 bool LightweightIoT::writeMeasurements(const Measurement* measurements, size_t count) {
+    // Inside a batch the caller began, the samples just join it
+    bool nested = batchMode;
     beginBatch();
-    for (size_t i = 0; i < count; i++) {
-        if (!writeMeasurement(measurements[i])) {
+    bool written = true;
+    for (size_t i = 0; i < count && written; i++) {
+        written = writeMeasurement(measurements[i]);
+    }
+    if (nested) {
+        return written;
+    }
+    // What was accepted before a failure still goes out, and batch mode always ends.
+    // Nothing left means deadbands or the flush policy already dealt with every sample.
+    bool sent = batch.empty() && columns.empty() && !ingestActive() ? true : flushBatch();
+    batchMode = false;
+    return written && sent;
+}
+
+namespace {
+
+// Decimal text of a timestamp that is advanced by a fixed step in place.
+// A regular series then costs a few digit additions per sample instead of
+// a 64-bit conversion, which needs library division on 32-bit MCUs.
+class DecimalCounter {
+public:
+    DecimalCounter(uint64_t value, uint64_t step) {
+        char text[LineProtocol::MAX_NUMBER_LENGTH];
+        size_t length = LineProtocol::formatUInt(text, value);
+        first = DIGITS - length;
+        memcpy(digits + first, text, length);
+        stepLength = LineProtocol::formatUInt(text, step);
+        for (size_t i = 0; i < stepLength; i++) {
+            stepDigits[i] = (uint8_t)(text[stepLength - 1 - i] - '0');
+        }
+    }
+
+    const char* text() const { return digits + first; }
+    size_t length() const { return DIGITS - first; }
+
+    void advance() {
+        uint8_t carry = 0;
+        size_t i = DIGITS;
+        for (size_t n = 0; (n < stepLength || carry != 0) && i > 0; n++) {
+            i--;
+            uint8_t digit = (uint8_t)((i >= first ? digits[i] - '0' : 0) + carry);
+            if (n < stepLength) {
+                digit += stepDigits[n];
+            }
+            carry = digit >= 10;
+            digits[i] = (char)('0' + (carry ? digit - 10 : digit));
+        }
+        if (i < first) {
+            first = i;
+        }
+    }
+
+private:
+    static const size_t DIGITS = 24;  ///< A 64-bit value has at most 20
+    char digits[DIGITS];              ///< Right-aligned, from digits[first]
+    size_t first;
+    uint8_t stepDigits[DIGITS];       ///< Least significant first
+    size_t stepLength;
+};
+
+} // namespace
+
+bool LightweightIoT::writeSeries(const char* measurement, const char* field, const float* values, size_t count,
+                                 uint64_t start, uint32_t interval, TimeUnit unit) {
+    return writeSamples(measurement, field, LineProtocol::FIELD_FLOAT, values, count, nullptr, start, interval, unit);
+}
+
+bool LightweightIoT::writeSeries(const char* measurement, const char* field, const int32_t* values, size_t count,
+                                 uint64_t start, uint32_t interval, TimeUnit unit) {
+    return writeSamples(measurement, field, LineProtocol::FIELD_INT, values, count, nullptr, start, interval, unit);
+}
+
+bool LightweightIoT::writeSeries(const char* measurement, const char* field, const float* values, size_t count,
+                                 const uint64_t* times, TimeUnit unit) {
+    return writeSamples(measurement, field, LineProtocol::FIELD_FLOAT, values, count, times, 0, 0, unit);
+}
+
+bool LightweightIoT::writeSeries(const char* measurement, const char* field, const int32_t* values, size_t count,
+                                 const uint64_t* times, TimeUnit unit) {
+    return writeSamples(measurement, field, LineProtocol::FIELD_INT, values, count, times, 0, 0, unit);
+}
+
+bool LightweightIoT::writeSamples(const char* measurement, const char* field, LineProtocol::FieldType type,
+                                  const void* values, size_t count, const uint64_t* times, uint64_t start,
+                                  uint32_t interval, TimeUnit unit) {
+    if (measurement == nullptr || *measurement == '\0' || field == nullptr || *field == '\0' ||
+        (values == nullptr && count > 0)) {
+        rejectPoint("Invalid series");
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
+    // A block ending now carries no timestamps when the server stamps points
+    bool stamped = times != nullptr || start != 0 || !config.serverTimestamps;
+    if (times == nullptr && start == 0) {
+        uint64_t now = scaleTimestamp(clockMillis(), MILLISECONDS, unit);
+        if ((uint64_t)(count - 1) * interval > now) {
+            rejectPoint("Series would start before the clock's zero; pass a start time");
             return false;
         }
+        start = now - (uint64_t)(count - 1) * interval;
+    }
+    const float* floats = (const float*)values;
+    const int32_t* ints = (const int32_t*)values;
+
+    if (deadbandCount > 0 || aggregationCount > 0 || ingestActive()) {
+        // Filters see every sample, and concurrent writers share the ingest queue
+        bool written = true;
+        for (size_t i = 0; i < count; i++) {
+            LineProtocol::Field value = type == LineProtocol::FIELD_FLOAT ? LineProtocol::Field(field, floats[i])
+                                                                          : LineProtocol::Field(field, (long)ints[i]);
+            uint64_t time = times != nullptr ? times[i] : start + (uint64_t)i * interval;
+            written = writeFields(measurement, &value, 1,
+                                  stamped ? scaleTimestamp(time, unit, config.writePrecision) : 0) &&
+                      written;
+        }
+        return written;
     }
-    return endBatch();
+
+    clearError();
+    if (!ensureBatchBuffer() || !ensurePointBuffer() || !refreshTagSet()) {
+        return false;
+    }
+    // "measurement,tags key=" once for the block
+    size_t measurementLength = strlen(measurement);
+    size_t keyLength = strlen(field);
+    size_t prefixLength =
+        LineProtocol::escapedLength(measurement, measurementLength, LineProtocol::ESCAPE_MEASUREMENT) + tagSetLength +
+        LineProtocol::escapedLength(field, keyLength, LineProtocol::ESCAPE_KEY) + 2;
+    if (prefixLength > pointBufferSize) {
+        rejectPoint("Point exceeds maxPointSize");
+        return false;
+    }
+    char* prefix = pointBuffer;
+    char* p = LineProtocol::escape(prefix, measurement, measurementLength, LineProtocol::ESCAPE_MEASUREMENT);
+    memcpy(p, tagSet, tagSetLength);
+    p += tagSetLength;
+    *p++ = ' ';
+    p = LineProtocol::escape(p, field, keyLength, LineProtocol::ESCAPE_KEY);
+    *p++ = '=';
+
+    // Timestamps of a regular series are counted in decimal unless truncating
+    // to a coarser precision makes their spacing uneven
+    bool counted = times == nullptr && config.writePrecision >= unit;
+    DecimalCounter clock(scaleTimestamp(start, unit, config.writePrecision),
+                         scaleTimestamp(interval, unit, config.writePrecision));
+    LineProtocol::Field value = type == LineProtocol::FIELD_FLOAT
+                                    ? LineProtocol::Field(field, 0.0f, precisionFor(field))
+                                    : LineProtocol::Field(field, 0L);
+    // The prefix, a number, a space and a 20-digit timestamp; like encode(), a time of 0 is left out
+    size_t longest = prefixLength + LineProtocol::MAX_NUMBER_LENGTH + 21;
+    size_t pointLimit = config.flushPoints > 0 ? config.flushPoints : SIZE_MAX;
+    size_t byteLimit = config.flushBytes > 0 ? config.flushBytes : SIZE_MAX;
+
+    bool written = true;
+    size_t encoded = 0;
+    size_t encodedBytes = 0;
+    unsigned long encodeMicros = 0;
+    unsigned long startedAt = micros();
+    for (size_t i = 0; i < count; i++, clock.advance()) {
+        if (type == LineProtocol::FIELD_FLOAT) {
+            value.f = floats[i];
+            if (!LineProtocol::isFinite(value.f)) {
+                rejectPoint("Field value is NaN or infinite");
+                written = false;
+                continue;
+            }
+        } else {
+            value.i = ints[i];
+        }
+
+        char* line = batch.claim(longest);
+        if (line == nullptr) {
+            // Send what is queued and carry on in the emptied batch
+            encodeMicros += micros() - startedAt;
+            flush(FLUSH_FULL);
+            startedAt = micros();
+            line = batch.claim(longest);
+            if (line == nullptr) {
+                setError(BATCH_FULL, "Point does not fit in the batch buffer");
+                countDropped(count - i);
+                written = false;
+                break;
+            }
+        }
+        memcpy(line, prefix, prefixLength);
+        p = LineProtocol::writeValue(line + prefixLength, value);
+        if (stamped && counted) {
+            if (clock.length() > 1 || clock.text()[0] != '0') {
+                *p++ = ' ';
+                memcpy(p, clock.text(), clock.length());
+                p += clock.length();
+            }
+        } else if (stamped) {
+            uint64_t time = times != nullptr ? times[i] : start + (uint64_t)i * interval;
+            time = scaleTimestamp(time, unit, config.writePrecision);
+            if (time != 0) {
+                *p++ = ' ';
+                p += LineProtocol::formatUInt(p, time);
+            }
+        }
+        size_t length = p - line;
+        batch.commit(length);
+        encoded++;
+        encodedBytes += length;
+
+        size_t points = batch.points() + columns.samples();
+        if (points == 1) {
+            batchStartedAt = millis();
+        }
+        // Only a reached budget needs the full policy check
+        if (points >= pointLimit || batch.bytes() + columns.bytes() >= byteLimit) {
+            FlushReason reason = flushDue();
+            if (reason != FLUSH_NONE) {
+                encodeMicros += micros() - startedAt;
+                flush(reason);
+                startedAt = micros();
+            }
+        }
+    }
+    encodeMicros += micros() - startedAt;
+    if (encoded > 0) {
+        // One timing for the block, spread over its samples
+        stats.pointsEncoded += encoded;
+        stats.bytesEncoded += encodedBytes;
+        stats.encodeMicros.add(encodeMicros / encoded, encoded);
+    }
+
+    // Without batching the block goes out now, unless a failed send is waiting for its retry
+    FlushReason reason = !isBatching() && getNextRetryTime() == 0 ? FLUSH_IMMEDIATE : flushDue();
+    if (reason != FLUSH_NONE && !batch.empty()) {
+        written = flush(reason) && written;
+    }
+    return written;
 }
 
 bool LightweightIoT::validateCredentials() {
@@ -340,19 +2388,33 @@ bool LightweightIoT::validateCredentials() {
         return false;
     }
 
-    HTTPClient http;
-    String healthUrl = this->url.substring(0, this->url.indexOf("/write")) + "/health";
-    http.begin(healthUrl);
-    http.addHeader("Authorization", "Token " + this->token);
+    // The health endpoint sits next to /api/v2/write
+    const char* base = this->url.c_str();
+    const char* write = strstr(base, "/write");
+    char healthUrl[256];
+    snprintf(healthUrl, sizeof(healthUrl), "%.*s/health", (int)(write != nullptr ? write - base : strlen(base)), base);
 
-    int httpCode = http.GET();
-    bool success = (httpCode >= 200 && httpCode < 300);
+    Transport::Request request;
+    request.method = "GET";
+    request.url = healthUrl;
+    request.token = this->token.c_str();
+    request.timeout = config.timeout;
+    request.keepAlive = config.keepAlive;
+    request.idleTimeout = config.keepAliveIdleTimeout;
+    request.caCert = config.caCert;
+
+    Transport::Response response;
+    {
+#ifdef LWIOT_HAS_THREADS
+        std::lock_guard<std::mutex> guard(transportLock);
+#endif
+        activeTransport()->send(request, &response);
+    }
+    bool success = (response.status >= 200 && response.status < 300);
 
     if (!success) {
         setError(AUTH_ERROR, "Invalid credentials");
     }
-
-    http.end();
     return success;
 }
 
@@ -409,7 +2471,11 @@ void LightweightIoT::managePower() {
         }
 
         // Ensure all data is sent before sleep
-        if (batchMode) {
+        closeWindows(true);
+#ifdef LWIOT_HAS_THREADS
+        stopSender();
+#endif
+        if (!batch.empty() || !columns.empty()) {
             flushBatch();
         }
 
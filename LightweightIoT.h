@@ -8,14 +8,50 @@
     #include <ArduinoJson.h>
     using String = ::String;
 #else
+    // Host builds (tests, benchmarks) take WiFi, HTTPClient and the Arduino
+    // timing functions from the stand-ins in extras/host
     #include <string>
-    #include <functional>
     using String = std::string;
+    #include <Arduino.h>
+    #include <WiFi.h>
+    #include <HTTPClient.h>
+#endif
+
+#include <functional>
+#include <initializer_list>
+#include <utility>
+
+// Background sending needs a second thread of execution
+#if defined(ESP32) || !defined(ARDUINO)
+    #define LWIOT_HAS_THREADS 1
+    #include <atomic>
+    #include <mutex>
+    #ifdef ARDUINO
+        #include <freertos/FreeRTOS.h>
+        #include <freertos/task.h>
+    #else
+        #include <condition_variable>
+        #include <thread>
+    #endif
 #endif
 
+#include "Aggregation.h"
+#include "Arena.h"
+#include "BatchBuffer.h"
+#include "ColumnBatch.h"
+#include "GzipWriter.h"
+#include "HTTPClientTransport.h"
+#include "KeyTable.h"
+#include "LineProtocol.h"
+#include "PointQueue.h"
+#include "PosixTransport.h"
+#include "ReportFilter.h"
+#include "Spool.h"
+#include "Transport.h"
+
 /**
  * @brief A lightweight IoT library for sending data to InfluxDB Cloud
- * 
+ *
  * This library provides an easy way to send sensor data to InfluxDB Cloud
  * from Arduino devices. It supports:
  * - Hierarchical location tracking
@@ -38,7 +74,29 @@ public:
         TIMEOUT = 5,         ///< Operation timed out
         MEMORY_ERROR = 6,    ///< Memory allocation failed
         INVALID_CONFIG = 7,  ///< Invalid configuration
-        AUTH_ERROR = 8       ///< Authentication failed
+        AUTH_ERROR = 8,      ///< Authentication failed
+        SPOOL_ERROR = 9      ///< Offline spool could not be opened or written
+    };
+
+    /**
+     * @brief Log levels for diagnostic output
+     */
+    enum LogLevel {
+        LOG_NONE = 0,
+        LOG_ERROR = 1,
+        LOG_WARN = 2,
+        LOG_INFO = 3,
+        LOG_DEBUG = 4
+    };
+
+    /**
+     * @brief Time units for timestamps and for the write precision
+     */
+    enum TimeUnit {
+        SECONDS,
+        MILLISECONDS,
+        MICROSECONDS,
+        NANOSECONDS
     };
 
     /**
@@ -46,16 +104,126 @@ public:
      */
     struct Config {
         uint8_t maxRetries = 3;         ///< Maximum number of retry attempts
-        uint16_t retryDelay = 1000;     ///< Delay between retries (ms)
+        uint16_t retryDelay = 1000;     ///< Initial delay before a retry, doubled on each attempt (ms)
+        uint32_t maxRetryDelay = 60000; ///< Upper bound for the retry delay (ms)
+        uint32_t retryBudget = 0;       ///< Give up on a payload after retrying for this long (ms, 0 = no limit)
         uint16_t timeout = 5000;        ///< Operation timeout (ms)
         bool debugMode = false;         ///< Enable debug output
         uint16_t reconnectDelay = 5000; ///< Delay before reconnection attempt (ms)
         bool autoReconnect = true;      ///< Automatically attempt reconnection
         size_t maxPointSize = 1024;     ///< Maximum size of a single point (bytes)
-        bool useStaticBuffer = false;   ///< Use pre-allocated buffer
-        size_t staticBufferSize = 2048; ///< Static buffer size (bytes)
+        int8_t floatPrecision = -1;     ///< Decimals for float fields (0-9), -1 for the shortest exact form
+        bool useStaticBuffer = false;   ///< Carve every buffer from one region reserved by begin(); no heap use afterwards except inside HTTPClient
+        size_t staticBufferSize = 2048; ///< Batch buffer size (bytes)
+        size_t columnBatchSize = 0;     ///< Batch single float and integer fields as 8-byte raw samples in this many bytes, rendered at flush (0 = off)
         bool useLowPowerMode = false;   ///< Enable power saving features
         uint32_t deepSleepDuration = 0; ///< Deep sleep duration (ms, 0 = disabled)
+
+        // Timestamps
+        TimeUnit writePrecision = NANOSECONDS; ///< Unit of written timestamps, sent as precision= by begin()
+        bool serverTimestamps = false;  ///< Leave out the time of writing and let the server stamp points
+
+        // Automatic flush policy. Setting any threshold queues every write
+        // and flushes when the first threshold is reached; a full batch is
+        // always flushed to make room instead of rejecting the point.
+        size_t flushBytes = 0;          ///< Flush at this many queued bytes (0 = disabled)
+        uint16_t flushPoints = 0;       ///< Flush at this many queued points (0 = disabled)
+        uint32_t flushInterval = 0;     ///< Flush when the oldest point is this old (ms, 0 = disabled)
+
+        // Connection reuse
+        bool keepAlive = true;                ///< Keep the HTTP connection open between writes
+        uint32_t keepAliveIdleTimeout = 30000; ///< Close connections idle for longer than this (ms)
+        const char* caCert = nullptr;         ///< Root CA for HTTPS (nullptr skips verification)
+        Transport* transport = nullptr;       ///< Transport to InfluxDB, not owned (nullptr = built-in HTTPClient)
+
+        // Payload compression
+        bool compress = false;                ///< Gzip batch payloads (Content-Encoding: gzip)
+        size_t compressThreshold = 512;       ///< Only compress payloads of at least this size (bytes)
+
+        // Background sending (ESP32 and host builds)
+        bool asyncSend = false;               ///< Send batches from a background task started by begin()
+        uint32_t senderStackSize = 8192;      ///< Stack size of the sender task (bytes, ESP32)
+        uint8_t senderPriority = 1;           ///< FreeRTOS priority of the sender task (ESP32)
+
+        // Concurrent writes (ESP32 and host builds)
+        size_t ingestQueueSize = 0;           ///< Accept writes from any thread through a lock-free queue of this many points (0 = one writer)
+
+        // Offline spool: payloads that cannot be sent are kept on flash
+        bool spool = false;                   ///< Keep unsent batches in a persistent log opened by begin()
+        const char* spoolPath = "/lwiot";     ///< Directory of the spool segments
+        size_t spoolSize = 65536;             ///< Upper bound for the spool (bytes); the oldest data is dropped beyond it
+        size_t spoolSegmentSize = 8192;       ///< Spool segment size (bytes); must exceed staticBufferSize
+        uint32_t spoolDrainInterval = 1000;   ///< Minimum time between spooled payloads once the link is back (ms)
+
+        // Report by exception
+        size_t deadbandSeries = 64;           ///< Series tracked by setDeadband() filters; further series are always written
+
+        // Self-telemetry
+        uint32_t statsInterval = 0;           ///< Write an lwiot_stats point from loop() this often (ms, 0 = never)
+    };
+
+    /**
+     * @brief Counters describing HTTP connection reuse
+     */
+    struct ConnectionStats {
+        uint32_t requests = 0;      ///< HTTP requests sent
+        uint32_t handshakes = 0;    ///< New TCP/TLS connections opened
+        uint32_t reused = 0;        ///< Requests sent on an already open connection
+        uint32_t idleCloses = 0;    ///< Connections closed after exceeding the idle timeout
+        uint32_t brokenCloses = 0;  ///< Connections dropped after a transport error
+    };
+
+    /**
+     * @brief Why a batch was flushed
+     */
+    enum FlushReason {
+        FLUSH_NONE = 0,      ///< No flush is due
+        FLUSH_MANUAL,        ///< flushBatch(), endBatch() or before deep sleep
+        FLUSH_POINTS,        ///< flushPoints reached
+        FLUSH_BYTES,         ///< flushBytes reached
+        FLUSH_INTERVAL,      ///< flushInterval passed
+        FLUSH_FULL,          ///< Batch buffer full
+        FLUSH_RETRY,         ///< Backoff of a failed send passed
+        FLUSH_IMMEDIATE,     ///< Background sender, concurrent writes or writeSeries() without a flush policy
+        FLUSH_REASONS
+    };
+
+    /**
+     * @brief Histogram with fixed power-of-four buckets
+     *
+     * Bucket 0 counts zeros and bucket i (i > 0) values in [4^(i-1), 4^i);
+     * the last bucket also holds everything larger.
+     */
+    struct Histogram {
+        static const size_t BUCKETS = 10;
+        uint32_t buckets[BUCKETS] = {};
+        uint32_t count = 0;
+        uint32_t max = 0;
+        uint64_t sum = 0;
+
+        void add(uint32_t value, uint32_t times = 1);
+        void merge(const Histogram& other);
+        uint32_t mean() const { return count > 0 ? (uint32_t)(sum / count) : 0; }
+    };
+
+    /**
+     * @brief Counters and histograms describing the write path
+     */
+    struct Stats {
+        uint32_t pointsEncoded = 0;     ///< Points encoded by writes
+        uint32_t bytesEncoded = 0;      ///< Line protocol bytes encoded by writes
+        uint32_t pointsRejected = 0;    ///< Writes refused as invalid or too large
+        uint32_t pointsDropped = 0;     ///< Accepted points lost to a full batch, a rejected payload or exhausted retries
+        uint32_t pointsSuppressed = 0;  ///< Writes left out because no field was outside its deadband
+        uint32_t samplesAggregated = 0; ///< Field values folded into aggregation windows
+        uint32_t retries = 0;           ///< Retries scheduled after a failed send
+        uint32_t spoolDropped = 0;      ///< Spool segments and records dropped to stay within spoolSize
+        uint32_t flushes[FLUSH_REASONS] = {}; ///< Flushes by FlushReason
+        uint32_t minFreeHeap = 0;       ///< Lowest free heap seen (bytes, 0 on host builds)
+        size_t batchBytes = 0;          ///< Bytes currently queued
+        Histogram encodeMicros;         ///< Time to encode one point (us)
+        Histogram requestMillis;        ///< HTTP round-trip time (ms)
+        Histogram flushBytes;           ///< Batch fill level when flushed (bytes)
     };
 
     /**
@@ -67,7 +235,7 @@ public:
         String room;       ///< Room number/identifier
         String zone;       ///< Zone within the room
 
-        Location(String b = "", String f = "", String r = "", String z = "") 
+        Location(String b = "", String f = "", String r = "", String z = "")
             : building(b), floor(f), room(r), zone(z) {}
 
         /**
@@ -75,7 +243,7 @@ public:
          * @return true if valid, false otherwise
          */
         bool isValid() const {
-            return !building.isEmpty() && building.length() <= 64 &&
+            return building.length() > 0 && building.length() <= 64 &&
                    floor.length() <= 32 &&
                    room.length() <= 32 &&
                    zone.length() <= 32;
@@ -93,7 +261,7 @@ public:
         String type;        ///< Device type
         String description; ///< Optional description
 
-        Device(String did = "", Location loc = Location(), String t = "", String desc = "") 
+        Device(String did = "", Location loc = Location(), String t = "", String desc = "")
             : id(did), location(loc), type(t), description(desc) {}
 
         /**
@@ -101,38 +269,141 @@ public:
          * @return true if valid, false otherwise
          */
         bool isValid() const {
-            return !id.isEmpty() && id.length() <= 64 &&
-                   !type.isEmpty() && type.length() <= 32 &&
+            return id.length() > 0 && id.length() <= 64 &&
+                   type.length() > 0 && type.length() <= 32 &&
                    description.length() <= 128 &&
                    location.isValid();
         }
     };
 
     /**
-     * @brief Measurement structure for data points
+     * @brief One sample of one field in 16 bytes (24 on 64-bit hosts)
+     *
+     * The measurement name and field key are interned in KeyTable::shared()
+     * by the constructor, so the record holds IDs rather than strings,
+     * arrays of measurements are plain contiguous memory, and the names are
+     * escaped once for every sample. String values are not copied, as with
+     * Point: they must stay valid until the measurement is written.
+     *
+     * @code
+     * LightweightIoT::Measurement samples[] = {
+     *     {"temperature", "value", 21.5f},
+     *     {"pump", "state", "running"},
+     * };
+     * iot.writeMeasurements(samples, 2);
+     * @endcode
      */
     struct Measurement {
-        String name;         ///< Measurement name
-        String field;        ///< Field name
-        String value;        ///< The actual value
-        unsigned long time;  ///< Timestamp
+        uint64_t time;             ///< Timestamp, 0 for the time of writing
+        union {
+            float f;
+            int32_t i;
+            bool b;
+            const char* s;         ///< String value, not copied
+        } value;
+        KeyTable::Id name;         ///< Interned measurement name
+        uint16_t field : 12;       ///< Interned field key
+        uint16_t type : 2;         ///< LineProtocol::FieldType of the value
+        uint16_t unit : 2;         ///< TimeUnit of the timestamp
 
-        Measurement(String n, String f, String v, unsigned long t = 0) 
-            : name(n), field(f), value(v), time(t) {}
+        Measurement();
+        Measurement(const char* name, const char* field, float value, uint64_t time = 0, TimeUnit unit = MILLISECONDS);
+        Measurement(const char* name, const char* field, double value, uint64_t time = 0, TimeUnit unit = MILLISECONDS);
+        Measurement(const char* name, const char* field, int value, uint64_t time = 0, TimeUnit unit = MILLISECONDS);
+        Measurement(const char* name, const char* field, long value, uint64_t time = 0, TimeUnit unit = MILLISECONDS);
+        Measurement(const char* name, const char* field, bool value, uint64_t time = 0, TimeUnit unit = MILLISECONDS);
+        Measurement(const char* name, const char* field, const char* value, uint64_t time = 0,
+                    TimeUnit unit = MILLISECONDS);
 
         /**
          * @brief Validates the measurement data
-         * @return true if valid, false otherwise
+         * @return false if a name was empty, too long or did not fit in the key table, or a string value was too long
          */
-        bool isValid() const {
-            return !name.isEmpty() && name.length() <= 64 &&
-                   !field.isEmpty() && field.length() <= 32 &&
-                   !value.isEmpty() && value.length() <= 64;
+        bool isValid() const;
+
+    private:
+        void setKeys(const char* name, const char* field, LineProtocol::FieldType type, uint64_t time,
+                     TimeUnit unit);
+    };
+
+    /**
+     * @brief Point with several fields of mixed types
+     *
+     * All fields share one line, so the measurement, tag set and timestamp
+     * are sent once per sample. Nothing is copied: the measurement, field
+     * keys and string values must stay valid until the point is written.
+     *
+     * @code
+     * LightweightIoT::Point point("energy");
+     * point.addField("voltage", voltage).addField("current", current).addField("relay", on);
+     * iot.writePoint(point);
+     * @endcode
+     */
+    class Point {
+    public:
+        static const size_t MAX_FIELDS = 16;
+
+        explicit Point(const char* measurement)
+            : measurement(measurement), count(0), timestamp(0), overflow(false) {}
+
+        Point& addField(const char* key, float value) { return add(LineProtocol::Field(key, value)); }
+        Point& addField(const char* key, double value) { return add(LineProtocol::Field(key, value)); }
+        Point& addField(const char* key, int value) { return add(LineProtocol::Field(key, value)); }
+        Point& addField(const char* key, long value) { return add(LineProtocol::Field(key, value)); }
+        Point& addField(const char* key, bool value) { return add(LineProtocol::Field(key, value)); }
+        Point& addField(const char* key, const char* value) { return add(LineProtocol::Field(key, value)); }
+
+        /**
+         * @brief Sets an explicit timestamp in Config::writePrecision units, 0 for the time of writing
+         */
+        Point& setTimestamp(uint64_t time) {
+            timestamp = time;
+            return *this;
+        }
+
+        /**
+         * @brief Removes all fields so the point can be reused for the next sample
+         */
+        void clearFields() {
+            count = 0;
+            overflow = false;
         }
+
+        size_t fieldCount() const { return count; }
+
+    private:
+        friend class LightweightIoT;
+
+        Point& add(const LineProtocol::Field& field) {
+            if (count < MAX_FIELDS) {
+                fields[count++] = field;
+            } else {
+                overflow = true;
+            }
+            return *this;
+        }
+
+        const char* measurement;
+        LineProtocol::Field fields[MAX_FIELDS];
+        size_t count;
+        uint64_t timestamp;
+        bool overflow;  ///< More than MAX_FIELDS fields were added
     };
 
+    /**
+     * @brief Measurement with a fixed list of typed fields, checked and escaped at compile time
+     *
+     * Declared with LWIOT_FIELD and LWIOT_SERIES; see LightweightIoTSchema.h.
+     */
+    template <typename Name, typename... Fields>
+    class Series;
+
     // Constructor and basic methods
     LightweightIoT(String token, String org, String bucket);
+    ~LightweightIoT();
+
+    LightweightIoT(const LightweightIoT&) = delete;
+    LightweightIoT& operator=(const LightweightIoT&) = delete;
 
     /**
      * @brief Validates InfluxDB credentials
@@ -152,272 +423,527 @@ public:
      */
     void enablePowerSaving(uint32_t duration);
 
+    /**
+     * @brief Manages power state
+     */
+    void managePower();
+
+    /**
+     * @brief Returns the exact encoded size of a point written now
+     *
+     * The size of the line writePoint() would queue for a string field,
+     * with the current tag set, float precision and timestamp, excluding the
+     * newline. Use it to size Config::maxPointSize and staticBufferSize.
+     *
+     * @return Size in bytes, 0 if the point has no writable field
+     */
     size_t getPointSize(String measurement, String field, String value);
-    bool reserveBuffer(size_t size);
+    size_t getPointSize(const Point& point);
+
+    /**
+     * @brief Returns the size of the region Config::useStaticBuffer needs
+     *
+     * Covers the point and tag set buffers, the batch, and whichever of the
+     * column batch, send buffer, compressor, spool buffer, ingest queue and
+     * deadband table the configuration and rules call for.
+     */
+    size_t requiredBufferSize() const;
+
+    /**
+     * @brief Reserves the region every buffer is carved from
+     *
+     * Frees the buffers allocated so far; begin() then carves all of them
+     * from the region, and they stay there until freeBuffer(). begin() calls
+     * this with Config::useStaticBuffer if no region has been reserved.
+     * Must be called before begin(), with no points queued.
+     *
+     * @param size Region size in bytes, 0 for requiredBufferSize()
+     * @return true if the region was reserved
+     */
+    bool reserveBuffer(size_t size = 0);
+
+    /**
+     * @brief Stops the sender and frees every buffer and the reserved region
+     *
+     * Points still queued are dropped; flush first to keep them.
+     */
     void freeBuffer();
     bool reconnect();
     void setAutoReconnect(bool enabled);
     bool getAutoReconnect() const { return config.autoReconnect; }
-    
-private:
-    String token;
-    String org;
-    String bucket;
-    String url;
-    Config config;
-    ErrorCode lastError;
-    String lastErrorMessage;
-    
-    // Tag storage
-    struct Tag {
-        String key;
-        String value;
-    };
-    static const int MAX_TAGS = 10;
-    Tag tags[MAX_TAGS];
-    int tagCount;
-    
-    // Batch storage
-    static const int MAX_BATCH_SIZE = 50;
-    String batchBuffer[MAX_BATCH_SIZE];
-    int batchCount;
-    bool batchMode;
-    
-    // Helper methods
-    String formatLineProtocol(String measurement, String field, String value);
-    String formatLineProtocol(String measurement, String field, float value);
-    String formatLineProtocol(String measurement, String field, int value);
-    bool sendToInfluxDB(String lineProtocol);
-    bool addToBatch(String lineProtocol);
-    void setError(ErrorCode code, String message);
-    bool retryOperation(std::function<bool()> operation);
-    
-public:
-    LightweightIoT(String token, String org, String bucket);
-    
+
     // Configuration
     void setConfig(Config config);
     Config getConfig() const { return config; }
-    
+
     // Error handling
     ErrorCode getLastError() const { return lastError; }
-    String getLastErrorMessage() const { return lastErrorMessage; }
-    void clearError() { lastError = NO_ERROR; lastErrorMessage = ""; }
-    
+    String getLastErrorMessage();
+    void clearError();
+
+    // Logging
+    void setLogLevel(LogLevel level);
+    LogLevel getLogLevel() const { return logLevel; }
+    void setLogCallback(void (*callback)(LogLevel level, const char* message));
+
     // Connection methods
     bool begin(String influxUrl = "https://cloud2.influxdata.com");
     bool isConnected();
-    
+    ConnectionStats getConnectionStats() const;
+
+    /**
+     * @brief Returns a snapshot of the write path statistics
+     *
+     * Counters are kept since construction or the last resetStats(). Call it
+     * from the thread that writes points, or from any thread with
+     * Config::ingestQueueSize.
+     */
+    Stats getStats() const;
+    void resetStats();
+
+    /**
+     * @brief Writes the current statistics as an lwiot_stats point
+     *
+     * The point carries the client's tags and goes through the normal write
+     * path. loop() calls this every Config::statsInterval.
+     */
+    bool writeStats();
+
+    /**
+     * @brief Returns when the failed payload at the front of the queue is retried
+     *
+     * Retries do not block: the payload stays queued and is sent again by
+     * loop(), or by the next write, once this time has passed.
+     * @return millis() time of the next attempt, 0 if no retry is waiting
+     */
+    unsigned long getNextRetryTime() const;
+
+    /**
+     * @brief Encodes a point into a caller-supplied buffer
+     *
+     * The point is rendered with the current tag set and timestamp without
+     * touching the heap. The output is NUL-terminated.
+     *
+     * @param buffer Destination buffer
+     * @param capacity Size of the destination buffer in bytes
+     * @return Exact encoded length, or 0 if the point does not fit
+     */
+    size_t encodePoint(char* buffer, size_t capacity, const char* measurement, const char* field, float value);
+    size_t encodePoint(char* buffer, size_t capacity, const char* measurement, const char* field, int value);
+    size_t encodePoint(char* buffer, size_t capacity, const char* measurement, const char* field, const char* value);
+    size_t encodePoint(char* buffer, size_t capacity, const Point& point);
+    size_t encodePoint(char* buffer, size_t capacity, const Measurement& measurement);
+
     // Data methods
-    bool writePoint(String measurement, String field, float value);
-    bool writePoint(String measurement, String field, int value);
-    bool writePoint(String measurement, String field, String value);
-    
-    // Tag methods
-    bool addTag(String key, String value);
-    void clearTags();
-    
-    // Batch methods
-    void beginBatch();
-    bool endBatch();
-    void clearBatch();
-    bool flushBatch();
-    int getBatchSize() { return batchCount; }
-};
+    bool writePoint(const char* measurement, const char* field, float value);
+    bool writePoint(const char* measurement, const char* field, int value);
+    bool writePoint(const char* measurement, const char* field, const char* value);
+    bool writePoint(const String& measurement, const String& field, float value) {
+        return writePoint(measurement.c_str(), field.c_str(), value);
+    }
+    bool writePoint(const String& measurement, const String& field, int value) {
+        return writePoint(measurement.c_str(), field.c_str(), value);
+    }
+    bool writePoint(const String& measurement, const String& field, const String& value) {
+        return writePoint(measurement.c_str(), field.c_str(), value.c_str());
+    }
 
-#endif
+    /**
+     * @brief Writes several fields as a single line
+     *
+     * Field types may be mixed: `writePoint("power", {{"watts", 512.5f}, {"phase", 2}, {"on", true}})`.
+     * At most Point::MAX_FIELDS fields; NaN and infinite values are left out.
+     * @return true if the point was sent or queued
+     */
+    bool writePoint(const Point& point);
+    bool writePoint(const char* measurement, std::initializer_list<LineProtocol::Field> fields);
 
-// Add these new methods to the public section
-public:
-    // Multiple fields in one point
+    // Multiple fields of one type
     bool writePoint(String measurement, std::initializer_list<std::pair<String, float>> fields);
     bool writePoint(String measurement, std::initializer_list<std::pair<String, int>> fields);
     bool writePoint(String measurement, std::initializer_list<std::pair<String, String>> fields);
-    
-    // Timestamp control
-    bool writePoint(String measurement, String field, float value, unsigned long timestamp);
-    bool writePoint(String measurement, String field, int value, unsigned long timestamp);
-    bool writePoint(String measurement, String field, String value, unsigned long timestamp);
-    
-private:
-    bool validateMeasurement(String measurement);
-    bool validateField(String field);
-    bool validateValue(String value);
-    bool validateTag(String key, String value);
+
     // Timestamp control
     bool writePoint(String measurement, String field, float value, unsigned long timestamp);
     bool writePoint(String measurement, String field, int value, unsigned long timestamp);
     bool writePoint(String measurement, String field, String value, unsigned long timestamp);
-    
-public:
-    enum LogLevel {
-        LOG_NONE = 0,
-        LOG_ERROR = 1,
-        LOG_WARN = 2,
-        LOG_INFO = 3,
-        LOG_DEBUG = 4
-    };
-    
-    void setLogLevel(LogLevel level);
-    LogLevel getLogLevel() const { return logLevel; }
-    void setLogCallback(void (*callback)(LogLevel level, const char* message));
 
-private:
-    LogLevel logLevel = LOG_ERROR;
-    void (*logCallback)(LogLevel level, const char* message) = nullptr;
-    void log(LogLevel level, const char* format, ...);
+    // Tag methods
+    bool addTag(String key, String value);
+    void clearTags();
 
-public:
-    class LightweightIoT {
-    public:
-        // Device and Location structure
-        struct Device {
-            String id;           // Unique device identifier
-            String location;     // Location identifier (e.g., "building_A")
-            String description;  // Optional description
-            
-            Device(String did = "", String loc = "", String desc = "") 
-                : id(did), location(loc), description(desc) {}
-        };
-    
-        // Time series settings
-        enum TimeUnit {
-            SECONDS,
-            MILLISECONDS,
-            MICROSECONDS,
-            NANOSECONDS
-        };
-    
-        // Measurement structure for better organization
-        struct Measurement {
-            String name;         // Measurement name (e.g., "temperature")
-            String field;        // Field name (e.g., "value")
-            String value;        // The actual value
-            unsigned long time;  // Timestamp
-            TimeUnit unit;       // Time unit
-            
-            Measurement(String n, String f, String v, unsigned long t = 0, TimeUnit u = MILLISECONDS)
-                : name(n), field(f), value(v), time(t), unit(u) {}
-        };
-    
-        // New methods for better data organization
-        void setDevice(const Device& device);
-        Device getDevice() const { return currentDevice; }
-        void setTimeUnit(TimeUnit unit) { timeUnit = unit; }
-        
-        // Enhanced write methods
-        bool writeMeasurement(const Measurement& measurement);
-        bool writeMeasurements(const Measurement* measurements, size_t count);
-    
-        // Helper method to get current timestamp in the configured unit
-        unsigned long getCurrentTimestamp();
-    
-    private:
-        Device currentDevice;
-        TimeUnit timeUnit = MILLISECONDS;
-        String formatTimestamp(unsigned long timestamp, TimeUnit unit);
-    
     /**
-     * @brief Validates HTTPS certificate
-     * @return true if valid, false otherwise
+     * @brief Sets the number of decimals written for a float field
+     *
+     * Overrides Config::floatPrecision for every point with this field key.
+     * @param field Field key
+     * @param decimals 0-9, or -1 for the shortest form that reads back exactly
+     * @return false if the table of per-field precisions is full
      */
-    bool validateCertificate();
+    bool setFieldPrecision(const char* field, int8_t decimals);
 
     /**
-     * @brief Manages power state
+     * @brief Thresholds of a report-by-exception filter, see ReportFilter::Rule
      */
-    void managePower();
-};
+    typedef ReportFilter::Rule Deadband;
 
-#endif
+    /**
+     * @brief Only writes a field when its value has changed meaningfully
+     *
+     * Each combination of measurement, field key and tag set is a series of
+     * its own. A write is left out, and still returns true, when every field
+     * has a deadband and none of them is due; otherwise all its fields are
+     * recorded as reported. The most specific deadband applies. The first
+     * call allocates a table of Config::deadbandSeries series.
+     * @param measurement Measurement name, nullptr for every measurement
+     * @param field Field key, nullptr for every field
+     * @return false if the table of deadbands is full or cannot be allocated
+     */
+    bool setDeadband(const char* measurement, const char* field, const Deadband& deadband);
+
+    /**
+     * @brief Removes all deadbands and forgets the reported values
+     */
+    void clearDeadbands();
+
+    /**
+     * @brief Writes a numeric field as statistics over tumbling windows
+     *
+     * Values of the field are no longer written as they come. They are
+     * folded into a window of `window` ms, and when the window has ended the
+     * next write or loop() writes one point with the fields <field>_min,
+     * _max, _mean, _count, _last and optionally _stddev, stamped with the
+     * window's start. Other fields of a point are written as usual. Open
+     * windows are also written before the tags change.
+     * @param measurement Measurement name
+     * @param field Field key
+     * @param window Window length (ms)
+     * @param stddev Also write the sample standard deviation
+     * @return false if the table of aggregations is full
+     */
+    bool setAggregation(const char* measurement, const char* field, uint32_t window, bool stddev = false);
+
+    /**
+     * @brief Writes the open windows and removes all aggregations
+     */
+    void clearAggregations();
+
+    // Device and measurement methods
+    void setDevice(const Device& device);
+    Device getDevice() const { return currentDevice; }
+    void setTimeUnit(TimeUnit unit) { timeUnit = unit; }
+    bool writeMeasurement(const Measurement& measurement);
+    bool writeMeasurements(const Measurement* measurements, size_t count);
+
+    /**
+     * @brief Writes a block of regularly spaced samples of one field
+     *
+     * For captured waveforms: the measurement, tag set and field key are
+     * escaped once for the whole block, and each sample costs a number and
+     * a timestamp. Lines go straight into the batch, which is flushed
+     * whenever the flush policy or the buffer fills, so a block may be
+     * larger than the batch. Without batching the block is sent when it
+     * has been written. Samples that are NaN or infinite are left out.
+     *
+     * With Config::serverTimestamps a block ending now is written without
+     * timestamps, like any point without an explicit time, so the server
+     * stamps its lines with one arrival time; pass a start time to keep the
+     * samples apart. A time of 0 is never written.
+     * @param measurement Measurement name
+     * @param field Field key
+     * @param values Samples, oldest first
+     * @param count Number of samples
+     * @param start Time of the first sample, 0 for a block whose last sample is the time of writing;
+     *              such a block is rejected if it would start before the clock's zero
+     * @param interval Time between samples
+     * @param unit Unit of start and interval
+     * @return false if any sample was rejected or dropped
+     */
+    bool writeSeries(const char* measurement, const char* field, const float* values, size_t count,
+                     uint64_t start, uint32_t interval, TimeUnit unit = MILLISECONDS);
+    bool writeSeries(const char* measurement, const char* field, const int32_t* values, size_t count,
+                     uint64_t start, uint32_t interval, TimeUnit unit = MILLISECONDS);
+
+    /**
+     * @brief Writes a block of samples of one field, each with its own timestamp
+     * @param times Timestamp of each sample, written as given
+     */
+    bool writeSeries(const char* measurement, const char* field, const float* values, size_t count,
+                     const uint64_t* times, TimeUnit unit = MILLISECONDS);
+    bool writeSeries(const char* measurement, const char* field, const int32_t* values, size_t count,
+                     const uint64_t* times, TimeUnit unit = MILLISECONDS);
+
+    /**
+     * @brief Gets the current timestamp in the unit set with setTimeUnit()
+     */
+    uint64_t getCurrentTimestamp();
+
+    /**
+     * @brief Runs periodic work such as age-based batch flushing
+     *
+     * Call this from the sketch's loop(); it returns immediately when there
+     * is nothing to do.
+     */
+    void loop();
+
+    // Batch methods
+    void beginBatch();
+    bool endBatch();
+    void clearBatch();
+    bool flushBatch();
+    int getBatchSize() { return (int)(batch.points() + columns.samples()); }
+    size_t getBatchBytes() const { return batch.bytes() + columns.bytes(); }
+
+    /**
+     * @brief Returns the amount of data waiting in the offline spool
+     * @return Approximate size in bytes, 0 if the spool is empty or disabled
+     */
+    size_t getSpoolBytes() const;
+
+    /**
+     * @brief Checks whether the background sender still holds unsent points
+     */
+    bool isSending() const;
 
-// Add these new methods to the public section
-public:
-    // Multiple fields in one point
-    bool writePoint(String measurement, std::initializer_list<std::pair<String, float>> fields);
-    bool writePoint(String measurement, std::initializer_list<std::pair<String, int>> fields);
-    bool writePoint(String measurement, std::initializer_list<std::pair<String, String>> fields);
-    
-    // Timestamp control
-    bool writePoint(String measurement, String field, float value, unsigned long timestamp);
-    bool writePoint(String measurement, String field, int value, unsigned long timestamp);
-    bool writePoint(String measurement, String field, String value, unsigned long timestamp);
-    
 private:
-    bool validateMeasurement(String measurement);
-    bool validateField(String field);
-    bool validateValue(String value);
-    bool validateTag(String key, String value);
-    // Timestamp control
-    bool writePoint(String measurement, String field, float value, unsigned long timestamp);
-    bool writePoint(String measurement, String field, int value, unsigned long timestamp);
-    bool writePoint(String measurement, String field, String value, unsigned long timestamp);
-    
-public:
-    enum LogLevel {
-        LOG_NONE = 0,
-        LOG_ERROR = 1,
-        LOG_WARN = 2,
-        LOG_INFO = 3,
-        LOG_DEBUG = 4
+    String token;
+    String org;
+    String bucket;
+    String url;
+    Config config;
+    ErrorCode lastError;
+    String lastErrorMessage;
+
+    // Tags, copied into tagText so that each client keeps its own
+    struct Tag {
+        uint16_t key;    ///< Offset of the NUL-terminated key in tagText
+        uint16_t value;  ///< Offset of the NUL-terminated value in tagText
     };
-    
-    void setLogLevel(LogLevel level);
-    LogLevel getLogLevel() const { return logLevel; }
-    void setLogCallback(void (*callback)(LogLevel level, const char* message));
+    static const int MAX_TAGS = 10;
+    static const size_t MAX_TAG_TEXT = 512;  ///< Room for the keys and values of a full Device
+    Tag tags[MAX_TAGS];
+    int tagCount;
+    char tagText[MAX_TAG_TEXT];
+    size_t tagTextLength;
 
-private:
+    // Per-field float precision overrides
+    struct FieldPrecision {
+        String field;
+        int8_t decimals;
+    };
+    static const int MAX_FIELD_PRECISIONS = 8;
+    FieldPrecision fieldPrecisions[MAX_FIELD_PRECISIONS];
+    int fieldPrecisionCount;
+
+    // Escaped, key-sorted tag set shared by every point, rebuilt on tag changes
+    char* tagSet;
+    size_t tagSetLength;
+    size_t tagSetCapacity;
+    uint32_t tagSetHash;  ///< ReportFilter::hash() of tagSet
+    bool tagSetDirty;
+
+    // Report-by-exception rules and the last reported value of each series,
+    // shared by concurrent writers under stateLock
+    struct DeadbandRule {
+        String measurement;  ///< Empty for every measurement
+        String field;        ///< Empty for every field
+        Deadband deadband;
+    };
+    static const int MAX_DEADBANDS = 8;
+    DeadbandRule deadbands[MAX_DEADBANDS];
+    int deadbandCount;
+    ReportFilter reportFilter;
+
+    // Windowed aggregations, added to under stateLock by concurrent writers
+    static const int MAX_AGGREGATIONS = 8;
+    Aggregation aggregations[MAX_AGGREGATIONS];
+    int aggregationCount;
+
+    // Device and time settings
+    Device currentDevice;
+    TimeUnit timeUnit = MILLISECONDS;
+
+    // Batch storage, sized from Config::staticBufferSize
+    BatchBuffer batch;
+    bool batchMode;
+
+    // Raw samples batched with Config::columnBatchSize, rendered into
+    // `batch` as it is flushed
+    ColumnBatch columns;
+    unsigned long batchStartedAt;   ///< millis() when the oldest queued point was added
+
+#ifdef LWIOT_HAS_THREADS
+    // Concurrent writes: producers encode straight into queue slots, and one
+    // flusher (the sender, else loop()) moves them into `batch`. Counters a
+    // producer would otherwise update in `stats` are kept here until then.
+    PointQueue ingest;
+    std::atomic<uint32_t> ingestRejected;
+    std::atomic<uint32_t> ingestDropped;
+    std::atomic<bool> ingestWake;      ///< A producer has woken the sender since it last collected
+    size_t ingestWakeMask;             ///< Producers wake the sender on tickets with these bits clear
+    std::atomic<bool> flushRequested;  ///< flushBatch() called while the sender owns `batch`
+#endif
+
+    // Persistent HTTP connection, through Config::transport if set. The
+    // sender updates the counters under stateLock.
+    HTTPClientTransport defaultTransport;
+    ConnectionStats connectionStats;
+
+    // Write path statistics. Encode and batch counters are only updated by
+    // the writing thread; the rest under stateLock.
+    Stats stats;
+    unsigned long lastStatsAt;
+
+#ifdef LWIOT_HAS_THREADS
+    // Background sender: producers fill `batch` while the sender drains
+    // `sendBuffer`. Only the producer swaps them, and only while the sender
+    // is idle, so neither side ever waits for the other.
+    BatchBuffer sendBuffer;
+    std::atomic<bool> sendPending;   ///< sendBuffer is owned by the sender
+    std::atomic<bool> senderStop;
+    std::atomic<bool> senderActive;
+    mutable std::mutex stateLock;  ///< Guards the error, retry and statistics state shared with the sender
+    std::mutex transportLock;      ///< Serializes requests from the sender and validateCredentials()
+#ifdef ARDUINO
+    TaskHandle_t senderTask;
+    static void senderTaskMain(void* arg);
+#else
+    std::thread senderThread;
+    std::mutex senderLock;
+    std::condition_variable senderWake;
+#endif
+    bool startSender();
+    void stopSender();
+    void wakeSender();
+    void senderMain();
+    bool handOffBatch();
+    bool ensureSendBuffer();
+#endif
+
+    // Retry scheduling for the payload at the front of the queue
+    enum SendStatus {
+        SEND_OK,
+        SEND_RETRY,   ///< Keep the payload queued and try again at retry.nextAttemptAt
+        SEND_FAILED,  ///< The server rejected the payload for good
+        SEND_GAVE_UP  ///< Still failing after maxRetries or retryBudget
+    };
+    struct RetryState {
+        bool pending = false;
+        uint8_t attempts = 0;              ///< Retries scheduled for the current payload
+        unsigned long firstFailureAt = 0;
+        unsigned long nextAttemptAt = 0;
+    };
+    RetryState retry;
+
+    // Compressor for batch payloads, allocated on first use
+    GzipWriter* gzip;
+
+    // Offline spool and the buffer its records are read into, allocated by begin()
+    Spool* spool;
+    char* spoolBuffer;
+    size_t spoolBufferSize;
+    size_t spoolBytes;      ///< Copy of spool->bytes() for other threads, under stateLock
+    uint32_t spoolDropped;  ///< Copy of spool->dropped() for other threads, under stateLock
+    unsigned long lastSpoolDrainAt;
+
+    // Scratch buffer holding the point currently being encoded
+    char* pointBuffer;
+    size_t pointBufferSize;
+
+    // Region the buffers are carved from with Config::useStaticBuffer
+    Arena arena;
+
+    // Logging
     LogLevel logLevel = LOG_ERROR;
     void (*logCallback)(LogLevel level, const char* message) = nullptr;
     void log(LogLevel level, const char* format, ...);
 
-public:
-    class LightweightIoT {
-    public:
-        // Device and Location structure
-        struct Device {
-            String id;           // Unique device identifier
-            String location;     // Location identifier (e.g., "building_A")
-            String description;  // Optional description
-            
-            Device(String did = "", String loc = "", String desc = "") 
-                : id(did), location(loc), description(desc) {}
-        };
-    
-        // Time series settings
-        enum TimeUnit {
-            SECONDS,
-            MILLISECONDS,
-            MICROSECONDS,
-            NANOSECONDS
-        };
-    
-        // Measurement structure for better organization
-        struct Measurement {
-            String name;         // Measurement name (e.g., "temperature")
-            String field;        // Field name (e.g., "value")
-            String value;        // The actual value
-            unsigned long time;  // Timestamp
-            TimeUnit unit;       // Time unit
-            
-            Measurement(String n, String f, String v, unsigned long t = 0, TimeUnit u = MILLISECONDS)
-                : name(n), field(f), value(v), time(t), unit(u) {}
-        };
-    
-        // New methods for better data organization
-        void setDevice(const Device& device);
-        Device getDevice() const { return currentDevice; }
-        void setTimeUnit(TimeUnit unit) { timeUnit = unit; }
-        
-        // Enhanced write methods
-        bool writeMeasurement(const Measurement& measurement);
-        bool writeMeasurements(const Measurement* measurements, size_t count);
-    
-        // Helper method to get current timestamp in the configured unit
-        unsigned long getCurrentTimestamp();
-    
-    private:
-        Device currentDevice;
-        TimeUnit timeUnit = MILLISECONDS;
-        String formatTimestamp(unsigned long timestamp, TimeUnit unit);
-    
\ No newline at end of file
+    // Helper methods
+    size_t encodeFields(char* buffer, size_t capacity, const char* measurement,
+                        const LineProtocol::Field* fields, size_t count, uint64_t timestamp);
+    bool writeFields(const char* measurement, const LineProtocol::Field* fields, size_t count, uint64_t timestamp,
+                     bool now = false);
+    bool writeSamples(const char* measurement, const char* field, LineProtocol::FieldType type, const void* values,
+                      size_t count, const uint64_t* times, uint64_t start, uint32_t interval, TimeUnit unit);
+    bool queueSample(const char* measurement, const LineProtocol::Field& field);
+    bool queueSample(KeyTable::Id name, KeyTable::Id field, const LineProtocol::Field& value);
+    bool ensureColumns();
+    void renderColumns();
+    void closeColumns();
+
+    // Destination of the point being written: pointBuffer, or a claimed
+    // ingest slot when writes are concurrent
+    struct PointTarget {
+        char* data;
+        size_t capacity;
+        size_t ticket;
+        bool queued;
+    };
+    bool beginPoint(PointTarget* target);
+    bool submitPoint(const PointTarget& target, size_t length, unsigned long startMicros);
+    bool submitPoint(size_t length);
+    void rejectPoint(const char* message, ErrorCode code = INVALID_DATA);
+    bool ingestActive() const;
+    void collectIngest();
+    void recordEncode(unsigned long startMicros, size_t length);
+    void countDropped(size_t points);
+    void sampleHeap();
+    bool flush(FlushReason reason);
+    uint64_t currentTimestamp();
+    int8_t precisionFor(const char* field) const;
+    size_t encodeMeasurement(char* buffer, size_t capacity, const Measurement& measurement, uint64_t timestamp);
+    uint64_t measurementTimestamp(const Measurement& measurement);
+    const Deadband* deadbandFor(const char* measurement, const char* field) const;
+    bool reportDue(const char* measurement, const LineProtocol::Field* fields, size_t count);
+    size_t aggregate(const char* measurement, const LineProtocol::Field* fields, size_t count,
+                     LineProtocol::Field* remaining);
+    void closeWindows(bool all);
+    bool writeWindow(const Aggregation& aggregation, const Aggregation::Summary& summary);
+    bool carveBuffer(size_t size, void** storage);
+    char* allocateBuffer(size_t size);
+    void releaseBuffer(char* buffer);
+    bool carveBuffers();
+    void releaseBuffers();
+    bool allocateReportFilter();
+    bool ensureGzip();
+    void resolvePrecisions(const LineProtocol::Field* fields, size_t count, LineProtocol::Field* values) const;
+    size_t encodedSize(const char* measurement, const LineProtocol::Field* fields, size_t count, uint64_t timestamp);
+    bool ensurePointBuffer();
+    bool refreshTagSet();
+    bool ensureBatchBuffer();
+    bool isBatching() const;
+    FlushReason flushDue() const;
+    bool asyncActive() const;
+    bool drainBatch(BatchBuffer& buffer);
+    size_t spoolRuns(BatchBuffer& buffer, const Transport::Slice* runs, size_t count);
+    bool openSpool();
+    bool spoolRun(const char* data, size_t length);
+    void drainSpool();
+    void recordSpool();
+    Transport* activeTransport();
+    int postPayload(Transport::Request& request, unsigned long* retryAfter);
+    SendStatus sendToInfluxDB(const Transport::Slice* body, size_t count);
+    SendStatus sendToInfluxDB(Transport::Request& request);
+    SendStatus sendBatchRun(const Transport::Slice* runs, size_t count);
+    SendStatus scheduleRetry(int httpCode, unsigned long retryAfter);
+    void deferRetry(unsigned long delayMs);
+    void resetRetry();
+    bool retryDue() const;
+    static bool isRetryable(int httpCode);
+    bool addToBatch(const char* lineProtocol, size_t length);
+    void setError(ErrorCode code, String message);
+    uint64_t scaleTimestamp(uint64_t timestamp, TimeUnit from, TimeUnit to) const;
+    static uint64_t clockMillis();
+    bool validateMeasurement(String measurement);
+    bool validateField(String field);
+    bool validateValue(String value);
+    bool validateTag(String key, String value);
+
+    /**
+     * @brief Validates HTTPS certificate
+     * @return true if valid, false otherwise
+     */
+    bool validateCertificate();
+};
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef LIGHTWEIGHT_IOT_SCHEMA_H
+#define LIGHTWEIGHT_IOT_SCHEMA_H
+
+#include <string.h>
+
+#include "LightweightIoT.h"
+
+/**
+ * @file LightweightIoTSchema.h
+ * @brief Compile-time series schemas
+ *
+ * A series is declared once with its measurement name and typed fields:
+ *
+ * @code
+ * LWIOT_FIELD(Voltage, "voltage", float);
+ * LWIOT_FIELD(Current, "current", float);
+ * LWIOT_FIELD(Relay, "relay", bool);
+ * LWIOT_SERIES(Energy, "energy", Voltage, Current, Relay);
+ *
+ * Energy::write(iot, 230.1f, 1.2f, true);
+ * @endcode
+ *
+ * Names are validated and escaped by the compiler and stored as constants, so
+ * a write only formats the values. An invalid or duplicate name, an
+ * unsupported field type or a wrong number of values fails the build.
+ */
+
+/**
+ * @brief Declares a field type for use in LWIOT_SERIES
+ * @param id Name of the generated type
+ * @param key Field key, a string literal
+ * @param type Value type: float, double, int, long, bool or const char*
+ */
+#define LWIOT_FIELD(id, key, type)                              \
+    struct id {                                                 \
+        typedef type Type;                                      \
+        static constexpr const char* name() { return key; }     \
+    }
+
+/**
+ * @brief Declares a series type with a measurement name and a list of LWIOT_FIELD types
+ */
+#define LWIOT_SERIES(id, measurement, ...)                              \
+    struct id##Measurement {                                            \
+        static constexpr const char* name() { return measurement; }     \
+    };                                                                  \
+    typedef LightweightIoT::Series<id##Measurement, __VA_ARGS__> id
+
+namespace LightweightIoTSchema {
+
+// Constant expressions are limited to a single return statement in C++11,
+// hence the recursion
+
+constexpr bool isSpecial(char c, int context) {
+    return c == ',' || c == ' ' || (c == '=' && (context & LineProtocol::ESCAPE_KEY) != 0);
+}
+
+constexpr size_t escapedLength(const char* str, int context) {
+    return *str == '\0' ? 0 : (isSpecial(*str, context) ? 2 : 1) + escapedLength(str + 1, context);
+}
+
+// Character at position index of the escaped string
+constexpr char escapedChar(const char* str, int context, size_t index) {
+    return isSpecial(*str, context)
+               ? (index == 0 ? '\\' : index == 1 ? *str : escapedChar(str + 1, context, index - 2))
+               : (index == 0 ? *str : escapedChar(str + 1, context, index - 1));
+}
+
+constexpr bool isPrintable(const char* str) {
+    return *str == '\0' || ((unsigned char)*str >= 0x20 && *str != 0x7f && isPrintable(str + 1));
+}
+
+// InfluxDB reserves names starting with an underscore
+constexpr bool isValidName(const char* str) {
+    return *str != '\0' && *str != '_' && isPrintable(str);
+}
+
+constexpr bool equals(const char* a, const char* b) {
+    return *a == *b && (*a == '\0' || equals(a + 1, b + 1));
+}
+
+constexpr bool contains(const char*) {
+    return false;
+}
+
+template <typename... Names>
+constexpr bool contains(const char* name, const char* first, Names... rest) {
+    return equals(name, first) || contains(name, rest...);
+}
+
+constexpr bool all() {
+    return true;
+}
+
+template <typename... Rest>
+constexpr bool all(bool first, Rest... rest) {
+    return first && all(rest...);
+}
+
+template <typename... Fields>
+struct Distinct {
+    static constexpr bool value = true;
+};
+
+template <typename First, typename... Rest>
+struct Distinct<First, Rest...> {
+    static constexpr bool value = !contains(First::name(), Rest::name()...) && Distinct<Rest...>::value;
+};
+
+template <typename T>
+struct IsFieldType {
+    static constexpr bool value = false;
+};
+
+template <> struct IsFieldType<float> { static constexpr bool value = true; };
+template <> struct IsFieldType<double> { static constexpr bool value = true; };
+template <> struct IsFieldType<int> { static constexpr bool value = true; };
+template <> struct IsFieldType<long> { static constexpr bool value = true; };
+template <> struct IsFieldType<bool> { static constexpr bool value = true; };
+template <> struct IsFieldType<const char*> { static constexpr bool value = true; };
+
+template <size_t... I>
+struct Indices {};
+
+template <size_t N, size_t... I>
+struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct MakeIndices<0, I...> {
+    typedef Indices<I...> type;
+};
+
+/**
+ * @brief Escaped copy of a name, built by the compiler
+ */
+template <typename Text, int Context,
+          typename = typename MakeIndices<escapedLength(Text::name(), Context)>::type>
+struct Escaped;
+
+template <typename Text, int Context, size_t... I>
+struct Escaped<Text, Context, Indices<I...>> {
+    static constexpr size_t length = sizeof...(I);
+    static constexpr char value[sizeof...(I) + 1] = {escapedChar(Text::name(), Context, I)..., '\0'};
+};
+
+template <typename Text, int Context, size_t... I>
+constexpr size_t Escaped<Text, Context, Indices<I...>>::length;
+
+template <typename Text, int Context, size_t... I>
+constexpr char Escaped<Text, Context, Indices<I...>>::value[sizeof...(I) + 1];
+
+} // namespace LightweightIoTSchema
+
+template <typename Name, typename... Fields>
+class LightweightIoT::Series {
+    static_assert(sizeof...(Fields) > 0, "A series needs at least one field");
+    static_assert(LightweightIoTSchema::isValidName(Name::name()),
+                  "Measurement names must be non-empty, printable and must not start with '_'");
+    static_assert(LightweightIoTSchema::all(LightweightIoTSchema::isValidName(Fields::name())...),
+                  "Field keys must be non-empty, printable and must not start with '_'");
+    static_assert(LightweightIoTSchema::all(!LightweightIoTSchema::equals(Fields::name(), "time")...),
+                  "'time' is reserved and cannot be used as a field key");
+    static_assert(LightweightIoTSchema::Distinct<Fields...>::value, "Field keys must be unique");
+    static_assert(LightweightIoTSchema::all(LightweightIoTSchema::IsFieldType<typename Fields::Type>::value...),
+                  "Field types must be float, double, int, long, bool or const char*");
+
+public:
+    static const size_t FIELD_COUNT = sizeof...(Fields);
+
+    /**
+     * @brief Encodes one point of the series with the client's tags
+     * @param timestamp Timestamp to append, 0 to omit it
+     * @return Encoded length, or 0 if the point does not fit or has no writable field
+     */
+    static size_t encode(LightweightIoT& iot, char* buffer, size_t capacity, uint64_t timestamp,
+                         typename Fields::Type... values) {
+        LineProtocol::Field fields[] = {LineProtocol::Field(Fields::name(), values)...};
+        return encodeFields(iot, buffer, capacity, timestamp, fields);
+    }
+
+    /**
+     * @brief Writes one point of the series, like LightweightIoT::writePoint()
+     */
+    static bool write(LightweightIoT& iot, typename Fields::Type... values) {
+        LineProtocol::Field fields[] = {LineProtocol::Field(Fields::name(), values)...};
+        if (iot.deadbandCount > 0 || iot.aggregationCount > 0) {
+            // Filtering and aggregation may leave out fields; take the general path
+            return iot.writeFields(Name::name(), fields, FIELD_COUNT, iot.currentTimestamp());
+        }
+        bool writable = false;
+        for (size_t i = 0; i < FIELD_COUNT && !writable; i++) {
+            writable = LineProtocol::isWritable(fields[i]);
+        }
+        if (!writable) {
+            iot.rejectPoint("Field value is NaN or infinite");
+            return false;
+        }
+        LightweightIoT::PointTarget target;
+        if (!iot.beginPoint(&target)) {
+            return false;
+        }
+        unsigned long startedAt = micros();
+        size_t length = encodeFields(iot, target.data, target.capacity, iot.currentTimestamp(), fields);
+        return iot.submitPoint(target, length, startedAt);
+    }
+
+private:
+    typedef LightweightIoTSchema::Escaped<Name, LineProtocol::ESCAPE_MEASUREMENT> MeasurementName;
+
+    static size_t encodeFields(LightweightIoT& iot, char* buffer, size_t capacity, uint64_t timestamp,
+                               LineProtocol::Field* fields) {
+        static const char* const keys[] = {LightweightIoTSchema::Escaped<Fields, LineProtocol::ESCAPE_KEY>::value...};
+        static const size_t keyLengths[] = {LightweightIoTSchema::Escaped<Fields, LineProtocol::ESCAPE_KEY>::length...};
+
+        if (!iot.refreshTagSet() || MeasurementName::length + iot.tagSetLength + 1 > capacity) {
+            return 0;
+        }
+        char* out = buffer;
+        memcpy(out, MeasurementName::value, MeasurementName::length);
+        out += MeasurementName::length;
+        memcpy(out, iot.tagSet, iot.tagSetLength);
+        out += iot.tagSetLength;
+
+        // Each value is formatted once; numbers go through a scratch buffer so
+        // the remaining capacity is checked before anything is copied
+        char scratch[LineProtocol::MAX_NUMBER_LENGTH];
+        char separator = ' ';
+        for (size_t i = 0; i < FIELD_COUNT; i++) {
+            LineProtocol::Field& field = fields[i];
+            if (!LineProtocol::isWritable(field)) {
+                continue;
+            }
+            if (field.type == LineProtocol::FIELD_FLOAT) {
+                field.precision = iot.precisionFor(field.key);
+            }
+            size_t valueLength;
+            if (field.type == LineProtocol::FIELD_STRING) {
+                valueLength = LineProtocol::valueLength(field);
+            } else {
+                valueLength = LineProtocol::writeValue(scratch, field) - scratch;
+            }
+            if ((size_t)(out - buffer) + keyLengths[i] + valueLength + 3 > capacity) {
+                return 0;
+            }
+            *out++ = separator;
+            separator = ',';
+            memcpy(out, keys[i], keyLengths[i]);
+            out += keyLengths[i];
+            *out++ = '=';
+            if (field.type == LineProtocol::FIELD_STRING) {
+                out = LineProtocol::writeValue(out, field);
+            } else {
+                memcpy(out, scratch, valueLength);
+                out += valueLength;
+            }
+        }
+        if (separator == ' ') {
+            return 0;
+        }
+
+        if (timestamp != 0) {
+            size_t length = LineProtocol::formatUInt(scratch, timestamp);
+            if ((size_t)(out - buffer) + length + 2 > capacity) {
+                return 0;
+            }
+            *out++ = ' ';
+            memcpy(out, scratch, length);
+            out += length;
+        }
+        *out = '\0';
+        return out - buffer;
+    }
+};
+
+template <typename Name, typename... Fields>
+const size_t LightweightIoT::Series<Name, Fields...>::FIELD_COUNT;
+
+#endif
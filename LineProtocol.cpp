@@ -0,0 +1,661 @@
+#include "LineProtocol.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(ARDUINO) && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define LWIOT_SIMD_ESCAPE 1
+#endif
+
+namespace {
+
+// Per-character escape flags, one bit per LineProtocol::EscapeContext
+const uint8_t ESCAPE_TABLE[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    3, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 0, 0, 0,   // ' ' '"' ','
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 0,   // '='
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0,   // '\\'
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+inline bool needsEscape(char c, uint8_t context) {
+    return (ESCAPE_TABLE[(uint8_t)c] & context) != 0;
+}
+
+#ifdef LWIOT_SIMD_ESCAPE
+// Returns a 16-bit mask of the bytes in a block that need escaping
+inline int specialMask(__m128i block, uint8_t context) {
+    __m128i hits;
+    if (context == LineProtocol::ESCAPE_STRING) {
+        hits = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+                            _mm_cmpeq_epi8(block, _mm_set1_epi8('\\')));
+    } else {
+        hits = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(',')),
+                            _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')));
+        if (context == LineProtocol::ESCAPE_KEY) {
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8('=')));
+        }
+    }
+    return _mm_movemask_epi8(hits);
+}
+#endif
+
+// Returns the index of the first character needing escape, or len if none
+inline size_t findEscape(const char* str, size_t len, uint8_t context) {
+    size_t i = 0;
+#ifdef LWIOT_SIMD_ESCAPE
+    for (; i + 16 <= len; i += 16) {
+        int mask = specialMask(_mm_loadu_si128((const __m128i*)(str + i)), context);
+        if (mask != 0) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (needsEscape(str[i], context)) {
+            return i;
+        }
+    }
+    return len;
+}
+
+// Two-digit groups for integer formatting
+const char DIGIT_PAIRS[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+const uint32_t POW10_32[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// Writes exactly eight digits, zero padded
+inline void writeDigits8(char* out, uint32_t value) {
+    for (int i = 6; i >= 0; i -= 2) {
+        memcpy(out + i, DIGIT_PAIRS + 2 * (value % 100), 2);
+        value /= 100;
+    }
+}
+
+size_t digitCount32(uint32_t value) {
+    size_t n = 1;
+    while (n < 10 && value >= POW10_32[n]) {
+        n++;
+    }
+    return n;
+}
+
+// Writes a value known to have `n` digits, right to left
+void writeDigits32(char* out, uint32_t value, size_t n) {
+    char* p = out + n;
+    while (value >= 100) {
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + 2 * (value % 100), 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        memcpy(p - 2, DIGIT_PAIRS + 2 * value, 2);
+    } else {
+        p[-1] = (char)('0' + value);
+    }
+}
+
+// Shortest round-trip float formatting: Grisu2 (Loitsch, "Printing
+// Floating-Point Numbers Quickly and Accurately with Integers", 2010) on
+// 64-bit significands. A float has only 24 significant bits, so the 64-bit
+// products leave ample margin and the result is the shortest in practice.
+struct DiyFp {
+    uint64_t f;
+    int e;
+};
+
+DiyFp multiply(const DiyFp& x, const DiyFp& y) {
+    // Upper 64 bits of the 128-bit product, rounded, from 32-bit halves
+    const uint64_t M32 = 0xffffffffULL;
+    uint64_t a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t mid = (bd >> 32) + (ad & M32) + (bc & M32) + (1ULL << 31);
+    DiyFp r = {ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64};
+    return r;
+}
+
+DiyFp normalize(DiyFp x) {
+    int shift = __builtin_clzll(x.f);
+    x.f <<= shift;
+    x.e -= shift;
+    return x;
+}
+
+// Normalized 10^k, k = -36..52 in steps of 8: the range a float needs
+struct CachedPower {
+    uint64_t f;
+    int16_t e;
+    int16_t k;
+};
+
+const CachedPower CACHED_POWERS[] = {
+    {0xaa242499697392d3ULL, -183, -36},
+    {0xfd87b5f28300ca0eULL, -157, -28},
+    {0xbce5086492111aebULL, -130, -20},
+    {0x8cbccc096f5088ccULL, -103, -12},
+    {0xd1b71758e219652cULL, -77, -4},
+    {0x9c40000000000000ULL, -50, 4},
+    {0xe8d4a51000000000ULL, -24, 12},
+    {0xad78ebc5ac620000ULL, 3, 20},
+    {0x813f3978f8940984ULL, 30, 28},
+    {0xc097ce7bc90715b3ULL, 56, 36},
+    {0x8f7e32ce7bea5c70ULL, 83, 44},
+    {0xd5d238a4abe98068ULL, 109, 52},
+};
+
+// Picks the power that scales a significand with exponent e into [2^-60, 2^-32)
+const CachedPower& cachedPower(int e) {
+    const size_t count = sizeof(CACHED_POWERS) / sizeof(CACHED_POWERS[0]);
+    size_t i = 0;
+    while (i + 1 < count && e + CACHED_POWERS[i].e + 64 < -60) {
+        i++;
+    }
+    return CACHED_POWERS[i];
+}
+
+void grisuRound(char* buffer, int length, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t distance) {
+    // Move the last digit towards the exact value while staying inside the interval
+    while (rest < distance && delta - rest >= tenKappa &&
+           (rest + tenKappa < distance || distance - rest > rest + tenKappa - distance)) {
+        buffer[length - 1]--;
+        rest += tenKappa;
+    }
+}
+
+int digitGen(const DiyFp& w, const DiyFp& upper, uint64_t delta, char* buffer, int* exponent) {
+    DiyFp one = {1ULL << -upper.e, upper.e};
+    uint64_t distance = upper.f - w.f;
+    uint32_t p1 = (uint32_t)(upper.f >> -one.e);
+    uint64_t p2 = upper.f & (one.f - 1);
+    int kappa = (int)digitCount32(p1);
+    int length = 0;
+
+    while (kappa > 0) {
+        uint32_t divisor = POW10_32[kappa - 1];
+        uint32_t digit = p1 / divisor;
+        p1 %= divisor;
+        if (digit != 0 || length != 0) {
+            buffer[length++] = (char)('0' + digit);
+        }
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *exponent += kappa;
+            grisuRound(buffer, length, delta, rest, (uint64_t)POW10_32[kappa] << -one.e, distance);
+            return length;
+        }
+    }
+
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        uint32_t digit = (uint32_t)(p2 >> -one.e);
+        if (digit != 0 || length != 0) {
+            buffer[length++] = (char)('0' + digit);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *exponent += kappa;
+            grisuRound(buffer, length, delta, p2, one.f, distance * POW10_32[-kappa]);
+            return length;
+        }
+    }
+}
+
+// Splits a positive finite float into significand and binary exponent
+void decompose(float value, uint32_t* significand, int* exponent, bool* lowerBoundaryCloser) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t biased = (bits >> 23) & 0xff;
+    uint32_t fraction = bits & 0x7fffff;
+    if (biased != 0) {
+        *significand = fraction | 0x800000;
+        *exponent = (int)biased - 150;
+    } else {
+        *significand = fraction;
+        *exponent = -149;
+    }
+    // At a power of two the next float down is half as far away
+    *lowerBoundaryCloser = fraction == 0 && biased > 1;
+}
+
+// Writes the shortest digits of a positive finite float; value = digits * 10^exponent
+int shortestDigits(float value, char* buffer, int* exponent) {
+    uint32_t significand;
+    int e;
+    bool lowerCloser;
+    decompose(value, &significand, &e, &lowerCloser);
+
+    DiyFp v = {significand, e};
+    DiyFp upper = normalize(DiyFp{((uint64_t)significand << 1) + 1, e - 1});
+    DiyFp lower = lowerCloser ? DiyFp{((uint64_t)significand << 2) - 1, e - 2}
+                              : DiyFp{((uint64_t)significand << 1) - 1, e - 1};
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    const CachedPower& power = cachedPower(upper.e);
+    DiyFp c = {power.f, power.e};
+    DiyFp w = multiply(normalize(v), c);
+    DiyFp wUpper = multiply(upper, c);
+    DiyFp wLower = multiply(lower, c);
+    wLower.f++;
+    wUpper.f--;
+
+    *exponent = -power.k;
+    return digitGen(w, wUpper, wUpper.f - wLower.f, buffer, exponent);
+}
+
+// Lays out significant digits with the decimal point, or in exponent notation
+size_t writeDecimal(char* out, const char* digits, int length, int exponent) {
+    char* p = out;
+    int point = length + exponent;  // Position of the decimal point relative to the digits
+
+    if (exponent >= 0 && point <= 21) {
+        memcpy(p, digits, length);
+        p += length;
+        memset(p, '0', exponent);
+        p += exponent;
+    } else if (point > 0 && point <= 21) {
+        memcpy(p, digits, point);
+        p += point;
+        *p++ = '.';
+        memcpy(p, digits + point, length - point);
+        p += length - point;
+    } else if (point > -6 && point <= 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -point);
+        p += -point;
+        memcpy(p, digits, length);
+        p += length;
+    } else {
+        *p++ = digits[0];
+        if (length > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, length - 1);
+            p += length - 1;
+        }
+        *p++ = 'e';
+        int scale = point - 1;
+        if (scale < 0) {
+            *p++ = '-';
+            scale = -scale;
+        }
+        size_t n = digitCount32((uint32_t)scale);
+        writeDigits32(p, (uint32_t)scale, n);
+        p += n;
+    }
+    return p - out;
+}
+
+// Rounds |value| * 10^decimals to an integer; false if it does not fit in 63 bits
+bool scaleFixed(float value, int decimals, uint64_t* scaled) {
+    uint32_t significand;
+    int e;
+    bool lowerCloser;
+    decompose(value, &significand, &e, &lowerCloser);
+
+    uint64_t pow10 = POW10_32[decimals];
+    if (e >= 0) {
+        if (e > 39 || ((uint64_t)significand << e) > (0x7fffffffffffffffULL / pow10)) {
+            return false;
+        }
+        *scaled = ((uint64_t)significand << e) * pow10;
+        return true;
+    }
+
+    // significand * 10^decimals < 2^54, so the product is exact before the shift
+    uint64_t product = significand * pow10;
+    int shift = -e;
+    if (shift >= 64) {
+        *scaled = 0;
+    } else {
+        *scaled = (product >> shift) + ((product >> (shift - 1)) & 1);
+    }
+    return true;
+}
+
+} // namespace
+
+size_t LineProtocol::escapedLength(const char* str, size_t len, EscapeContext context) {
+    size_t i = findEscape(str, len, context);
+    if (i == len) {
+        return len;
+    }
+
+    size_t escaped = len;
+#ifdef LWIOT_SIMD_ESCAPE
+    for (; i + 16 <= len; i += 16) {
+        escaped += __builtin_popcount(specialMask(_mm_loadu_si128((const __m128i*)(str + i)), context));
+    }
+#endif
+    for (; i < len; i++) {
+        escaped += needsEscape(str[i], context) ? 1 : 0;
+    }
+    return escaped;
+}
+
+char* LineProtocol::escape(char* out, const char* str, size_t len, EscapeContext context) {
+    size_t i = findEscape(str, len, context);
+    memcpy(out, str, i);
+    out += i;
+
+    for (; i < len; i++) {
+        char c = str[i];
+        if (needsEscape(c, context)) {
+            *out++ = '\\';
+        }
+        *out++ = c;
+    }
+    return out;
+}
+
+size_t LineProtocol::formatUInt(char* out, uint64_t value) {
+    if (value <= 0xffffffffULL) {
+        size_t n = digitCount32((uint32_t)value);
+        writeDigits32(out, (uint32_t)value, n);
+        return n;
+    }
+
+    // Split off eight digits at a time so the rest runs on 32-bit arithmetic
+    uint32_t low = (uint32_t)(value % 100000000);
+    uint64_t high = value / 100000000;
+    size_t n;
+    if (high <= 0xffffffffULL) {
+        n = digitCount32((uint32_t)high);
+        writeDigits32(out, (uint32_t)high, n);
+    } else {
+        uint32_t middle = (uint32_t)(high % 100000000);
+        uint32_t top = (uint32_t)(high / 100000000);
+        n = digitCount32(top);
+        writeDigits32(out, top, n);
+        writeDigits8(out + n, middle);
+        n += 8;
+    }
+    writeDigits8(out + n, low);
+    return n + 8;
+}
+
+size_t LineProtocol::formatInt(char* out, long value) {
+    if (value < 0) {
+        *out = '-';
+        // Negate in unsigned space so LONG_MIN does not overflow
+        return 1 + formatUInt(out + 1, 0 - (uint64_t)(int64_t)value);
+    }
+    return formatUInt(out, (uint64_t)value);
+}
+
+bool LineProtocol::isFinite(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x7f800000) != 0x7f800000;
+}
+
+size_t LineProtocol::formatFloat(char* out, float value, int8_t precision) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bool negative = (bits & 0x80000000) != 0;
+    bits &= 0x7fffffff;
+    memcpy(&value, &bits, sizeof(bits));
+
+    if (bits == 0) {
+        *out = '0';
+        return 1;
+    }
+
+    if (precision >= 0) {
+        int decimals = precision > MAX_PRECISION ? MAX_PRECISION : precision;
+        uint64_t scaled;
+        if (scaleFixed(value, decimals, &scaled)) {
+            if (scaled == 0) {
+                *out = '0';
+                return 1;
+            }
+            uint32_t pow10 = POW10_32[decimals];
+            uint64_t whole = scaled / pow10;
+            uint32_t fraction = (uint32_t)(scaled - whole * pow10);
+            while (decimals > 0 && fraction % 10 == 0) {
+                fraction /= 10;
+                decimals--;
+            }
+
+            char* p = out;
+            if (negative) {
+                *p++ = '-';
+            }
+            p += formatUInt(p, whole);
+            if (decimals > 0) {
+                *p++ = '.';
+                // Leading zeros of the fraction; n never exceeds decimals
+                size_t n = digitCount32(fraction);
+                for (size_t i = n; i < (size_t)decimals; i++) {
+                    p[i - n] = '0';
+                }
+                writeDigits32(p + decimals - n, fraction, n);
+                p += decimals;
+            }
+            return p - out;
+        }
+    }
+
+    char digits[12];
+    int exponent;
+    int length = shortestDigits(value, digits, &exponent);
+    char* p = out;
+    if (negative) {
+        *p++ = '-';
+    }
+    return (p - out) + writeDecimal(p, digits, length, exponent);
+}
+
+size_t LineProtocol::tagSetLength(const Tag* tags, size_t tagCount) {
+    size_t len = 0;
+    for (size_t i = 0; i < tagCount; i++) {
+        len += 2 + escapedLength(tags[i].key, strlen(tags[i].key), ESCAPE_KEY) +
+               escapedLength(tags[i].value, strlen(tags[i].value), ESCAPE_KEY);
+    }
+    return len;
+}
+
+size_t LineProtocol::renderTagSet(char* buffer, size_t capacity, const Tag* tags, size_t tagCount) {
+    size_t len = tagSetLength(tags, tagCount);
+    if (buffer == nullptr || len + 1 > capacity) {
+        return 0;
+    }
+
+    // Selection order by (key, index) keeps this allocation-free; tag sets are small
+    char* out = buffer;
+    const Tag* previous = nullptr;
+    for (size_t n = 0; n < tagCount; n++) {
+        const Tag* next = nullptr;
+        for (size_t i = 0; i < tagCount; i++) {
+            const Tag* candidate = &tags[i];
+            if (previous != nullptr) {
+                int order = strcmp(candidate->key, previous->key);
+                if (order < 0 || (order == 0 && candidate <= previous)) {
+                    continue;
+                }
+            }
+            if (next == nullptr || strcmp(candidate->key, next->key) < 0) {
+                next = candidate;
+            }
+        }
+
+        *out++ = ',';
+        out = escape(out, next->key, strlen(next->key), ESCAPE_KEY);
+        *out++ = '=';
+        out = escape(out, next->value, strlen(next->value), ESCAPE_KEY);
+        previous = next;
+    }
+
+    *out = '\0';
+    return len;
+}
+
+size_t LineProtocol::valueLength(const Field& field) {
+    char scratch[MAX_NUMBER_LENGTH];
+    switch (field.type) {
+        case FIELD_FLOAT:
+            return formatFloat(scratch, field.f, field.precision);
+        case FIELD_INT:
+            return formatInt(scratch, field.i) + 1;
+        case FIELD_BOOL:
+            return field.b ? 4 : 5;
+        case FIELD_STRING:
+            return escapedLength(field.s, strlen(field.s), ESCAPE_STRING) + 2;
+    }
+    return 0;
+}
+
+char* LineProtocol::writeValue(char* out, const Field& field) {
+    switch (field.type) {
+        case FIELD_FLOAT:
+            return out + formatFloat(out, field.f, field.precision);
+        case FIELD_INT:
+            out += formatInt(out, field.i);
+            *out++ = 'i';
+            return out;
+        case FIELD_BOOL:
+            if (field.b) {
+                memcpy(out, "true", 4);
+                return out + 4;
+            }
+            memcpy(out, "false", 5);
+            return out + 5;
+        case FIELD_STRING:
+            *out++ = '"';
+            out = escape(out, field.s, strlen(field.s), ESCAPE_STRING);
+            *out++ = '"';
+            return out;
+    }
+    return out;
+}
+
+size_t LineProtocol::encodedLength(const char* measurement, size_t tagSetLength,
+                                   const Field* fields, size_t fieldCount,
+                                   uint64_t timestamp) {
+    size_t len = escapedLength(measurement, strlen(measurement), ESCAPE_MEASUREMENT) + tagSetLength;
+
+    for (size_t i = 0; i < fieldCount; i++) {
+        if (!isWritable(fields[i])) {
+            continue;
+        }
+        len += 2 + escapedLength(fields[i].key, strlen(fields[i].key), ESCAPE_KEY) +
+               valueLength(fields[i]);
+    }
+
+    if (timestamp != 0) {
+        char scratch[MAX_NUMBER_LENGTH];
+        len += 1 + formatUInt(scratch, timestamp);
+    }
+    return len;
+}
+
+size_t LineProtocol::encode(char* buffer, size_t capacity,
+                            const char* measurement,
+                            const char* tagSet, size_t tagSetLength,
+                            const Field* fields, size_t fieldCount,
+                            uint64_t timestamp) {
+    size_t writable = 0;
+    for (size_t i = 0; i < fieldCount; i++) {
+        writable += isWritable(fields[i]) ? 1 : 0;
+    }
+    if (writable == 0) {
+        return 0;
+    }
+
+    size_t len = encodedLength(measurement, tagSetLength, fields, fieldCount, timestamp);
+    if (buffer == nullptr || len + 1 > capacity) {
+        return 0;
+    }
+
+    char* out = escape(buffer, measurement, strlen(measurement), ESCAPE_MEASUREMENT);
+    memcpy(out, tagSet, tagSetLength);
+    out += tagSetLength;
+
+    char separator = ' ';
+    for (size_t i = 0; i < fieldCount; i++) {
+        if (!isWritable(fields[i])) {
+            continue;
+        }
+        *out++ = separator;
+        separator = ',';
+        out = escape(out, fields[i].key, strlen(fields[i].key), ESCAPE_KEY);
+        *out++ = '=';
+        out = writeValue(out, fields[i]);
+    }
+
+    if (timestamp != 0) {
+        *out++ = ' ';
+        out += formatUInt(out, timestamp);
+    }
+
+    *out = '\0';
+    return len;
+}
+
+size_t LineProtocol::encodeEscaped(char* buffer, size_t capacity,
+                                   const char* measurement, size_t measurementLength,
+                                   const char* tagSet, size_t tagSetLength,
+                                   const char* key, size_t keyLength, const Field& field,
+                                   uint64_t timestamp) {
+    if (!isWritable(field)) {
+        return 0;
+    }
+    // Numbers go through scratch buffers so the length is known before anything is written
+    char value[MAX_NUMBER_LENGTH];
+    size_t valueLength;
+    if (field.type == FIELD_STRING) {
+        valueLength = LineProtocol::valueLength(field);
+    } else {
+        valueLength = writeValue(value, field) - value;
+    }
+    char time[MAX_NUMBER_LENGTH];
+    size_t timeLength = timestamp != 0 ? formatUInt(time, timestamp) : 0;
+
+    size_t len = measurementLength + tagSetLength + 2 + keyLength + valueLength + (timestamp != 0 ? timeLength + 1 : 0);
+    if (buffer == nullptr || len + 1 > capacity) {
+        return 0;
+    }
+
+    char* out = buffer;
+    memcpy(out, measurement, measurementLength);
+    out += measurementLength;
+    memcpy(out, tagSet, tagSetLength);
+    out += tagSetLength;
+    *out++ = ' ';
+    memcpy(out, key, keyLength);
+    out += keyLength;
+    *out++ = '=';
+    if (field.type == FIELD_STRING) {
+        out = writeValue(out, field);
+    } else {
+        memcpy(out, value, valueLength);
+        out += valueLength;
+    }
+    if (timestamp != 0) {
+        *out++ = ' ';
+        memcpy(out, time, timeLength);
+        out += timeLength;
+    }
+    *out = '\0';
+    return len;
+}
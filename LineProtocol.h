@@ -0,0 +1,195 @@
+#ifndef LIGHTWEIGHT_IOT_LINE_PROTOCOL_H
+#define LIGHTWEIGHT_IOT_LINE_PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Allocation-free InfluxDB line protocol encoder
+ *
+ * Points are written straight into a caller-supplied buffer. The encoded
+ * length is computed first, checked once against the buffer capacity and
+ * then written without further bounds checks, so a point either fits
+ * completely or the buffer is left untouched.
+ */
+class LineProtocol {
+public:
+    /**
+     * @brief Field value types supported by the encoder
+     */
+    enum FieldType {
+        FIELD_FLOAT,   ///< Floating point value
+        FIELD_INT,     ///< Signed integer value (suffixed with 'i')
+        FIELD_BOOL,    ///< Boolean value
+        FIELD_STRING   ///< String value (quoted)
+    };
+
+    /**
+     * @brief Tag key/value pair
+     */
+    struct Tag {
+        const char* key;    ///< Tag key
+        const char* value;  ///< Tag value
+    };
+
+    static const int8_t PRECISION_SHORTEST = -1; ///< Shortest form that reads back as the same float
+    static const int8_t MAX_PRECISION = 9;       ///< Most decimals a float field can be written with
+
+    /**
+     * @brief Typed field key/value pair
+     */
+    struct Field {
+        const char* key;    ///< Field key
+        FieldType type;     ///< Value type
+        int8_t precision;   ///< Decimals for float values, or PRECISION_SHORTEST
+        union {
+            float f;
+            long i;
+            bool b;
+            const char* s;
+        };
+
+        Field() : key(nullptr), type(FIELD_INT), precision(PRECISION_SHORTEST), i(0) {}
+        Field(const char* k, float v, int8_t p = PRECISION_SHORTEST)
+            : key(k), type(FIELD_FLOAT), precision(p), f(v) {}
+        Field(const char* k, double v, int8_t p = PRECISION_SHORTEST)
+            : key(k), type(FIELD_FLOAT), precision(p), f((float)v) {}
+        Field(const char* k, int v) : key(k), type(FIELD_INT), precision(PRECISION_SHORTEST), i(v) {}
+        Field(const char* k, long v) : key(k), type(FIELD_INT), precision(PRECISION_SHORTEST), i(v) {}
+        Field(const char* k, bool v) : key(k), type(FIELD_BOOL), precision(PRECISION_SHORTEST), b(v) {}
+        Field(const char* k, const char* v) : key(k), type(FIELD_STRING), precision(PRECISION_SHORTEST), s(v) {}
+    };
+
+    /**
+     * @brief Computes the length of a rendered tag set
+     * @return Length in bytes, excluding the terminating NUL
+     */
+    static size_t tagSetLength(const Tag* tags, size_t tagCount);
+
+    /**
+     * @brief Renders a tag set as ",k1=v1,k2=v2", escaped and sorted by key
+     *
+     * Sorted keys give InfluxDB its canonical series key. The result is
+     * meant to be rendered once and reused for every point with these tags.
+     *
+     * @return Rendered length, or 0 if the tag set does not fit
+     */
+    static size_t renderTagSet(char* buffer, size_t capacity, const Tag* tags, size_t tagCount);
+
+    /**
+     * @brief Computes the exact encoded length of a point
+     *
+     * Float fields that are NaN or infinite have no line protocol form and
+     * are left out, here and in encode().
+     *
+     * @param tagSetLength Length of the tag set rendered by renderTagSet()
+     * @param timestamp Timestamp to append, 0 to omit it
+     * @return Encoded length in bytes, excluding the terminating NUL
+     */
+    static size_t encodedLength(const char* measurement, size_t tagSetLength,
+                                const Field* fields, size_t fieldCount,
+                                uint64_t timestamp);
+
+    /**
+     * @brief Encodes a point into a caller-supplied buffer
+     *
+     * The output is NUL-terminated, so the buffer must hold the encoded
+     * length plus one byte.
+     *
+     * @param buffer Destination buffer
+     * @param capacity Size of the destination buffer in bytes
+     * @param tagSet Tag set rendered by renderTagSet(), copied verbatim
+     * @param timestamp Timestamp to append, 0 to omit it
+     * @return Exact encoded length, or 0 if the point does not fit or has no writable field
+     */
+    static size_t encode(char* buffer, size_t capacity,
+                         const char* measurement,
+                         const char* tagSet, size_t tagSetLength,
+                         const Field* fields, size_t fieldCount,
+                         uint64_t timestamp);
+
+    /**
+     * @brief Encodes a one-field point whose names are already escaped
+     *
+     * For names escaped once and reused, such as interned ones: the
+     * measurement and field key are copied verbatim. A string value is
+     * escaped as usual.
+     *
+     * @return Exact encoded length, or 0 if the point does not fit or the field is not writable
+     */
+    static size_t encodeEscaped(char* buffer, size_t capacity,
+                                const char* measurement, size_t measurementLength,
+                                const char* tagSet, size_t tagSetLength,
+                                const char* key, size_t keyLength, const Field& field,
+                                uint64_t timestamp);
+
+    /**
+     * @brief Returns the encoded length of a field value, including quotes and the 'i' suffix
+     */
+    static size_t valueLength(const Field& field);
+
+    /**
+     * @brief Writes a field value as it appears after the '=' of a field
+     * @return Pointer past the last byte written
+     */
+    static char* writeValue(char* out, const Field& field);
+
+    /**
+     * @brief Escaping rules, one per line protocol element
+     */
+    enum EscapeContext {
+        ESCAPE_MEASUREMENT = 0x01, ///< Measurement names: comma and space
+        ESCAPE_KEY = 0x02,         ///< Tag keys, tag values and field keys: comma, equals and space
+        ESCAPE_STRING = 0x04       ///< String field values: double quote and backslash
+    };
+
+    /**
+     * @brief Returns the escaped length of a string in the given context
+     */
+    static size_t escapedLength(const char* str, size_t len, EscapeContext context);
+
+    /**
+     * @brief Copies a string into the output, escaping it for the given context
+     *
+     * Strings without special characters are copied with a single memcpy.
+     *
+     * @return Pointer past the last byte written
+     */
+    static char* escape(char* out, const char* str, size_t len, EscapeContext context);
+
+    /**
+     * @brief Formats an integer in decimal, two digits at a time
+     * @return Number of characters written (no NUL)
+     */
+    static size_t formatInt(char* out, long value);
+    static size_t formatUInt(char* out, uint64_t value);
+
+    /**
+     * @brief Formats a finite float without any floating point arithmetic
+     *
+     * With PRECISION_SHORTEST the value is written with the fewest digits
+     * that read back as exactly the same float (Grisu2). Otherwise it is
+     * rounded to at most `precision` decimals and trailing zeros are dropped;
+     * values too large to scale that way fall back to the shortest form.
+     * Very large and very small magnitudes use exponent notation.
+     *
+     * @return Number of characters written (no NUL)
+     */
+    static size_t formatFloat(char* out, float value, int8_t precision = PRECISION_SHORTEST);
+
+    /**
+     * @brief Checks whether a float can be written, i.e. is neither NaN nor infinite
+     */
+    static bool isFinite(float value);
+
+    /**
+     * @brief Checks whether a field has a line protocol representation
+     */
+    static bool isWritable(const Field& field) {
+        return field.type != FIELD_FLOAT || isFinite(field.f);
+    }
+
+    static const size_t MAX_NUMBER_LENGTH = 48; ///< Longest formatted number
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "PointQueue.h"
+
+#if defined(ESP32) || !defined(ARDUINO)
+
+#include <new>
+
+PointQueue::PointQueue() : ring(nullptr), storage(nullptr), owned(false), mask(0), size(0), enqueuePos(0), dequeuePos(0) {}
+
+PointQueue::~PointQueue() {
+    release();
+}
+
+size_t PointQueue::slotCount(size_t slots) {
+    size_t count = 1;
+    while (count < slots) {
+        count *= 2;
+    }
+    return count;
+}
+
+size_t PointQueue::storageSize(size_t slots, size_t slotSize) {
+    // Slots first, so the caller's alignment carries over to them
+    size_t count = slotCount(slots);
+    return count * sizeof(Slot) + count * slotSize;
+}
+
+bool PointQueue::allocate(size_t slots, size_t slotSize, void* region) {
+    release();
+    size_t count = slotCount(slots);
+    owned = region == nullptr;
+    if (owned) {
+        ring = new (std::nothrow) Slot[count];
+        storage = new (std::nothrow) char[count * slotSize];
+    } else {
+        ring = (Slot*)region;
+        for (size_t i = 0; i < count; i++) {
+            new (&ring[i]) Slot();
+        }
+        storage = (char*)region + count * sizeof(Slot);
+    }
+    if (ring == nullptr || storage == nullptr) {
+        release();
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        ring[i].sequence.store(i, std::memory_order_relaxed);
+        ring[i].length = 0;
+        ring[i].encodeMicros = 0;
+    }
+    mask = count - 1;
+    size = slotSize;
+    enqueuePos.store(0, std::memory_order_relaxed);
+    dequeuePos = 0;
+    return true;
+}
+
+void PointQueue::release() {
+    // Slots are trivially destructible, so a passed-in ring needs no teardown
+    if (owned) {
+        delete[] ring;
+        delete[] storage;
+    }
+    ring = nullptr;
+    storage = nullptr;
+    owned = false;
+    mask = 0;
+    size = 0;
+}
+
+char* PointQueue::claim(size_t* ticket) {
+    if (ring == nullptr) {
+        return nullptr;
+    }
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = ring[pos & mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        long difference = (long)(sequence - pos);
+        if (difference == 0) {
+            // Free for this ticket; take it unless another producer was faster
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            // Still holds a point from the previous lap
+            return nullptr;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    *ticket = pos;
+    return storage + (pos & mask) * size;
+}
+
+void PointQueue::publish(size_t ticket, size_t length, uint32_t encodeMicros) {
+    Slot& slot = ring[ticket & mask];
+    slot.length = length;
+    slot.encodeMicros = encodeMicros;
+    slot.sequence.store(ticket + 1, std::memory_order_release);
+}
+
+long PointQueue::front(const char** data, uint32_t* encodeMicros) const {
+    if (ring == nullptr) {
+        return -1;
+    }
+    const Slot& slot = ring[dequeuePos & mask];
+    if (slot.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+        return -1;
+    }
+    *data = storage + (dequeuePos & mask) * size;
+    *encodeMicros = slot.encodeMicros;
+    return (long)slot.length;
+}
+
+void PointQueue::pop() {
+    // Free for the ticket one lap ahead
+    ring[dequeuePos & mask].sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+    dequeuePos++;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef LIGHTWEIGHT_IOT_POINT_QUEUE_H
+#define LIGHTWEIGHT_IOT_POINT_QUEUE_H
+
+// Needs std::atomic, available wherever LightweightIoT runs a sender thread
+#if defined(ESP32) || !defined(ARDUINO)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/**
+ * @brief Bounded lock-free multi-producer, single-consumer queue of encoded points
+ *
+ * A ring of fixed-size slots, each with a sequence number (Vyukov's bounded
+ * queue). A producer claims the next free slot with one compare-and-swap,
+ * encodes its point straight into the slot and publishes it; producers never
+ * wait for each other or for the consumer, and claim() fails instead of
+ * blocking when the ring is full. The single consumer takes points in claim
+ * order. A slot that is claimed but not yet published holds back the
+ * consumer, not the other producers.
+ */
+class PointQueue {
+public:
+    PointQueue();
+    ~PointQueue();
+
+    PointQueue(const PointQueue&) = delete;
+    PointQueue& operator=(const PointQueue&) = delete;
+
+    /**
+     * @brief Allocates the ring, discarding any queued points
+     * @param slots Number of points, rounded up to a power of two
+     * @param slotSize Maximum encoded size of one point (bytes)
+     * @param region Caller-owned region of storageSize() bytes to use instead of the heap
+     * @return true if the ring was allocated
+     */
+    bool allocate(size_t slots, size_t slotSize, void* region = nullptr);
+
+    /**
+     * @brief Returns the bytes allocate() needs for a ring, suitably aligned
+     */
+    static size_t storageSize(size_t slots, size_t slotSize);
+
+    /**
+     * @brief Frees the ring
+     */
+    void release();
+
+    /**
+     * @brief Claims a slot for one point (any thread)
+     * @param ticket Set to the claim, to be passed to publish()
+     * @return Storage of slotSize() bytes, nullptr if the queue is full
+     */
+    char* claim(size_t* ticket);
+
+    /**
+     * @brief Hands a claimed slot to the consumer (the claiming thread)
+     * @param ticket Claim returned by claim()
+     * @param length Encoded length; 0 abandons the slot
+     * @param encodeMicros Time spent encoding, for the statistics
+     */
+    void publish(size_t ticket, size_t length, uint32_t encodeMicros);
+
+    /**
+     * @brief Returns the oldest published point (consumer only)
+     * @param data Set to the point
+     * @param encodeMicros Set to the time it took to encode
+     * @return Length of the point, 0 for an abandoned slot
+     * @retval -1 The oldest slot is free or not yet published
+     */
+    long front(const char** data, uint32_t* encodeMicros) const;
+
+    /**
+     * @brief Releases the slot returned by front() to the producers (consumer only)
+     */
+    void pop();
+
+    size_t slots() const { return mask + 1; }
+    size_t slotSize() const { return size; }
+    bool allocated() const { return storage != nullptr; }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;  ///< Ticket the slot is free for, ticket + 1 once published
+        size_t length;
+        uint32_t encodeMicros;
+    };
+
+    Slot* ring;
+    char* storage;
+    bool owned;  ///< ring and storage were allocated by allocate() rather than passed in
+    size_t mask;
+    size_t size;
+    std::atomic<size_t> enqueuePos;
+    size_t dequeuePos;
+
+    static size_t slotCount(size_t slots);
+};
+
+#endif
+
+#endif
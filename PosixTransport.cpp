@@ -0,0 +1,544 @@
+#ifndef ARDUINO
+
+#include "PosixTransport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+    #include <sys/epoll.h>
+#else
+    #include <poll.h>
+#endif
+
+namespace {
+
+// Status of a reused connection the server closed before answering
+const int NO_ANSWER = -1000;
+
+uint64_t nowMillis() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Case-insensitive match of a header name at the start of a line
+bool isHeader(const char* line, size_t length, const char* name, const char** value) {
+    size_t nameLength = strlen(name);
+    if (length <= nameLength || line[nameLength] != ':' || strncasecmp(line, name, nameLength) != 0) {
+        return false;
+    }
+    const char* p = line + nameLength + 1;
+    while (p < line + length && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    *value = p;
+    return true;
+}
+
+} // namespace
+
+PosixTransport::PosixTransport()
+    : fd(-1), pollFd(-1), port(0), addressLength(0), bufferStart(0), bufferEnd(0), lastRequestAt(0) {
+    memset(&address, 0, sizeof(address));
+#ifdef __linux__
+    pollFd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+}
+
+bool PosixTransport::ready() const {
+#ifdef __linux__
+    return pollFd >= 0;
+#else
+    return true;
+#endif
+}
+
+PosixTransport::~PosixTransport() {
+    close();
+    if (pollFd >= 0) {
+        ::close(pollFd);
+    }
+}
+
+void PosixTransport::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool PosixTransport::parseUrl(const char* newUrl) {
+    if (url == newUrl) {
+        return true;
+    }
+    close();
+    url.clear();
+    addressLength = 0;
+
+    if (strncmp(newUrl, "http://", 7) != 0) {
+        return false;
+    }
+    const char* authority = newUrl + 7;
+    const char* slash = strchr(authority, '/');
+    const char* authorityEnd = slash != nullptr ? slash : authority + strlen(authority);
+    target = slash != nullptr ? slash : "/";
+
+    // host, host:port, [v6], [v6]:port
+    const char* nameEnd = authorityEnd;
+    const char* portStart = nullptr;
+    if (*authority == '[') {
+        const char* bracket = (const char*)memchr(authority, ']', authorityEnd - authority);
+        if (bracket == nullptr) {
+            return false;
+        }
+        hostName.assign(authority + 1, bracket - authority - 1);
+        portStart = bracket + 1 < authorityEnd && bracket[1] == ':' ? bracket + 2 : nullptr;
+    } else {
+        const char* colon = (const char*)memchr(authority, ':', authorityEnd - authority);
+        if (colon != nullptr) {
+            nameEnd = colon;
+            portStart = colon + 1;
+        }
+        hostName.assign(authority, nameEnd - authority);
+    }
+    port = 80;
+    if (portStart != nullptr) {
+        char* end;
+        unsigned long value = strtoul(portStart, &end, 10);
+        if (end != authorityEnd || value == 0 || value > 65535) {
+            return false;
+        }
+        port = (uint16_t)value;
+    }
+    if (hostName.empty()) {
+        return false;
+    }
+    host.assign(authority, authorityEnd - authority);
+    url = newUrl;
+    return true;
+}
+
+bool PosixTransport::wait(bool writable, uint64_t deadline) {
+    for (;;) {
+        uint64_t now = nowMillis();
+        if (now >= deadline) {
+            return false;
+        }
+        int timeout = (int)(deadline - now);
+#ifdef __linux__
+        // The socket is registered edge-triggered for both directions, so a
+        // stale edge for the other direction may wake us once; just wait again
+        epoll_event event;
+        int n = epoll_wait(pollFd, &event, 1, timeout);
+        if (n > 0 && (event.events & ((writable ? EPOLLOUT : EPOLLIN) | EPOLLERR | EPOLLHUP)) != 0) {
+            return true;
+        }
+#else
+        pollfd entry = {fd, (short)(writable ? POLLOUT : POLLIN), 0};
+        int n = poll(&entry, 1, timeout);
+        if (n > 0) {
+            return true;
+        }
+#endif
+        if (n < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool PosixTransport::connectTo(uint64_t deadline) {
+    if (addressLength == 0) {
+        char service[8];
+        snprintf(service, sizeof(service), "%u", (unsigned)port);
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(hostName.c_str(), service, &hints, &result) != 0 || result == nullptr) {
+            return false;
+        }
+        memcpy(&address, result->ai_addr, result->ai_addrlen);
+        addressLength = result->ai_addrlen;
+        freeaddrinfo(result);
+    }
+
+    fd = socket(address.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int one = 1;
+    // Each request goes out in one write; do not hold back its last segment
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+#ifdef __linux__
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    event.data.fd = fd;
+    if (epoll_ctl(pollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        close();
+        return false;
+    }
+#endif
+
+    if (::connect(fd, (const sockaddr*)&address, addressLength) != 0) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (errno != EINPROGRESS || !wait(true, deadline) ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            close();
+            // The address may have changed; resolve it again next time
+            addressLength = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PosixTransport::peerClosed() {
+    char probe;
+    ssize_t n = recv(fd, &probe, 1, MSG_PEEK);
+    return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+}
+
+bool PosixTransport::writeAll(iovec* iov, size_t count, uint64_t deadline) {
+    while (count > 0) {
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+#ifdef MSG_NOSIGNAL
+        ssize_t n = sendmsg(fd, &message, MSG_NOSIGNAL);
+#else
+        ssize_t n = sendmsg(fd, &message, 0);
+#endif
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait(true, deadline)) {
+                continue;
+            }
+            return false;
+        }
+
+        // Drop what was written from the front of the vector
+        size_t done = 0;
+        while (done < count && (size_t)n >= iov[done].iov_len) {
+            n -= iov[done].iov_len;
+            done++;
+        }
+        if (done < count) {
+            iov[done].iov_base = (char*)iov[done].iov_base + n;
+            iov[done].iov_len -= n;
+        }
+        iov += done;
+        count -= done;
+    }
+    return true;
+}
+
+bool PosixTransport::writeRequest(const Request& request, uint64_t deadline) {
+    size_t length = request.sourceLength;
+    for (size_t i = 0; request.source == nullptr && i < request.bodyCount; i++) {
+        length += request.body[i].length;
+    }
+    bool chunked = request.source != nullptr && request.sourceLength == 0;
+
+    // The head's storage is kept between requests
+    char number[24];
+    head.assign(request.method).append(" ").append(target).append(" HTTP/1.1\r\nHost: ").append(host);
+    head.append("\r\nAuthorization: Token ").append(request.token != nullptr ? request.token : "");
+    head.append("\r\nContent-Type: text/plain; charset=utf-8");
+    if (request.contentEncoding != nullptr) {
+        head.append("\r\nContent-Encoding: ").append(request.contentEncoding);
+    }
+    if (chunked) {
+        head.append("\r\nTransfer-Encoding: chunked");
+    } else {
+        snprintf(number, sizeof(number), "%zu", length);
+        head.append("\r\nContent-Length: ").append(number);
+    }
+    head.append(request.keepAlive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+
+    // Head and body slices in one scatter-gather write, several if there are many slices
+    static const size_t MAX_IOV = 16;
+    iovec iov[MAX_IOV];
+    size_t next = 0;       // next body slice to queue
+    size_t count = 0;
+    iov[count].iov_base = (void*)head.data();
+    iov[count].iov_len = head.size();
+    count++;
+    do {
+        while (count < MAX_IOV && request.source == nullptr && next < request.bodyCount) {
+            if (request.body[next].length > 0) {
+                iov[count].iov_base = (void*)request.body[next].data;
+                iov[count].iov_len = request.body[next].length;
+                count++;
+            }
+            next++;
+        }
+        if (!writeAll(iov, count, deadline)) {
+            return false;
+        }
+        count = 0;
+    } while (request.source == nullptr && next < request.bodyCount);
+    if (request.source == nullptr) {
+        return true;
+    }
+
+    // A source is read into the response buffer, which is free until the answer comes
+    if (!request.source->rewind()) {
+        return false;
+    }
+    size_t sent = 0;
+    for (;;) {
+        long n = request.source->read(buffer, sizeof(buffer));
+        if (n < 0 || (!chunked && sent + n > length)) {
+            return false;
+        }
+        sent += n;
+        if (!chunked) {
+            iovec data = {buffer, (size_t)n};
+            if (n == 0) {
+                // A body shorter than announced would leave the server waiting
+                return sent == length;
+            }
+            if (!writeAll(&data, 1, deadline)) {
+                return false;
+            }
+            continue;
+        }
+        // Chunk size line, data and CRLF; an empty chunk ends the body
+        int sizeLength = snprintf(number, sizeof(number), n > 0 ? "%lx\r\n" : "0\r\n\r\n", n);
+        iovec chunk[3] = {{number, (size_t)sizeLength}, {buffer, (size_t)n}, {(void*)"\r\n", 2}};
+        if (!writeAll(chunk, n > 0 ? 3 : 1, deadline)) {
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+    }
+}
+
+int PosixTransport::fill(uint64_t deadline) {
+    if (bufferStart > 0) {
+        memmove(buffer, buffer + bufferStart, bufferEnd - bufferStart);
+        bufferEnd -= bufferStart;
+        bufferStart = 0;
+    }
+    if (bufferEnd == sizeof(buffer)) {
+        return -1;
+    }
+    for (;;) {
+        ssize_t n = recv(fd, buffer + bufferEnd, sizeof(buffer) - bufferEnd, 0);
+        if (n > 0) {
+            bufferEnd += n;
+            return (int)n;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if ((errno != EAGAIN && errno != EWOULDBLOCK) || !wait(false, deadline)) {
+            return -1;
+        }
+    }
+}
+
+int PosixTransport::readBody(size_t length, Response* response, uint64_t deadline) {
+    size_t kept = strlen(response->body);
+    while (length > 0) {
+        if (bufferStart == bufferEnd) {
+            int n = fill(deadline);
+            if (n <= 0) {
+                return n == 0 ? ERROR_CONNECTION_LOST : ERROR_TIMEOUT;
+            }
+        }
+        size_t available = bufferEnd - bufferStart;
+        size_t take = available < length ? available : length;
+        // Keep the start of the body for error messages, skip the rest
+        if (kept < sizeof(response->body) - 1) {
+            size_t copy = sizeof(response->body) - 1 - kept < take ? sizeof(response->body) - 1 - kept : take;
+            memcpy(response->body + kept, buffer + bufferStart, copy);
+            kept += copy;
+            response->body[kept] = '\0';
+        }
+        bufferStart += take;
+        length -= take;
+    }
+    return 0;
+}
+
+int PosixTransport::readResponse(Response* response, uint64_t deadline, bool* keepAlive) {
+    bufferStart = 0;
+    bufferEnd = 0;
+
+    // Header block
+    char* headerEnd = nullptr;
+    while (headerEnd == nullptr) {
+        int n = fill(deadline);
+        if (n <= 0) {
+            if (n == 0 && bufferEnd == 0) {
+                return NO_ANSWER;
+            }
+            return n == 0 ? ERROR_CONNECTION_LOST : ERROR_TIMEOUT;
+        }
+        headerEnd = (char*)memmem(buffer, bufferEnd, "\r\n\r\n", 4);
+    }
+
+    int minor = 0;
+    int status = 0;
+    if (sscanf(buffer, "HTTP/1.%d %d", &minor, &status) != 2) {
+        return ERROR_CONNECTION_LOST;
+    }
+    *keepAlive = minor >= 1;
+    long contentLength = -1;
+    bool chunked = false;
+
+    const char* line = (const char*)memchr(buffer, '\n', headerEnd + 2 - buffer) + 1;
+    while (line < headerEnd) {
+        const char* lineEnd = (const char*)memchr(line, '\r', headerEnd + 2 - line);
+        size_t length = lineEnd - line;
+        const char* value;
+        if (isHeader(line, length, "Content-Length", &value)) {
+            contentLength = strtol(value, nullptr, 10);
+        } else if (isHeader(line, length, "Transfer-Encoding", &value)) {
+            chunked = strncasecmp(value, "chunked", 7) == 0;
+        } else if (isHeader(line, length, "Connection", &value)) {
+            if (strncasecmp(value, "close", 5) == 0) {
+                *keepAlive = false;
+            } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+                *keepAlive = true;
+            }
+        } else if (isHeader(line, length, "Retry-After", &value) && *value >= '0' && *value <= '9') {
+            // Only the delay-seconds form is supported; an HTTP date falls back to the backoff
+            response->retryAfter = strtoul(value, nullptr, 10) * 1000UL;
+        }
+        line = lineEnd + 2;
+    }
+    bufferStart = headerEnd + 4 - buffer;
+
+    // Body
+    if (status == 204 || status == 304 || (status >= 100 && status < 200)) {
+        return status;
+    }
+    if (chunked) {
+        for (;;) {
+            char* sizeEnd;
+            while ((sizeEnd = (char*)memmem(buffer + bufferStart, bufferEnd - bufferStart, "\r\n", 2)) == nullptr) {
+                int n = fill(deadline);
+                if (n <= 0) {
+                    return n == 0 ? ERROR_CONNECTION_LOST : ERROR_TIMEOUT;
+                }
+            }
+            size_t size = strtoul(buffer + bufferStart, nullptr, 16);
+            bufferStart = sizeEnd + 2 - buffer;
+            int result = readBody(size, response, deadline);
+            if (result != 0) {
+                return result;
+            }
+            // A chunk is followed by CRLF; the last one (size 0) by an empty trailer line
+            while (bufferEnd - bufferStart < 2) {
+                int n = fill(deadline);
+                if (n <= 0) {
+                    return n == 0 ? ERROR_CONNECTION_LOST : ERROR_TIMEOUT;
+                }
+            }
+            bufferStart += 2;
+            if (size == 0) {
+                return status;
+            }
+        }
+    }
+    if (contentLength >= 0) {
+        int result = readBody((size_t)contentLength, response, deadline);
+        return result != 0 ? result : status;
+    }
+
+    // No length: the body runs until the server closes the connection
+    *keepAlive = false;
+    for (;;) {
+        int result = readBody(bufferEnd - bufferStart, response, deadline);
+        if (result != 0) {
+            return result;
+        }
+        int n = fill(deadline);
+        if (n <= 0) {
+            return n == 0 ? status : ERROR_TIMEOUT;
+        }
+    }
+}
+
+int PosixTransport::send(const Request& request, Response* response) {
+    *response = Response();
+    if (!ready()) {
+        response->status = ERROR_SETUP;
+        return response->status;
+    }
+    if (request.url == nullptr || !parseUrl(request.url)) {
+        response->status = ERROR_INVALID_URL;
+        return response->status;
+    }
+    uint64_t now = nowMillis();
+    uint64_t deadline = now + request.timeout;
+
+    if (fd >= 0 && request.idleTimeout > 0 && now - lastRequestAt >= request.idleTimeout) {
+        close();
+        response->idleClosed = true;
+    }
+    if (fd >= 0 && peerClosed()) {
+        close();
+    }
+
+    int status;
+    for (int attempt = 0;; attempt++) {
+        bool reused = fd >= 0;
+        if (!reused && !connectTo(deadline)) {
+            status = nowMillis() >= deadline ? ERROR_TIMEOUT : ERROR_CONNECT;
+            break;
+        }
+        response->reused = reused;
+
+        bool keepAlive = false;
+        if (!writeRequest(request, deadline)) {
+            status = ERROR_SEND;
+        } else {
+            status = readResponse(response, deadline, &keepAlive);
+        }
+        if (status < 0 || !keepAlive || !request.keepAlive) {
+            close();
+        }
+        // The server may close an idle connection just as it is reused
+        if ((status == NO_ANSWER || status == ERROR_SEND) && reused && attempt == 0) {
+            continue;
+        }
+        if (status == NO_ANSWER) {
+            status = ERROR_CONNECTION_LOST;
+        }
+        break;
+    }
+
+    lastRequestAt = nowMillis();
+    response->status = status;
+    return status;
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef LIGHTWEIGHT_IOT_POSIX_TRANSPORT_H
+#define LIGHTWEIGHT_IOT_POSIX_TRANSPORT_H
+
+#ifndef ARDUINO
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <string>
+
+#include "Transport.h"
+
+/**
+ * @brief Native HTTP/1.1 transport for Linux gateways and other POSIX hosts
+ *
+ * Talks to the server over a non-blocking socket, waiting for readiness
+ * with epoll on Linux and poll elsewhere, so every step of a request is
+ * bounded by Request::timeout. The connection is kept alive between
+ * requests; a request that finds it closed by the server is sent once more
+ * on a fresh connection, which is safe because InfluxDB writes are
+ * idempotent. The request head and all body slices go out in one
+ * scatter-gather write, so batches are sent straight from the batch buffer.
+ * A body source of unknown length, such as a payload compressed while it
+ * is sent, goes out with Transfer-Encoding: chunked in chunks of up to
+ * 4 KB, staged in the response buffer.
+ * The server address is resolved once per URL.
+ *
+ * Only http:// is supported; reach InfluxDB Cloud through a local TLS proxy.
+ * There is no link state on a gateway, so linkUp() is always true and an
+ * unreachable server shows up as ERROR_CONNECT. If the epoll instance
+ * cannot be created, ready() is false and requests fail with ERROR_SETUP.
+ *
+ * @code
+ * PosixTransport transport;
+ * LightweightIoT::Config config;
+ * config.transport = &transport;
+ * iot.setConfig(config);
+ * iot.begin("http://localhost:8086");
+ * @endcode
+ */
+class PosixTransport : public Transport {
+public:
+    PosixTransport();
+    ~PosixTransport();
+
+    PosixTransport(const PosixTransport&) = delete;
+    PosixTransport& operator=(const PosixTransport&) = delete;
+
+    bool ready() const override;
+    bool linkUp() override { return true; }
+    int send(const Request& request, Response* response) override;
+    void close() override;
+    bool gathers() const override { return true; }
+    bool chunks() const override { return true; }
+
+private:
+    bool parseUrl(const char* url);
+    bool connectTo(uint64_t deadline);
+    bool peerClosed();
+    bool wait(bool writable, uint64_t deadline);
+    bool writeAll(iovec* iov, size_t count, uint64_t deadline);
+    bool writeRequest(const Request& request, uint64_t deadline);
+    int readResponse(Response* response, uint64_t deadline, bool* keepAlive);
+    int fill(uint64_t deadline);
+    int readBody(size_t length, Response* response, uint64_t deadline);
+
+    int fd;
+    int pollFd;                    ///< epoll instance on Linux, -1 elsewhere
+    std::string url;               ///< URL the parsed and resolved address belongs to
+    std::string host;              ///< Host header value
+    std::string hostName;
+    std::string target;            ///< Path and query
+    uint16_t port;
+    sockaddr_storage address;
+    socklen_t addressLength;       ///< 0 until the host has been resolved
+    std::string head;              ///< Request head, rebuilt in place for every request
+    char buffer[4096];             ///< Response bytes not yet parsed; body source chunks before that
+    size_t bufferStart;
+    size_t bufferEnd;
+    uint64_t lastRequestAt;
+};
+
+#endif
+
+#endif
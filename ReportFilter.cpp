@@ -0,0 +1,144 @@
+#include "ReportFilter.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <new>
+
+namespace {
+
+const uint32_t FNV_PRIME = 16777619u;
+
+uint32_t mix(uint32_t hash, uint8_t byte) {
+    return (hash ^ byte) * FNV_PRIME;
+}
+
+uint64_t valueState(const LineProtocol::Field& field) {
+    return field.type == LineProtocol::FIELD_BOOL ? (uint64_t)field.b : ReportFilter::hash(field.s);
+}
+
+} // namespace
+
+ReportFilter::ReportFilter() : entries(nullptr), owned(false), mask(0), limit(0), used(0) {}
+
+ReportFilter::~ReportFilter() {
+    release();
+}
+
+size_t ReportFilter::entryCount(size_t series) {
+    // At most three quarters full, which keeps linear probes short, and
+    // always with a free entry to end them
+    size_t count = 1;
+    while (count <= series + series / 3) {
+        count *= 2;
+    }
+    return count;
+}
+
+size_t ReportFilter::storageSize(size_t series) {
+    return entryCount(series) * sizeof(Entry);
+}
+
+bool ReportFilter::allocate(size_t series, void* storage) {
+    release();
+    size_t count = entryCount(series);
+    owned = storage == nullptr;
+    entries = owned ? new (std::nothrow) Entry[count] : (Entry*)storage;
+    if (entries == nullptr) {
+        return false;
+    }
+    mask = count - 1;
+    limit = series;
+    reset();
+    return true;
+}
+
+void ReportFilter::release() {
+    if (owned) {
+        delete[] entries;
+    }
+    entries = nullptr;
+    owned = false;
+    mask = 0;
+    limit = 0;
+    used = 0;
+}
+
+void ReportFilter::reset() {
+    if (entries != nullptr) {
+        memset(entries, 0, (mask + 1) * sizeof(Entry));
+    }
+    used = 0;
+}
+
+ReportFilter::Entry* ReportFilter::find(uint32_t key, bool* created) {
+    *created = false;
+    if (entries == nullptr) {
+        return nullptr;
+    }
+    // Entries are never removed, so the first free entry ends the probe
+    for (size_t i = key & mask, probes = 0; probes <= mask; i = (i + 1) & mask, probes++) {
+        Entry& entry = entries[i];
+        if (entry.key == key) {
+            return &entry;
+        }
+        if (entry.key == 0) {
+            if (used >= limit) {
+                return nullptr;
+            }
+            entry.key = key;
+            used++;
+            *created = true;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool ReportFilter::due(const Entry& entry, const LineProtocol::Field& field, const Rule& rule, uint32_t now) {
+    if (rule.maxSilence > 0 && now - entry.reportedAt >= rule.maxSilence) {
+        return true;
+    }
+    if (field.type == LineProtocol::FIELD_BOOL || field.type == LineProtocol::FIELD_STRING) {
+        return valueState(field) != entry.state;
+    }
+
+    double value = field.type == LineProtocol::FIELD_FLOAT ? (double)field.f : (double)field.i;
+    double moved = fabs(value - entry.number);
+    if (rule.absolute <= 0 && rule.percent <= 0) {
+        return moved > 0;
+    }
+    return (rule.absolute > 0 && moved > rule.absolute) ||
+           (rule.percent > 0 && moved > fabs(entry.number) * rule.percent / 100);
+}
+
+void ReportFilter::record(Entry& entry, const LineProtocol::Field& field, uint32_t now) {
+    entry.reportedAt = now;
+    switch (field.type) {
+    case LineProtocol::FIELD_FLOAT:
+        entry.number = field.f;
+        break;
+    case LineProtocol::FIELD_INT:
+        entry.number = (double)field.i;
+        break;
+    default:
+        entry.state = valueState(field);
+        break;
+    }
+}
+
+uint32_t ReportFilter::hash(const char* text, uint32_t seed) {
+    uint32_t hash = seed;
+    for (const char* p = text; *p != '\0'; p++) {
+        hash = mix(hash, (uint8_t)*p);
+    }
+    return hash;
+}
+
+uint32_t ReportFilter::seriesKey(uint32_t tagSetHash, const char* measurement, const LineProtocol::Field& field) {
+    // Separators keep ("ab", "c") and ("a", "bc") apart; the type keeps a
+    // field that changes type from being compared with its old values
+    uint32_t key = mix(hash(measurement, tagSetHash), 0);
+    key = mix(hash(field.key, key), (uint8_t)(0x80 | field.type));
+    return key != 0 ? key : 1;
+}
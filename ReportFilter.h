@@ -0,0 +1,125 @@
+#ifndef LIGHTWEIGHT_IOT_REPORT_FILTER_H
+#define LIGHTWEIGHT_IOT_REPORT_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "LineProtocol.h"
+
+/**
+ * @brief Report-by-exception state of the series written so far
+ *
+ * A fixed-size open-addressing hash table holding the last reported value of
+ * each series, keyed by a 32-bit hash of measurement, field key, field type
+ * and tag set. An entry takes 16 bytes and is never removed, so a table
+ * allocated for N series needs no memory after startup; series beyond N are
+ * not tracked and are always reported.
+ */
+class ReportFilter {
+public:
+    /**
+     * @brief When a value is worth reporting
+     *
+     * A numeric value is reported when it moved by more than `absolute` or
+     * by more than `percent` of the last reported value; with both at 0 any
+     * change is reported. Strings and booleans are reported when they
+     * change. Independently of the value, a series is reported at least
+     * every `maxSilence` ms.
+     */
+    struct Rule {
+        float absolute;       ///< Absolute deadband (0 = none)
+        float percent;        ///< Deadband relative to the last reported value (%, 0 = none)
+        uint32_t maxSilence;  ///< Heartbeat interval (ms, 0 = only on change)
+
+        Rule(float absolute = 0, float percent = 0, uint32_t maxSilence = 0)
+            : absolute(absolute), percent(percent), maxSilence(maxSilence) {}
+    };
+
+    /**
+     * @brief Last reported value of one series
+     */
+    struct Entry {
+        uint32_t key;         ///< Series key, 0 for a free entry
+        uint32_t reportedAt;  ///< millis() of the last report
+        union {
+            double number;    ///< Integer and float fields
+            uint64_t state;   ///< Boolean fields, hash of string fields
+        };
+    };
+
+    ReportFilter();
+    ~ReportFilter();
+
+    ReportFilter(const ReportFilter&) = delete;
+    ReportFilter& operator=(const ReportFilter&) = delete;
+
+    /**
+     * @brief Allocates the table, forgetting all series
+     * @param series Number of series to track
+     * @param storage Caller-owned region of storageSize() bytes to use instead of the heap
+     * @return true if the table was allocated
+     */
+    bool allocate(size_t series, void* storage = nullptr);
+
+    /**
+     * @brief Returns the bytes allocate() needs for a table
+     */
+    static size_t storageSize(size_t series);
+
+    /**
+     * @brief Frees the table
+     */
+    void release();
+
+    /**
+     * @brief Forgets all series, so the next value of each is reported
+     */
+    void reset();
+
+    /**
+     * @brief Finds the entry of a series, adding it if it is new
+     * @param key Key from seriesKey()
+     * @param created Set to true if the entry was added
+     * @return The entry, nullptr if the series is new and the table is full
+     */
+    Entry* find(uint32_t key, bool* created);
+
+    /**
+     * @brief Checks whether a value has to be reported under a rule
+     * @param now Current millis()
+     */
+    static bool due(const Entry& entry, const LineProtocol::Field& field, const Rule& rule, uint32_t now);
+
+    /**
+     * @brief Records a value as reported
+     */
+    static void record(Entry& entry, const LineProtocol::Field& field, uint32_t now);
+
+    /**
+     * @brief Hashes a string into a running FNV-1a hash
+     */
+    static uint32_t hash(const char* text, uint32_t seed = FNV_OFFSET);
+
+    /**
+     * @brief Computes the key of a series; never 0
+     * @param tagSetHash hash() of the rendered tag set
+     */
+    static uint32_t seriesKey(uint32_t tagSetHash, const char* measurement, const LineProtocol::Field& field);
+
+    size_t series() const { return limit; }
+    size_t tracked() const { return used; }
+    bool allocated() const { return entries != nullptr; }
+
+    static const uint32_t FNV_OFFSET = 2166136261u;
+
+private:
+    Entry* entries;
+    bool owned;    ///< entries were allocated by allocate() rather than passed in
+    size_t mask;
+    size_t limit;  ///< Series the table was allocated for
+    size_t used;
+
+    static size_t entryCount(size_t series);
+};
+
+#endif
@@ -0,0 +1,416 @@
+#include "Spool.h"
+#include "GzipWriter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ARDUINO
+    #ifndef LWIOT_SPOOL_FS
+        #define LWIOT_SPOOL_FS LittleFS
+        #define LWIOT_SPOOL_FS_HEADER <LittleFS.h>
+    #endif
+    #include LWIOT_SPOOL_FS_HEADER
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+
+const uint8_t SEGMENT_MAGIC[4] = {'L', 'W', 'S', '1'};
+
+void put32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+uint32_t get32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+} // namespace
+
+#ifdef ARDUINO
+
+Spool::Segment::Segment() : seq(0) {}
+
+Spool::Segment::~Segment() {
+    close();
+}
+
+bool Spool::Segment::create(const char* path, uint32_t sequence, size_t) {
+    close();
+    file = LWIOT_SPOOL_FS.open(path, "w");
+    if (!file) {
+        return false;
+    }
+    uint8_t header[SEGMENT_HEADER];
+    memcpy(header, SEGMENT_MAGIC, 4);
+    put32(header + 4, sequence);
+    seq = sequence;
+    return write(0, header, sizeof(header)) && sync();
+}
+
+bool Spool::Segment::open(const char* path) {
+    close();
+    if (!LWIOT_SPOOL_FS.exists(path)) {
+        return false;
+    }
+    file = LWIOT_SPOOL_FS.open(path, "r");
+    uint8_t header[SEGMENT_HEADER];
+    if (!file || !read(0, header, sizeof(header)) || memcmp(header, SEGMENT_MAGIC, 4) != 0) {
+        close();
+        return false;
+    }
+    seq = get32(header + 4);
+    return true;
+}
+
+void Spool::Segment::close() {
+    if (file) {
+        file.close();
+    }
+}
+
+bool Spool::Segment::isOpen() const {
+    return (bool)file;
+}
+
+size_t Spool::Segment::size() const {
+    return file ? const_cast<fs::File&>(file).size() : 0;
+}
+
+bool Spool::Segment::write(size_t, const uint8_t* data, size_t length) {
+    // Files are only ever appended to, so the offset is implied
+    return file.write(data, length) == length;
+}
+
+bool Spool::Segment::read(size_t offset, uint8_t* data, size_t length) {
+    return file.seek(offset) && file.read(data, length) == length;
+}
+
+bool Spool::Segment::sync() {
+    file.flush();
+    return true;
+}
+
+bool Spool::removeFile(const char* path) {
+    return LWIOT_SPOOL_FS.remove(path);
+}
+
+#else
+
+Spool::Segment::Segment() : seq(0), fd(-1), map(nullptr), mapSize(0) {}
+
+Spool::Segment::~Segment() {
+    close();
+}
+
+bool Spool::Segment::create(const char* path, uint32_t sequence, size_t size) {
+    close();
+    // The file is sized up front; unwritten space reads as zero, which ends the record scan
+    fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        close();
+        return false;
+    }
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    map = (uint8_t*)p;
+    mapSize = size;
+
+    uint8_t header[SEGMENT_HEADER];
+    memcpy(header, SEGMENT_MAGIC, 4);
+    put32(header + 4, sequence);
+    seq = sequence;
+    return write(0, header, sizeof(header));
+}
+
+bool Spool::Segment::open(const char* path) {
+    close();
+    fd = ::open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < SEGMENT_HEADER) {
+        close();
+        return false;
+    }
+    void* p = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    map = (uint8_t*)p;
+    mapSize = info.st_size;
+    if (memcmp(map, SEGMENT_MAGIC, 4) != 0) {
+        close();
+        return false;
+    }
+    seq = get32(map + 4);
+    return true;
+}
+
+void Spool::Segment::close() {
+    if (map != nullptr) {
+        munmap(map, mapSize);
+        map = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    mapSize = 0;
+}
+
+bool Spool::Segment::isOpen() const {
+    return map != nullptr;
+}
+
+size_t Spool::Segment::size() const {
+    return mapSize;
+}
+
+bool Spool::Segment::write(size_t offset, const uint8_t* data, size_t length) {
+    if (map == nullptr || offset + length > mapSize) {
+        return false;
+    }
+    memcpy(map + offset, data, length);
+    return true;
+}
+
+bool Spool::Segment::read(size_t offset, uint8_t* data, size_t length) {
+    if (map == nullptr || offset + length > mapSize) {
+        return false;
+    }
+    memcpy(data, map + offset, length);
+    return true;
+}
+
+bool Spool::Segment::sync() {
+    // The page cache survives a crash of the process; this only starts writeback
+    return msync(map, mapSize, MS_ASYNC) == 0;
+}
+
+bool Spool::removeFile(const char* path) {
+    return unlink(path) == 0;
+}
+
+#endif
+
+Spool::Spool()
+    : segmentSize(0), slots(0), readSequence(0), writeSequence(0), readOffset(0), writeOffset(0),
+      pendingLength(0), droppedCount(0), ready(false) {
+    directory[0] = '\0';
+}
+
+Spool::~Spool() {
+    end();
+}
+
+bool Spool::begin(const char* directory, size_t maxBytes, size_t segmentSize) {
+    end();
+    if (strlen(directory) >= sizeof(this->directory) || segmentSize <= SEGMENT_HEADER + RECORD_HEADER) {
+        return false;
+    }
+    strcpy(this->directory, directory);
+    this->segmentSize = segmentSize;
+    slots = maxBytes / segmentSize;
+    if (slots < 2) {
+        slots = 2;
+    }
+
+#if defined(ESP32)
+    // Formats the partition on first use
+    if (!LWIOT_SPOOL_FS.begin(true)) {
+        return false;
+    }
+#elif defined(ARDUINO)
+    if (!LWIOT_SPOOL_FS.begin()) {
+        return false;
+    }
+#endif
+#ifdef ARDUINO
+    LWIOT_SPOOL_FS.mkdir(directory);
+#else
+    mkdir(directory, 0755);
+#endif
+
+    // Find the oldest and newest segment left by a previous run
+    bool found = false;
+    uint32_t oldest = 0;
+    uint32_t newest = 0;
+    char path[48];
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        Segment segment;
+        segmentPath(path, sizeof(path), slot);
+        if (!segment.open(path)) {
+            continue;
+        }
+        uint32_t sequence = segment.sequence();
+        if (!found || (int32_t)(sequence - oldest) < 0) {
+            oldest = sequence;
+        }
+        if (!found || (int32_t)(sequence - newest) > 0) {
+            newest = sequence;
+        }
+        found = true;
+    }
+
+    // New records go to a fresh segment, created on the first append
+    readSequence = found ? oldest : 0;
+    writeSequence = found ? newest + 1 : 0;
+    readOffset = SEGMENT_HEADER;
+    writeOffset = SEGMENT_HEADER;
+    pendingLength = 0;
+    ready = true;
+    return true;
+}
+
+void Spool::end() {
+    writer.close();
+    reader.close();
+    ready = false;
+}
+
+bool Spool::append(const char* data, size_t length) {
+    size_t framed = RECORD_HEADER + length;
+    if (!ready || length == 0 || SEGMENT_HEADER + framed > segmentSize) {
+        return false;
+    }
+    if (writer.isOpen() && writeOffset + framed > segmentSize) {
+        writer.close();
+        writeSequence++;
+        writeOffset = SEGMENT_HEADER;
+    }
+    if (!writer.isOpen() && !openWriter()) {
+        return false;
+    }
+
+    uint8_t header[RECORD_HEADER];
+    put32(header, length);
+    put32(header + 4, GzipWriter::crc32((const uint8_t*)data, length));
+    if (!writer.write(writeOffset, header, sizeof(header)) ||
+        !writer.write(writeOffset + sizeof(header), (const uint8_t*)data, length) || !writer.sync()) {
+        // The segment may now hold a partial record; continue in a new one
+        writer.close();
+        writeSequence++;
+        writeOffset = SEGMENT_HEADER;
+        return false;
+    }
+    writeOffset += framed;
+    return true;
+}
+
+size_t Spool::peek(char* buffer, size_t capacity) {
+    pendingLength = 0;
+    char path[48];
+
+    while (!empty()) {
+        bool current = readSequence == writeSequence;
+        if (!reader.isOpen()) {
+            segmentPath(path, sizeof(path), readSequence);
+            if (!reader.open(path) || reader.sequence() != readSequence) {
+                // Missing or overwritten segment
+                reader.close();
+                if (current) {
+                    return 0;
+                }
+                advanceReader();
+                continue;
+            }
+        }
+
+        size_t limit = current ? writeOffset : reader.size();
+        uint8_t header[RECORD_HEADER];
+        uint32_t length = 0;
+        bool valid = readOffset + RECORD_HEADER <= limit && reader.read(readOffset, header, sizeof(header));
+        if (valid) {
+            length = get32(header);
+            valid = length > 0 && readOffset + RECORD_HEADER + length <= limit;
+        }
+        if (valid && length > capacity) {
+            readOffset += RECORD_HEADER + length;
+            droppedCount++;
+            continue;
+        }
+        valid = valid && reader.read(readOffset + RECORD_HEADER, (uint8_t*)buffer, length) &&
+                GzipWriter::crc32((const uint8_t*)buffer, length) == get32(header + 4);
+
+        if (!valid) {
+            // End of the segment, or a record torn by a crash: nothing after it can be trusted
+            if (current) {
+                readOffset = writeOffset;
+                return 0;
+            }
+            advanceReader();
+            continue;
+        }
+
+        pendingLength = RECORD_HEADER + length;
+        return length;
+    }
+    return 0;
+}
+
+void Spool::consume() {
+    readOffset += pendingLength;
+    pendingLength = 0;
+    if (readSequence != writeSequence) {
+        // Free the flash of a drained segment straight away. Unwritten space
+        // reads as zero, so a zero length also ends the segment.
+        uint8_t header[RECORD_HEADER];
+        if (readOffset + RECORD_HEADER > reader.size() || !reader.read(readOffset, header, sizeof(header)) ||
+            get32(header) == 0) {
+            advanceReader();
+        }
+    } else if (readSequence == writeSequence && readOffset >= writeOffset) {
+        // Fully drained: delete the segment too, or a reboot would send it again
+        writer.close();
+        writeSequence++;
+        writeOffset = SEGMENT_HEADER;
+        advanceReader();
+    }
+}
+
+bool Spool::empty() const {
+    return !ready || (readSequence == writeSequence && readOffset >= writeOffset);
+}
+
+size_t Spool::bytes() const {
+    if (empty()) {
+        return 0;
+    }
+    return (size_t)(writeSequence - readSequence) * segmentSize + writeOffset - readOffset;
+}
+
+void Spool::segmentPath(char* path, size_t capacity, uint32_t sequence) const {
+    snprintf(path, capacity, "%s/%lu.seg", directory, (unsigned long)(sequence % slots));
+}
+
+bool Spool::openWriter() {
+    // Ring full: drop the oldest segment to make room
+    while (writeSequence - readSequence >= slots) {
+        advanceReader();
+        droppedCount++;
+    }
+    char path[48];
+    segmentPath(path, sizeof(path), writeSequence);
+    writeOffset = SEGMENT_HEADER;
+    return writer.create(path, writeSequence, segmentSize);
+}
+
+void Spool::advanceReader() {
+    char path[48];
+    reader.close();
+    segmentPath(path, sizeof(path), readSequence);
+    removeFile(path);
+    readSequence++;
+    readOffset = SEGMENT_HEADER;
+    pendingLength = 0;
+}
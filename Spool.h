@@ -0,0 +1,134 @@
+#ifndef LIGHTWEIGHT_IOT_SPOOL_H
+#define LIGHTWEIGHT_IOT_SPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef ARDUINO
+    #include <FS.h>
+#endif
+
+/**
+ * @brief Persistent append-only log of batch payloads
+ *
+ * Payloads that cannot be sent are written as CRC-framed records to a ring of
+ * fixed-size segment files and read back oldest first. The ring is bounded:
+ * when it is full the oldest segment is dropped to make room. A drained
+ * segment is deleted as soon as the reader moves past it.
+ *
+ * Each segment starts with its sequence number, so the log is found again
+ * after a reboot without any other metadata. A record whose checksum does not
+ * match (for example one torn by a crash) ends its segment. The read position
+ * is not persisted; after a reboot the oldest segment is sent again from its
+ * start, which InfluxDB absorbs because rewriting a point with the same series
+ * and timestamp is idempotent.
+ *
+ * Segments are files on LittleFS (or the filesystem named by LWIOT_SPOOL_FS)
+ * on Arduino, and memory-mapped files on host builds. The spool is not
+ * thread-safe.
+ */
+class Spool {
+public:
+    Spool();
+    ~Spool();
+
+    Spool(const Spool&) = delete;
+    Spool& operator=(const Spool&) = delete;
+
+    /**
+     * @brief Opens the log, recovering any records left by a previous run
+     * @param directory Directory holding the segment files
+     * @param maxBytes Upper bound for the total size of the segments
+     * @param segmentSize Size of one segment; also bounds the record size
+     * @return true if the log is ready for writing
+     */
+    bool begin(const char* directory, size_t maxBytes, size_t segmentSize);
+
+    /**
+     * @brief Closes the log; the segment files are kept
+     */
+    void end();
+
+    /**
+     * @brief Appends one record
+     * @return false if the record is larger than a segment or cannot be written
+     */
+    bool append(const char* data, size_t length);
+
+    /**
+     * @brief Copies the oldest record without removing it
+     *
+     * Records larger than the buffer are dropped and counted in dropped().
+     * @return Record length, 0 if the log is empty
+     */
+    size_t peek(char* buffer, size_t capacity);
+
+    /**
+     * @brief Removes the record returned by the last peek()
+     */
+    void consume();
+
+    bool empty() const;
+
+    /**
+     * @brief Approximate number of bytes still to be read
+     */
+    size_t bytes() const;
+
+    /**
+     * @brief Number of segments and oversized records dropped
+     */
+    uint32_t dropped() const { return droppedCount; }
+
+private:
+    static const size_t SEGMENT_HEADER = 8;  ///< Magic and sequence number
+    static const size_t RECORD_HEADER = 8;   ///< Length and CRC-32
+
+    /**
+     * @brief One segment file, opened either for writing or for reading
+     */
+    class Segment {
+    public:
+        Segment();
+        ~Segment();
+        bool create(const char* path, uint32_t sequence, size_t size);
+        bool open(const char* path);
+        void close();
+        bool isOpen() const;
+        uint32_t sequence() const { return seq; }
+        size_t size() const;
+        bool write(size_t offset, const uint8_t* data, size_t length);
+        bool read(size_t offset, uint8_t* data, size_t length);
+        bool sync();
+
+    private:
+        uint32_t seq;
+#ifdef ARDUINO
+        fs::File file;
+#else
+        int fd;
+        uint8_t* map;
+        size_t mapSize;
+#endif
+    };
+
+    Segment writer;
+    Segment reader;
+    char directory[32];
+    size_t segmentSize;
+    uint32_t slots;            ///< Number of segment files in the ring
+    uint32_t readSequence;     ///< Oldest segment
+    uint32_t writeSequence;    ///< Segment being appended to
+    size_t readOffset;
+    size_t writeOffset;
+    size_t pendingLength;      ///< Framed size of the record returned by peek()
+    uint32_t droppedCount;
+    bool ready;
+
+    void segmentPath(char* path, size_t capacity, uint32_t sequence) const;
+    bool openWriter();
+    void advanceReader();
+    static bool removeFile(const char* path);
+};
+
+#endif
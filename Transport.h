@@ -0,0 +1,139 @@
+#ifndef LIGHTWEIGHT_IOT_TRANSPORT_H
+#define LIGHTWEIGHT_IOT_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief HTTP transport used by LightweightIoT to reach InfluxDB
+ *
+ * A transport sends one request at a time and keeps its connection open
+ * between requests when asked to. Two backends come with the library:
+ * HTTPClientTransport, the default, uses the Arduino HTTPClient and WiFi;
+ * PosixTransport (host builds) talks HTTP/1.1 over a non-blocking socket
+ * for Linux gateways. Select one with Config::transport.
+ *
+ * A transport is used from one thread at a time; LightweightIoT serializes
+ * its own calls, including those made by the background sender.
+ */
+class Transport {
+public:
+    /**
+     * @brief Contiguous piece of a request body
+     */
+    struct Slice {
+        const char* data;
+        size_t length;
+    };
+
+    /**
+     * @brief Request body produced while it is sent
+     *
+     * For bodies that exist only in pieces, such as compressed output, so a
+     * request never holds the whole body. A transport may read the body
+     * more than once, e.g. to resend it on a fresh connection, and calls
+     * rewind() before every pass.
+     */
+    class BodySource {
+    public:
+        virtual ~BodySource() {}
+
+        /**
+         * @brief Starts the body again from its first byte
+         * @return false if it cannot be produced again
+         */
+        virtual bool rewind() = 0;
+
+        /**
+         * @brief Copies the next bytes of the body
+         * @return Bytes copied, 0 at the end of the body, -1 if it could not be produced
+         */
+        virtual long read(char* buffer, size_t capacity) = 0;
+    };
+
+    /**
+     * @brief Negative status codes for requests that got no HTTP answer
+     */
+    enum Error {
+        ERROR_CONNECT = -1,          ///< Could not connect to the server
+        ERROR_SEND = -3,             ///< Writing the request failed
+        ERROR_NOT_CONNECTED = -4,    ///< No network link
+        ERROR_CONNECTION_LOST = -5,  ///< Connection closed before the answer was complete
+        ERROR_TIMEOUT = -11,         ///< No answer within the timeout
+        ERROR_INVALID_URL = -100,    ///< URL malformed or scheme not supported by this transport
+        ERROR_MEMORY = -101,         ///< Out of memory
+        ERROR_SETUP = -102           ///< The transport could not set itself up, see ready()
+    };
+
+    /**
+     * @brief One HTTP request
+     */
+    struct Request {
+        const char* method = "POST";
+        const char* url = nullptr;              ///< Absolute http:// or https:// URL
+        const char* token = nullptr;            ///< InfluxDB API token, sent as "Authorization: Token ..."
+        const char* contentEncoding = nullptr;  ///< Content-Encoding of the body, nullptr for none
+        const Slice* body = nullptr;            ///< Body, sent back to back without copying where possible
+        size_t bodyCount = 0;
+        BodySource* source = nullptr;           ///< Body read while sending, instead of body; nullptr for none
+        size_t sourceLength = 0;                ///< Length of the source's body, 0 if unknown (see chunks())
+        uint16_t timeout = 5000;                ///< Connect and response timeout (ms)
+        bool keepAlive = true;                  ///< Keep the connection open after the answer
+        uint32_t idleTimeout = 30000;           ///< Reconnect rather than reuse a connection idle this long (ms, 0 = never)
+        const char* caCert = nullptr;           ///< Root CA for https:// (nullptr skips verification)
+    };
+
+    /**
+     * @brief Answer to a request
+     */
+    struct Response {
+        int status = 0;                 ///< HTTP status code, or an Error
+        unsigned long retryAfter = 0;   ///< Retry-After in the delay-seconds form (ms), 0 if absent
+        bool reused = false;            ///< Sent on a connection that was already open
+        bool idleClosed = false;        ///< An idle connection was closed before the request
+        char body[128] = "";            ///< Start of the response body, NUL-terminated
+    };
+
+    virtual ~Transport() {}
+
+    /**
+     * @brief Checks whether the transport set itself up, independent of the network
+     *
+     * A transport that is not ready fails every request with ERROR_SETUP;
+     * LightweightIoT::begin() refuses it.
+     */
+    virtual bool ready() const { return true; }
+
+    /**
+     * @brief Checks whether the network link is up
+     */
+    virtual bool linkUp() = 0;
+
+    /**
+     * @brief Sends a request and reads the whole answer
+     * @return Response::status
+     */
+    virtual int send(const Request& request, Response* response) = 0;
+
+    /**
+     * @brief Closes the connection
+     */
+    virtual void close() = 0;
+
+    /**
+     * @brief Checks whether a body of several slices is sent without joining them first
+     *
+     * LightweightIoT then sends a wrapped batch as one request instead of two.
+     */
+    virtual bool gathers() const { return false; }
+
+    /**
+     * @brief Checks whether a source body of unknown length is sent with Transfer-Encoding: chunked
+     *
+     * Other transports need Request::sourceLength, which costs LightweightIoT
+     * a second compression pass to find out.
+     */
+    virtual bool chunks() const { return false; }
+};
+
+#endif
@@ -1,15 +1,17 @@
 /*
  * BasicBatch Example
  * Created by Judas Sithole
- * 
+ *
  * This example demonstrates how to use batch operations to collect multiple sensor readings
- * and send them to InfluxDB in a single request. It uses a BMP280 sensor to measure
- * temperature and pressure, collecting 5 readings before sending them as a batch.
- * 
+ * and send them to InfluxDB in as few requests as possible. It uses a BMP280 sensor to
+ * measure temperature and pressure. Instead of managing the batch by hand, the flush
+ * policy sends the queued readings once 10 points are collected or the oldest reading
+ * is a minute old, whichever comes first.
+ *
  * Hardware Required:
  * - ESP32 or compatible board
  * - BMP280 sensor
- * 
+ *
  * Circuit:
  * - Connect BMP280 to your board's I2C pins
  */
@@ -27,45 +29,44 @@ const char* INFLUXDB_ORG = "your-org";
 const char* INFLUXDB_BUCKET = "your-bucket";
 
 Adafruit_BMP280 bmp;
-LightweightIoT iot;
+LightweightIoT iot(INFLUXDB_TOKEN, INFLUXDB_ORG, INFLUXDB_BUCKET);
 
 void setup() {
   Serial.begin(115200);
-  
+
   if (!bmp.begin()) {
     Serial.println("BMP280 not found!");
     while (1);
   }
-  
+
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
   while (WiFi.status() != WL_CONNECTED) {
     delay(500);
     Serial.print(".");
   }
   Serial.println("\nWiFi connected");
-  
-  iot.setConfig(INFLUXDB_URL, INFLUXDB_TOKEN, INFLUXDB_ORG, INFLUXDB_BUCKET);
-  iot.begin();
+
+  // Flush after 10 points or when the oldest point is 60 seconds old
+  LightweightIoT::Config config;
+  config.flushPoints = 10;
+  config.flushInterval = 60000;
+  iot.setConfig(config);
+
+  iot.begin(INFLUXDB_URL);
   iot.addTag("device", "bmp280-sensor");
   iot.addTag("location", "outdoor");
 }
 
 void loop() {
-  iot.beginBatch();
-  
-  // Collect 5 readings
-  for (int i = 0; i < 5; i++) {
-    float temp = bmp.readTemperature();
-    float pressure = bmp.readPressure() / 100.0F; // Convert to hPa
-    
-    iot.addToBatch("temperature", temp);
-    iot.addToBatch("pressure", pressure);
-    
-    delay(2000); // Wait 2 seconds between readings
-  }
-  
-  // Send batch
-  iot.endBatch();
-  
-  delay(300000); // Wait 5 minutes before next batch
-}
\ No newline at end of file
+  float temp = bmp.readTemperature();
+  float pressure = bmp.readPressure() / 100.0F; // Convert to hPa
+
+  // Readings are queued and sent automatically by the flush policy
+  iot.writePoint("temperature", "value", temp);
+  iot.writePoint("pressure", "value", pressure);
+
+  // Sends the batch once the oldest reading is too old
+  iot.loop();
+
+  delay(2000); // Wait 2 seconds between readings
+}
@@ -5,6 +5,8 @@
  * This example shows how to use multiple sensors with different tags for each sensor.
  * It demonstrates reading from a DHT22 temperature/humidity sensor and a BH1750
  * light sensor, sending data to InfluxDB with appropriate location tags.
+ * Temperature and humidity are read together, so they are sent as two fields
+ * of one point.
  * 
  * Hardware Required:
  * - ESP32 or compatible board
@@ -33,7 +35,7 @@ const char* INFLUXDB_BUCKET = "your-bucket";
 DHT dht(2, DHT22);
 BH1750 lightMeter;
 
-LightweightIoT iot;
+LightweightIoT iot(INFLUXDB_TOKEN, INFLUXDB_ORG, INFLUXDB_BUCKET);
 
 void setup() {
   Serial.begin(115200);
@@ -48,8 +50,7 @@ void setup() {
   }
   Serial.println("\nWiFi connected");
   
-  iot.setConfig(INFLUXDB_URL, INFLUXDB_TOKEN, INFLUXDB_ORG, INFLUXDB_BUCKET);
-  iot.begin();
+  iot.begin(INFLUXDB_URL);
 }
 
 void loop() {
@@ -62,8 +63,7 @@ void loop() {
   float temp = dht.readTemperature();
   float hum = dht.readHumidity();
   if (!isnan(temp) && !isnan(hum)) {
-    iot.writePoint("temperature", temp);
-    iot.writePoint("humidity", hum);
+    iot.writePoint("climate", {{"temperature", temp}, {"humidity", hum}});
   }
   
   // Read Light Sensor (outdoor)
@@ -74,7 +74,7 @@ void loop() {
   
   float lux = lightMeter.readLightLevel();
   if (lux >= 0) {
-    iot.writePoint("light", lux);
+    iot.writePoint("light", "lux", lux);
   }
   
   delay(60000); // Read every minute
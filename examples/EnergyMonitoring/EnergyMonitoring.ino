@@ -4,7 +4,12 @@
  * 
  * This example shows how to monitor electrical parameters using a PZEM-004T sensor.
  * It demonstrates advanced usage of the library with device location tracking and
- * batch measurements for power monitoring applications.
+ * multi-field points for power monitoring applications: every reading of the
+ * meter becomes one line with all six values as fields.
+ *
+ * The meter is read every second, but only per-minute min/max/mean/count/last
+ * of the readings are uploaded, so short load peaks are kept while the upload
+ * volume drops sixty-fold. The energy counter is sent when it moves.
  * 
  * Hardware Required:
  * - ESP32 or compatible board
@@ -45,6 +50,7 @@ void setup() {
     LightweightIoT::Config config;
     config.maxRetries = 3;
     config.debugMode = true;
+    config.flushInterval = 60000; // one upload per minute
     iot.setConfig(config);
     
     // Connect to WiFi
@@ -63,31 +69,31 @@ void setup() {
         Serial.println("Failed to initialize!");
         return;
     }
+
+    // Per-minute statistics instead of every sample
+    iot.setAggregation("energy", "voltage", 60000);
+    iot.setAggregation("energy", "current", 60000);
+    iot.setAggregation("energy", "power", 60000, true);
+    iot.setAggregation("energy", "frequency", 60000);
+    iot.setAggregation("energy", "power_factor", 60000);
+    iot.setDeadband("energy", "energy", LightweightIoT::Deadband(0.01f, 0, 60000));
 }
 
 void loop() {
-    // Read energy metrics
-    float voltage = pzem.voltage();
-    float current = pzem.current();
-    float power = pzem.power();
-    float energy = pzem.energy();
-    float frequency = pzem.frequency();
-    float pf = pzem.pf();
-    
-    // Create measurements
-    LightweightIoT::Measurement measurements[] = {
-        {"voltage", "value", String(voltage)},
-        {"current", "value", String(current)},
-        {"power", "value", String(power)},
-        {"energy", "value", String(energy)},
-        {"frequency", "value", String(frequency)},
-        {"power_factor", "value", String(pf)}
-    };
+    // Read energy metrics into one point
+    LightweightIoT::Point point("energy");
+    point.addField("voltage", pzem.voltage())
+         .addField("current", pzem.current())
+         .addField("power", pzem.power())
+         .addField("energy", pzem.energy())
+         .addField("frequency", pzem.frequency())
+         .addField("power_factor", pzem.pf());
     
-    // Send data in batch
-    if (!iot.writeMeasurements(measurements, 6)) {
+    // A value the meter failed to read (NaN) is left out; the others are sent
+    if (!iot.writePoint(point)) {
         Serial.println("Error sending data!");
     }
+    iot.loop();
     
-    delay(10000); // Read every 10 seconds
+    delay(1000); // Read every second
 }
\ No newline at end of file
@@ -87,9 +87,9 @@ void loop() {
     
     // Create measurements
     LightweightIoT::Measurement measurements[] = {
-        {"temperature", "value", String(temperature)},
-        {"humidity", "value", String(humidity)},
-        {"pressure", "value", String(pressure)}
+        {"temperature", "value", temperature},
+        {"humidity", "value", humidity},
+        {"pressure", "value", pressure}
     };
     
     // Send data
@@ -98,9 +98,9 @@ void loop() {
 
     // Create measurements
     LightweightIoT::Measurement measurements[] = {
-        {"temperature", "value", String(temperature)},
-        {"humidity", "value", String(humidity)},
-        {"light", "value", String(light)}
+        {"temperature", "value", temperature},
+        {"humidity", "value", humidity},
+        {"light", "value", light}
     };
 
     // Send data from each device
@@ -0,0 +1,130 @@
+#include "Bench.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+namespace {
+
+std::atomic<unsigned long> allocationCount(0);
+thread_local bool countThread = true;
+
+void* allocate(size_t size) {
+    if (countThread) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    void* p = malloc(size != 0 ? size : 1);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](size_t size) {
+    return allocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+Bench::Bench(int argc, char** argv) : quickRun(false), filter(nullptr), failures(0), current(""), startAllocations(0) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quickRun = true;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        }
+    }
+}
+
+unsigned long Bench::iterations(unsigned long full) const {
+    unsigned long n = quickRun ? full / 100 : full;
+    return n > 0 ? n : 1;
+}
+
+bool Bench::selected(const char* name) const {
+    return filter == nullptr || strstr(name, filter) != nullptr;
+}
+
+void Bench::section(const char* title) {
+    printf("\n%s\n%-30s %12s %10s %12s %13s\n", title, "case", "points/s", "ns/point", "bytes/point",
+           "allocs/point");
+}
+
+void Bench::begin(const char* name) {
+    current = name;
+    startAllocations = allocations();
+    startedAt = std::chrono::steady_clock::now();
+}
+
+Bench::Result Bench::end(unsigned long points, size_t bytes, const char* note) {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startedAt).count();
+    unsigned long allocated = allocations() - startAllocations;
+
+    Result result;
+    double n = points > 0 ? (double)points : 1.0;
+    result.pointsPerSecond = elapsed > 0 ? points / elapsed : 0;
+    result.bytesPerPoint = bytes / n;
+    result.allocationsPerPoint = allocated / n;
+    printf("%-30s %12.0f %10.1f %12.1f %13.3f%s%s\n", current, result.pointsPerSecond, elapsed * 1e9 / n,
+           result.bytesPerPoint, result.allocationsPerPoint, note != nullptr ? "  " : "", note != nullptr ? note : "");
+    fflush(stdout);
+    return result;
+}
+
+void Bench::fail(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    printf("FAIL %s: ", current);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    failures++;
+}
+
+unsigned long Bench::allocations() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+void Bench::countAllocations(bool enabled) {
+    countThread = enabled;
+}
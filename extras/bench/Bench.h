@@ -0,0 +1,98 @@
+#ifndef LIGHTWEIGHT_IOT_BENCH_H
+#define LIGHTWEIGHT_IOT_BENCH_H
+
+/**
+ * @file Bench.h
+ * @brief Timing, allocation counting and reporting for the host benchmarks
+ *
+ * Linking Bench.cpp replaces the global operator new, so every heap
+ * allocation made by the process is counted. Threads that belong to the
+ * harness rather than the code under test, such as the mock server, call
+ * countAllocations(false) to stay out of the numbers.
+ *
+ * Each case is timed between begin() and end() and printed as one row:
+ *
+ *   case                          points/s   ns/point  bytes/point  allocs/point
+ *   encode float                   3712000       269         52.0         0.000
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+
+class Bench {
+public:
+    /**
+     * @brief Figures for one case
+     */
+    struct Result {
+        double pointsPerSecond;
+        double bytesPerPoint;
+        double allocationsPerPoint;
+    };
+
+    /**
+     * @brief Parses the common options
+     *
+     * --quick divides the iteration counts by 100 for smoke runs under ctest;
+     * --filter TEXT only runs cases whose name contains TEXT.
+     */
+    Bench(int argc, char** argv);
+
+    bool quick() const { return quickRun; }
+
+    /**
+     * @brief Scales a full-run iteration count for the current mode
+     */
+    unsigned long iterations(unsigned long full) const;
+
+    /**
+     * @brief Checks whether a case was selected with --filter
+     */
+    bool selected(const char* name) const;
+
+    /**
+     * @brief Prints a section heading and the column names
+     */
+    void section(const char* title);
+
+    /**
+     * @brief Starts timing a case and counting its allocations
+     */
+    void begin(const char* name);
+
+    /**
+     * @brief Stops timing and prints the row
+     * @param points Points (or strings, values, ...) processed since begin()
+     * @param bytes Bytes produced for them
+     * @param note Optional text appended to the row
+     */
+    Result end(unsigned long points, size_t bytes, const char* note = nullptr);
+
+    /**
+     * @brief Records a failed check; main() returns exitCode()
+     */
+    void fail(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    int exitCode() const { return failures > 0 ? 1 : 0; }
+
+    /**
+     * @brief Heap allocations made so far by counted threads
+     */
+    static unsigned long allocations();
+
+    /**
+     * @brief Includes or excludes the calling thread's allocations
+     */
+    static void countAllocations(bool enabled);
+
+private:
+    bool quickRun;
+    const char* filter;
+    int failures;
+    const char* current;
+    unsigned long startAllocations;
+    std::chrono::steady_clock::time_point startedAt;
+};
+
+#endif
@@ -0,0 +1,323 @@
+#include "MockInfluxDB.h"
+#include "Bench.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+// Returns the value of a request header, or an empty string
+std::string headerValue(const std::string& head, const char* name) {
+    size_t nameLength = strlen(name);
+    size_t lineStart = head.find("\r\n");
+    while (lineStart != std::string::npos && lineStart + 2 < head.size()) {
+        lineStart += 2;
+        size_t lineEnd = head.find("\r\n", lineStart);
+        if (lineEnd == std::string::npos) {
+            lineEnd = head.size();
+        }
+        if (lineEnd - lineStart > nameLength && head[lineStart + nameLength] == ':' &&
+            strncasecmp(head.c_str() + lineStart, name, nameLength) == 0) {
+            size_t valueStart = head.find_first_not_of(' ', lineStart + nameLength + 1);
+            return valueStart < lineEnd ? head.substr(valueStart, lineEnd - valueStart) : std::string();
+        }
+        lineStart = lineEnd;
+    }
+    return std::string();
+}
+
+bool sendAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        length -= n;
+    }
+    return true;
+}
+
+bool respond(int fd, int status, const char* reason, const char* extraHeaders, const char* body, bool keepAlive) {
+    char response[512];
+    int length = snprintf(response, sizeof(response),
+                          "HTTP/1.1 %d %s\r\nContent-Length: %zu\r\nConnection: %s\r\n%s\r\n%s", status, reason,
+                          strlen(body), keepAlive ? "keep-alive" : "close", extraHeaders, body);
+    return sendAll(fd, response, (size_t)length);
+}
+
+} // namespace
+
+MockInfluxDB::MockInfluxDB() : listenFd(-1), listenPort(0), stopping(false) {}
+
+MockInfluxDB::~MockInfluxDB() {
+    stop();
+}
+
+bool MockInfluxDB::start(const Options& options) {
+    stop();
+    this->options = options;
+    generator.seed(options.seed);
+    totals = Counters();
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(options.port);
+    socklen_t addressLength = sizeof(address);
+    if (bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 64) != 0 ||
+        getsockname(listenFd, (sockaddr*)&address, &addressLength) != 0) {
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    listenPort = ntohs(address.sin_port);
+
+    stopping.store(false);
+    acceptThread = std::thread(&MockInfluxDB::acceptLoop, this);
+    return true;
+}
+
+void MockInfluxDB::stop() {
+    if (listenFd < 0) {
+        return;
+    }
+    stopping.store(true);
+    shutdown(listenFd, SHUT_RDWR);
+    acceptThread.join();
+    ::close(listenFd);
+    listenFd = -1;
+
+    // Wake connection threads blocked in recv()
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (int fd : connectionFds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        threads.swap(connectionThreads);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void MockInfluxDB::setFaults(uint32_t latency, float errorRate, float throttleRate, uint32_t retryAfter) {
+    std::lock_guard<std::mutex> guard(lock);
+    options.latency = latency;
+    options.errorRate = errorRate;
+    options.throttleRate = throttleRate;
+    options.retryAfter = retryAfter;
+}
+
+std::string MockInfluxDB::url() const {
+    return "http://127.0.0.1:" + std::to_string(listenPort);
+}
+
+MockInfluxDB::Counters MockInfluxDB::counters() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return totals;
+}
+
+void MockInfluxDB::resetCounters() {
+    std::lock_guard<std::mutex> guard(lock);
+    totals = Counters();
+}
+
+void MockInfluxDB::acceptLoop() {
+    Bench::countAllocations(false);
+    while (!stopping.load()) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (stopping.load()) {
+            ::close(fd);
+            break;
+        }
+        totals.connections++;
+        connectionFds.push_back(fd);
+        connectionThreads.push_back(std::thread(&MockInfluxDB::serve, this, fd));
+    }
+}
+
+void MockInfluxDB::serve(int fd) {
+    Bench::countAllocations(false);
+    std::string data;
+    char chunk[16384];
+    bool keepAlive = true;
+
+    while (keepAlive && !stopping.load()) {
+        // Header block
+        size_t headerEnd;
+        while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                keepAlive = false;
+                break;
+            }
+            data.append(chunk, n);
+        }
+        if (!keepAlive) {
+            break;
+        }
+        std::string head = data.substr(0, headerEnd);
+        data.erase(0, headerEnd + 4);
+
+        // Body, with a length or in chunks
+        std::string body;
+        bool chunked = strncasecmp(headerValue(head, "Transfer-Encoding").c_str(), "chunked", 7) == 0;
+        size_t contentLength = strtoul(headerValue(head, "Content-Length").c_str(), nullptr, 10);
+        for (;;) {
+            size_t needed = contentLength;
+            size_t sizeEnd = std::string::npos;
+            if (chunked) {
+                // Size line, data and CRLF; the last chunk is empty and followed by an empty trailer
+                sizeEnd = data.find("\r\n");
+                size_t size = sizeEnd != std::string::npos ? strtoul(data.c_str(), nullptr, 16) : 0;
+                needed = sizeEnd != std::string::npos ? sizeEnd + 2 + size + 2 : data.size() + 1;
+            }
+            if (data.size() >= needed) {
+                if (!chunked) {
+                    body = data.substr(0, contentLength);
+                    data.erase(0, contentLength);
+                    break;
+                }
+                size_t size = needed - sizeEnd - 4;
+                body.append(data, sizeEnd + 2, size);
+                data.erase(0, needed);
+                if (size == 0) {
+                    break;
+                }
+                continue;
+            }
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                keepAlive = false;
+                break;
+            }
+            data.append(chunk, n);
+        }
+        if (!keepAlive) {
+            break;
+        }
+
+        keepAlive = strcasecmp(headerValue(head, "Connection").c_str(), "close") != 0;
+        if (!handle(fd, head, body, keepAlive)) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    connectionFds.erase(std::remove(connectionFds.begin(), connectionFds.end(), fd), connectionFds.end());
+    ::close(fd);
+}
+
+int MockInfluxDB::chooseStatus() {
+    std::lock_guard<std::mutex> guard(lock);
+    float draw = std::uniform_real_distribution<float>(0.0f, 1.0f)(generator);
+    if (draw < options.throttleRate) {
+        return 429;
+    }
+    if (draw < options.throttleRate + options.errorRate) {
+        return 500;
+    }
+    return 204;
+}
+
+bool MockInfluxDB::handle(int fd, const std::string& head, const std::string& body, bool keepAlive) {
+    uint32_t latency;
+    uint32_t retryAfter;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        latency = options.latency;
+        retryAfter = options.retryAfter;
+    }
+    if (latency > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(latency));
+    }
+
+    if (head.compare(0, 12, "GET /health ") == 0 || head.compare(0, 20, "GET /api/v2/health ") == 0) {
+        return respond(fd, 200, "OK", "Content-Type: application/json\r\n", "{\"status\":\"pass\"}", keepAlive);
+    }
+    if (head.compare(0, 19, "POST /api/v2/write?") != 0) {
+        return respond(fd, 404, "Not Found", "", "{\"code\":\"not found\"}", keepAlive);
+    }
+    if (headerValue(head, "Authorization").compare(0, 6, "Token ") != 0) {
+        return respond(fd, 401, "Unauthorized", "", "{\"code\":\"unauthorized\"}", keepAlive);
+    }
+
+    int status = chooseStatus();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        totals.requests++;
+        if (status == 429) {
+            totals.throttled++;
+        } else if (status == 500) {
+            totals.errors++;
+        } else {
+            bool gzip = strcasecmp(headerValue(head, "Content-Encoding").c_str(), "gzip") == 0;
+            bool chunked = strncasecmp(headerValue(head, "Transfer-Encoding").c_str(), "chunked", 7) == 0;
+            totals.accepted++;
+            totals.bytes += body.size();
+            if (chunked) {
+                totals.chunked++;
+            }
+            if (gzip) {
+                totals.compressed++;
+            } else {
+                totals.lines += std::count(body.begin(), body.end(), '\n');
+                // The last line of a payload need not end with a newline
+                if (!body.empty() && body.back() != '\n') {
+                    totals.lines++;
+                }
+            }
+        }
+    }
+
+    if (status == 429) {
+        char headers[48] = "";
+        if (retryAfter > 0) {
+            snprintf(headers, sizeof(headers), "Retry-After: %u\r\n", (unsigned)retryAfter);
+        }
+        return respond(fd, 429, "Too Many Requests", headers, "{\"code\":\"too many requests\"}", keepAlive);
+    }
+    if (status == 500) {
+        return respond(fd, 500, "Internal Server Error", "", "{\"code\":\"internal error\"}", keepAlive);
+    }
+    return respond(fd, 204, "No Content", "", "", keepAlive);
+}
@@ -0,0 +1,107 @@
+#ifndef LIGHTWEIGHT_IOT_MOCK_INFLUXDB_H
+#define LIGHTWEIGHT_IOT_MOCK_INFLUXDB_H
+
+/**
+ * @file MockInfluxDB.h
+ * @brief Loopback HTTP server answering like InfluxDB's write API
+ *
+ * Accepts POST /api/v2/write and GET /health on 127.0.0.1 and counts what
+ * it receives. Request bodies may come with a Content-Length or chunked. Failures can be injected: a fixed delay before each answer,
+ * a share of writes answered with 500, and a share answered with 429 and a
+ * Retry-After header. Faults are drawn from a seeded generator, so a run is
+ * repeatable.
+ *
+ * Each connection is served by its own thread and kept open between
+ * requests unless the client asks otherwise. The server's threads do not
+ * count towards Bench::allocations().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MockInfluxDB {
+public:
+    struct Options {
+        uint16_t port = 0;          ///< Port to listen on, 0 to pick a free one
+        uint32_t latency = 0;       ///< Delay before every answer (ms)
+        float errorRate = 0;        ///< Share of writes answered with 500 Internal Server Error
+        float throttleRate = 0;     ///< Share of writes answered with 429 Too Many Requests
+        uint32_t retryAfter = 0;    ///< Retry-After of 429 answers (s, 0 = no header)
+        uint32_t seed = 1;          ///< Seed of the fault generator
+    };
+
+    /**
+     * @brief What the server has received
+     *
+     * Lines are only counted for uncompressed bodies; gzip bodies count
+     * towards bytes only.
+     */
+    struct Counters {
+        uint64_t requests = 0;      ///< Write requests
+        uint64_t accepted = 0;      ///< Writes answered with 204
+        uint64_t errors = 0;        ///< Writes answered with 500
+        uint64_t throttled = 0;     ///< Writes answered with 429
+        uint64_t lines = 0;         ///< Lines in accepted uncompressed writes
+        uint64_t bytes = 0;         ///< Body bytes of accepted writes, as sent (without chunk framing)
+        uint64_t compressed = 0;    ///< Accepted writes with Content-Encoding: gzip
+        uint64_t chunked = 0;       ///< Accepted writes with Transfer-Encoding: chunked
+        uint64_t connections = 0;   ///< TCP connections accepted
+    };
+
+    MockInfluxDB();
+    ~MockInfluxDB();
+
+    MockInfluxDB(const MockInfluxDB&) = delete;
+    MockInfluxDB& operator=(const MockInfluxDB&) = delete;
+
+    /**
+     * @brief Starts listening and serving in the background
+     */
+    bool start(const Options& options);
+
+    /**
+     * @brief Closes the listening socket and all connections
+     */
+    void stop();
+
+    /**
+     * @brief Changes the fault injection of a running server
+     */
+    void setFaults(uint32_t latency, float errorRate, float throttleRate, uint32_t retryAfter);
+
+    uint16_t port() const { return listenPort; }
+
+    /**
+     * @brief Returns the base URL to pass to LightweightIoT::begin()
+     */
+    std::string url() const;
+
+    Counters counters() const;
+    void resetCounters();
+
+private:
+    void acceptLoop();
+    void serve(int fd);
+    bool handle(int fd, const std::string& head, const std::string& body, bool keepAlive);
+    int chooseStatus();
+
+    Options options;
+    int listenFd;
+    uint16_t listenPort;
+    std::atomic<bool> stopping;
+    std::thread acceptThread;
+    std::vector<std::thread> connectionThreads;
+    std::vector<int> connectionFds;
+    mutable std::mutex lock;  ///< Guards the fault options, generator, counters and connection lists
+    std::minstd_rand generator;
+    Counters totals;
+};
+
+#endif
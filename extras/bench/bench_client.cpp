@@ -0,0 +1,394 @@
+/*
+ * End-to-end benchmark of the write path against a loopback mock InfluxDB
+ *
+ * Each case writes points through a LightweightIoT client pointed at
+ * MockInfluxDB and waits until the server has received them, so the numbers
+ * include encoding, batching, compression, HTTP and retries. Bytes per point
+ * are bytes on the wire; allocations include the background sender but not
+ * the server. The run fails if a case loses points it should have delivered.
+ *
+ * The concurrent cases share one client between several writer threads,
+ * either through Config::ingestQueueSize or by serializing writePoint() with
+ * a mutex. The writers do not wait for the sender, so when they outrun it
+ * points are dropped; those are reported, and the rate counts delivered
+ * points until the last one has reached the server.
+ *
+ *   ./build/bench_client [--quick] [--filter NAME]
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Bench.h"
+#include "LightweightIoT.h"
+#include "MockInfluxDB.h"
+
+namespace {
+
+struct Case {
+    const char* name;
+    unsigned long points;       ///< Points to write
+    unsigned long batchPoints;  ///< Points per beginBatch()/endBatch() upload, 0 for none
+    uint32_t latency;           ///< Server delay per request (ms)
+    float errorRate;            ///< Share of requests answered with 500
+    float throttleRate;         ///< Share of requests answered with 429
+    uint32_t retryAfter;        ///< Retry-After of 429 answers (s)
+    bool lossy;                 ///< The writer may outrun the sender; drops are reported, not failures
+    void (*configure)(LightweightIoT::Config& config);
+    void (*setup)(LightweightIoT& iot);  ///< Called after begin(), nullptr for none
+    size_t block;               ///< Samples per writeSeries() call, 0 for one writePoint() per point
+};
+
+// The benchmark signal: a 0-9.9 sawtooth in steps of 0.1
+float sample(unsigned long i) {
+    return 20.0f + (float)(i % 100) / 10.0f;
+}
+
+// Writes points [i, i + count) as one block of 1 ms spaced samples. The
+// start is explicit since a block ending now would reach back before boot.
+void writeBlock(LightweightIoT& iot, unsigned long i, size_t count) {
+    static float values[1024];
+    for (size_t n = 0; n < count; n++) {
+        values[n] = sample(i + n);
+    }
+    iot.writeSeries("temperature", "value", values, count, 1700000000000ULL + i, 1);
+}
+
+LightweightIoT::Config baseConfig() {
+    LightweightIoT::Config config;
+    config.staticBufferSize = 65536;
+    config.retryDelay = 5;
+    config.maxRetryDelay = 50;
+    config.maxRetries = 8;
+    config.timeout = 2000;
+    return config;
+}
+
+// Flushes until every point has left the client. A flush is refused while
+// the background sender is busy, so it is repeated rather than left to loop().
+bool drain(LightweightIoT& iot) {
+    unsigned long deadline = millis() + 30000;
+    while (iot.getBatchSize() > 0 || iot.isSending() || iot.getNextRetryTime() != 0) {
+        if ((long)(millis() - deadline) >= 0) {
+            return false;
+        }
+        iot.flushBatch();
+        iot.loop();
+        delay(1);
+    }
+    return true;
+}
+
+void runCase(Bench& bench, MockInfluxDB& server, const Case& spec) {
+    if (!bench.selected(spec.name)) {
+        return;
+    }
+    server.setFaults(spec.latency, spec.errorRate, spec.throttleRate, spec.retryAfter);
+
+    LightweightIoT iot("bench-token", "bench-org", "bench-bucket");
+    LightweightIoT::Config config = baseConfig();
+    if (spec.configure != nullptr) {
+        spec.configure(config);
+    }
+    iot.setConfig(config);
+    iot.addTag("device", "esp32-01");
+    iot.addTag("building", "Building A");
+    iot.addTag("room", "Room-101");
+    if (!iot.begin(server.url())) {
+        bench.fail("begin() failed");
+        return;
+    }
+    if (spec.setup != nullptr) {
+        spec.setup(iot);
+    }
+    // Warm up the connection outside the measurement
+    iot.writePoint("warmup", "value", 1);
+    drain(iot);
+    server.resetCounters();
+    iot.resetStats();
+
+    bench.begin(spec.name);
+    for (unsigned long i = 0; i < spec.points && spec.block > 0; i += spec.block) {
+        writeBlock(iot, i, spec.points - i < spec.block ? spec.points - i : spec.block);
+    }
+    for (unsigned long i = 0; i < spec.points && spec.block == 0; i++) {
+        if (spec.batchPoints > 0 && i % spec.batchPoints == 0) {
+            iot.beginBatch();
+        }
+        iot.writePoint("temperature", "value", sample(i));
+        if (spec.batchPoints > 0 && (i + 1) % spec.batchPoints == 0) {
+            // Like a device that uploads every N samples, wait for a failed
+            // batch to go out before collecting the next one
+            iot.endBatch();
+            drain(iot);
+        }
+    }
+    bool drained = drain(iot);
+
+    MockInfluxDB::Counters received = server.counters();
+    LightweightIoT::Stats stats = iot.getStats();
+    // gzip bodies are not counted by the server, so those are counted by the client
+    uint64_t delivered = received.compressed > 0 ? spec.points - stats.pointsDropped : received.lines;
+    char note[128];
+    snprintf(note, sizeof(note), "requests=%llu retries=%u dropped=%u", (unsigned long long)received.requests,
+             stats.retries, stats.pointsDropped);
+    if (stats.pointsSuppressed > 0) {
+        snprintf(note + strlen(note), sizeof(note) - strlen(note), " suppressed=%u", stats.pointsSuppressed);
+    }
+    // Rates are per delivered point, so losing points shows up as a slowdown.
+    // Suppressed points count as handled: bytes per point are per sample taken.
+    Bench::Result result = bench.end((unsigned long)delivered + stats.pointsSuppressed, received.bytes, note);
+
+    if (!drained) {
+        bench.fail("points still queued after 30 s");
+    }
+    if (config.useStaticBuffer && config.transport != nullptr && result.allocationsPerPoint > 0) {
+        // Everything but the host HTTPClient runs out of the reserved region
+        bench.fail("%.3f heap allocations per point with a static buffer", result.allocationsPerPoint);
+    }
+    if (delivered + stats.pointsDropped + stats.pointsSuppressed != spec.points ||
+        (stats.pointsDropped > 0 && !spec.lossy)) {
+        bench.fail("%llu of %lu points delivered, %u dropped", (unsigned long long)delivered, spec.points,
+                   stats.pointsDropped);
+    }
+}
+
+void benchQueue(Bench& bench, const char* name, unsigned long iterations, void (*setup)(LightweightIoT& iot),
+                size_t block = 0) {
+    if (!bench.selected(name)) {
+        return;
+    }
+    LightweightIoT iot("bench-token", "bench-org", "bench-bucket");
+    iot.setConfig(baseConfig());
+    iot.addTag("device", "esp32-01");
+    iot.addTag("building", "Building A");
+    iot.addTag("room", "Room-101");
+    if (setup != nullptr) {
+        setup(iot);
+    }
+    iot.beginBatch();
+    iot.writePoint("warmup", "value", 1);
+    iot.clearBatch();
+
+    // Cleared before a write could fill the 64 KB batch and try to send it
+    size_t limit = block > 0 ? 65536 - block * 128 : 60000;
+    size_t bytes = 0;
+    bench.begin(name);
+    for (unsigned long i = 0; i < iterations; i += block > 0 ? block : 1) {
+        if (block > 0) {
+            writeBlock(iot, i, iterations - i < block ? iterations - i : block);
+        } else {
+            iot.writePoint("temperature", "value", sample(i));
+        }
+        if (iot.getBatchBytes() > limit) {
+            bytes += iot.getBatchBytes();
+            iot.clearBatch();
+        }
+    }
+    bytes += iot.getBatchBytes();
+    // Per point written, whether it was queued, suppressed or folded into a window
+    Bench::Result result = bench.end(iterations, bytes);
+    if (result.allocationsPerPoint > 0) {
+        bench.fail("%.3f allocations per queued point", result.allocationsPerPoint);
+    }
+}
+
+// Several threads write through one client; the background sender uploads
+void benchConcurrent(Bench& bench, MockInfluxDB& server, unsigned writers, unsigned long perWriter, bool queued) {
+    char name[48];
+    snprintf(name, sizeof(name), "%u writers, %s", writers, queued ? "ingest queue" : "mutex");
+    if (!bench.selected(name)) {
+        return;
+    }
+    server.setFaults(0, 0, 0, 0);
+
+    PosixTransport transport;
+    LightweightIoT iot("bench-token", "bench-org", "bench-bucket");
+    LightweightIoT::Config config = baseConfig();
+    config.transport = &transport;
+    config.asyncSend = true;
+    config.flushBytes = 16384;
+    config.ingestQueueSize = queued ? 4096 : 0;
+    config.maxPointSize = 128;
+    iot.setConfig(config);
+    iot.addTag("device", "gateway-01");
+    iot.addTag("site", "Plant 3");
+    if (!iot.begin(server.url())) {
+        bench.fail("begin() failed");
+        return;
+    }
+    server.resetCounters();
+
+    std::mutex lock;
+    std::vector<std::thread> threads;
+    bench.begin(name);
+    for (unsigned w = 0; w < writers; w++) {
+        threads.push_back(std::thread([&, w]() {
+            char field[16];
+            snprintf(field, sizeof(field), "sensor%u", w);
+            for (unsigned long i = 0; i < perWriter; i++) {
+                if (queued) {
+                    iot.writePoint("temperature", field, sample(i));
+                } else {
+                    std::lock_guard<std::mutex> guard(lock);
+                    iot.writePoint("temperature", field, sample(i));
+                }
+            }
+        }));
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // Every point is either delivered or counted as dropped
+    unsigned long deadline = millis() + 30000;
+    unsigned long offered = writers * perWriter;
+    while (server.counters().lines + iot.getStats().pointsDropped < offered && (long)(millis() - deadline) < 0) {
+        iot.flushBatch();
+        iot.loop();
+        delay(1);
+    }
+    MockInfluxDB::Counters received = server.counters();
+    LightweightIoT::Stats stats = iot.getStats();
+    char note[96];
+    snprintf(note, sizeof(note), "requests=%llu dropped=%u", (unsigned long long)received.requests,
+             stats.pointsDropped);
+    bench.end((unsigned long)received.lines, received.bytes, note);
+
+    if (received.lines + stats.pointsDropped != offered) {
+        bench.fail("%llu of %lu points delivered, %u dropped", (unsigned long long)received.lines, offered,
+                   stats.pointsDropped);
+    }
+}
+
+void flushBySize(LightweightIoT::Config& config) {
+    config.flushBytes = 16384;
+}
+
+void secondPrecision(LightweightIoT::Config& config) {
+    config.flushBytes = 16384;
+    config.writePrecision = LightweightIoT::SECONDS;
+}
+
+void serverTimestamps(LightweightIoT::Config& config) {
+    config.flushBytes = 16384;
+    config.serverTimestamps = true;
+}
+
+// sample() moves by 0.1 per point
+void deadband(LightweightIoT& iot) {
+    iot.setDeadband("temperature", "value", LightweightIoT::Deadband(0.5f, 0, 60000));
+}
+
+void aggregate(LightweightIoT& iot) {
+    iot.setAggregation("temperature", "value", 100, true);
+}
+
+void columnar(LightweightIoT::Config& config) {
+    config.flushBytes = 16384;
+    config.columnBatchSize = 16384;
+}
+
+void holdRaw(LightweightIoT& iot) {
+    LightweightIoT::Config config = iot.getConfig();
+    config.columnBatchSize = 65536;
+    iot.setConfig(config);
+}
+
+void compressed(LightweightIoT::Config& config) {
+    config.flushBytes = 16384;
+    config.compress = true;
+}
+
+void background(LightweightIoT::Config& config) {
+    config.flushBytes = 16384;
+    config.asyncSend = true;
+}
+
+void singleConnection(LightweightIoT::Config& config) {
+    config.keepAlive = false;
+}
+
+PosixTransport posixTransport;
+
+void posix(LightweightIoT::Config& config) {
+    config.transport = &posixTransport;
+}
+
+void posixFlushBySize(LightweightIoT::Config& config) {
+    flushBySize(config);
+    posix(config);
+}
+
+void posixStaticGzip(LightweightIoT::Config& config) {
+    compressed(config);
+    posix(config);
+    config.useStaticBuffer = true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Bench bench(argc, argv);
+    WiFi.begin();
+
+    MockInfluxDB server;
+    MockInfluxDB::Options options;
+    if (!server.start(options)) {
+        fprintf(stderr, "cannot start the mock server\n");
+        return 1;
+    }
+    printf("mock InfluxDB at %s\n", server.url().c_str());
+
+    bench.section("Batch queue (no network)");
+    unsigned long queued = bench.iterations(1000000);
+    benchQueue(bench, "writePoint into batch", queued, nullptr);
+    benchQueue(bench, "writePoint, 0.5 deadband", queued, deadband);
+    benchQueue(bench, "writePoint, 100 ms windows", queued, aggregate);
+    benchQueue(bench, "writePoint, columnar batch", queued, holdRaw);
+    benchQueue(bench, "writeSeries, 256-sample blocks", queued, nullptr, 256);
+
+    unsigned long single = bench.iterations(20000);
+    unsigned long batched = bench.iterations(200000);
+    unsigned long faulty = bench.iterations(50000);
+    Case cases[] = {
+        {"single writes keep-alive", single, 0, 0, 0, 0, 0, false, nullptr, nullptr, 0},
+        {"single writes reconnect", single / 4, 0, 0, 0, 0, 0, false, singleConnection, nullptr, 0},
+        {"flushBatch every 500", batched, 500, 0, 0, 0, 0, false, nullptr, nullptr, 0},
+        {"auto flush 16 KB", batched, 0, 0, 0, 0, 0, false, flushBySize, nullptr, 0},
+        {"auto flush 16 KB precision=s", batched, 0, 0, 0, 0, 0, false, secondPrecision, nullptr, 0},
+        {"auto flush 16 KB server time", batched, 0, 0, 0, 0, 0, false, serverTimestamps, nullptr, 0},
+        {"auto flush 16 KB deadband 0.5", batched, 0, 0, 0, 0, 0, false, flushBySize, deadband, 0},
+        {"auto flush 16 KB gzip", batched, 0, 0, 0, 0, 0, false, compressed, nullptr, 0},
+        {"auto flush 16 KB columnar", batched, 0, 0, 0, 0, 0, false, columnar, nullptr, 0},
+        {"auto flush 16 KB writeSeries", batched, 0, 0, 0, 0, 0, false, flushBySize, nullptr, 1000},
+        {"auto flush 16 KB async", batched, 0, 0, 0, 0, 0, true, background, nullptr, 0},
+        {"single writes POSIX", single, 0, 0, 0, 0, 0, false, posix, nullptr, 0},
+        {"flushBatch every 500 POSIX", batched, 500, 0, 0, 0, 0, false, posix, nullptr, 0},
+        {"auto flush 16 KB POSIX", batched, 0, 0, 0, 0, 0, false, posixFlushBySize, nullptr, 0},
+        {"static buffer gzip POSIX", batched, 0, 0, 0, 0, 0, false, posixStaticGzip, nullptr, 0},
+        {"latency 5 ms, batch 500", faulty, 500, 5, 0, 0, 0, false, nullptr, nullptr, 0},
+        {"latency 5 ms, async", faulty, 0, 5, 0, 0, 0, true, background, nullptr, 0},
+        {"10% 500 errors, batch 500", faulty, 500, 0, 0.1f, 0, 0, false, nullptr, nullptr, 0},
+        {"10% 429, batch 500", faulty, 500, 0, 0, 0.1f, bench.quick() ? 0u : 1u, false, nullptr, nullptr, 0},
+    };
+
+    bench.section("End-to-end against the mock /api/v2/write");
+    for (const Case& spec : cases) {
+        runCase(bench, server, spec);
+    }
+
+    bench.section("Concurrent writers (POSIX transport, 16 KB flushes)");
+    unsigned long perWriter = bench.iterations(200000);
+    for (unsigned writers = 1; writers <= 8; writers *= 2) {
+        benchConcurrent(bench, server, writers, perWriter, false);
+        benchConcurrent(bench, server, writers, perWriter, true);
+    }
+
+    server.stop();
+    return bench.exitCode();
+}
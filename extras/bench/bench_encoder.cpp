@@ -0,0 +1,183 @@
+/*
+ * Host-side benchmark for the line protocol encoder
+ *
+ * Measures escaping, every encodePoint overload, compile-time series,
+ * tag-heavy points and number formatting, and reports points per second,
+ * bytes per point and heap allocations per point. Encoding a point must not
+ * allocate; the run fails if it does.
+ *
+ * Build and run from the library root (see CMakeLists.txt):
+ *   cmake -S . -B build && cmake --build build
+ *   ./build/bench_encoder [--quick] [--filter NAME]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Bench.h"
+#include "LightweightIoT.h"
+#include "LightweightIoTSchema.h"
+
+LWIOT_FIELD(BenchVoltage, "voltage", float);
+LWIOT_FIELD(BenchCurrent, "current", float);
+LWIOT_FIELD(BenchCycles, "cycles", int);
+LWIOT_FIELD(BenchRelay, "relay", bool);
+LWIOT_SERIES(BenchEnergy, "energy", BenchVoltage, BenchCurrent, BenchCycles, BenchRelay);
+
+static const uint64_t TIMESTAMP = 1700000000000000000ULL;
+
+// Times `iterations` encodes of one point; encoders return the encoded length
+template <typename Encode>
+static void encodeCase(Bench& bench, const char* name, unsigned long iterations, Encode encode,
+                       bool allocationFree = true) {
+    if (!bench.selected(name)) {
+        return;
+    }
+    // The first call renders the cached tag set
+    encode(0);
+    size_t bytes = 0;
+    bench.begin(name);
+    for (unsigned long i = 0; i < iterations; i++) {
+        bytes += encode(i);
+    }
+    Bench::Result result = bench.end(iterations, bytes);
+    if (bytes == 0) {
+        bench.fail("nothing was encoded");
+    }
+    if (allocationFree && result.allocationsPerPoint > 0) {
+        bench.fail("%.3f allocations per point", result.allocationsPerPoint);
+    }
+}
+
+static void benchEscaping(Bench& bench, unsigned long iterations) {
+    static char buffer[256];
+    struct {
+        const char* name;
+        const char* text;
+        LineProtocol::EscapeContext context;
+    } cases[] = {
+        {"escape string plain", "status report from the north-east wing pump controller: nominal",
+         LineProtocol::ESCAPE_STRING},
+        {"escape string quoted", "controller said \"pressure nominal\" at C:\\plant\\pump-7 after restart",
+         LineProtocol::ESCAPE_STRING},
+        {"escape tag value", "Building A, North Wing=East", LineProtocol::ESCAPE_KEY},
+        {"escape measurement", "power meter,phase 1", LineProtocol::ESCAPE_MEASUREMENT},
+    };
+
+    bench.section("Escaping (one point = one string)");
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        const char* text = cases[c].text;
+        size_t length = strlen(text);
+        LineProtocol::EscapeContext context = cases[c].context;
+        encodeCase(bench, cases[c].name, iterations, [&](unsigned long) {
+            return (size_t)(LineProtocol::escape(buffer, text, length, context) - buffer);
+        });
+    }
+}
+
+static void benchEncoding(Bench& bench, unsigned long iterations) {
+    static char buffer[1024];
+    bench.section("Encoding");
+
+    LineProtocol::Tag tags[] = {
+        {"device", "esp32-01"},
+        {"building", "Building A"},
+        {"room", "Room-101"},
+    };
+    char tagSet[128];
+    size_t tagSetLength = LineProtocol::renderTagSet(tagSet, sizeof(tagSet), tags, 3);
+    encodeCase(bench, "LineProtocol::encode", iterations, [&](unsigned long i) {
+        LineProtocol::Field field("value", 20.0f + (float)(i % 100) / 10.0f);
+        return LineProtocol::encode(buffer, sizeof(buffer), "temperature", tagSet, tagSetLength, &field, 1,
+                                    TIMESTAMP + i);
+    });
+
+    LightweightIoT iot("token", "org", "bucket");
+    iot.addTag("device", "esp32-01");
+    iot.addTag("building", "Building A");
+    iot.addTag("room", "Room-101");
+
+    encodeCase(bench, "encodePoint float", iterations, [&](unsigned long i) {
+        return iot.encodePoint(buffer, sizeof(buffer), "temperature", "value", 20.0f + (float)(i % 100) / 10.0f);
+    });
+    encodeCase(bench, "encodePoint Measurement", iterations, [&](unsigned long i) {
+        // Interned names, escaped once when the record was built
+        LightweightIoT::Measurement sample("temperature", "value", 20.0f + (float)(i % 100) / 10.0f);
+        return iot.encodePoint(buffer, sizeof(buffer), sample);
+    });
+    encodeCase(bench, "encodePoint int", iterations, [&](unsigned long i) {
+        return iot.encodePoint(buffer, sizeof(buffer), "counter", "value", (int)i);
+    });
+    encodeCase(bench, "encodePoint string", iterations, [&](unsigned long) {
+        return iot.encodePoint(buffer, sizeof(buffer), "status", "state", "pump \"7\" nominal");
+    });
+    encodeCase(bench, "encodePoint Point 4 fields", iterations, [&](unsigned long i) {
+        LightweightIoT::Point point("energy");
+        point.addField("voltage", 230.0f + (float)(i % 50) / 10.0f)
+            .addField("current", 1.25f)
+            .addField("cycles", (int)i)
+            .addField("relay", (i & 1) != 0);
+        return iot.encodePoint(buffer, sizeof(buffer), point);
+    });
+    encodeCase(bench, "Series::encode 4 fields", iterations, [&](unsigned long i) {
+        return BenchEnergy::encode(iot, buffer, sizeof(buffer), TIMESTAMP + i, 230.0f + (float)(i % 50) / 10.0f,
+                                   1.25f, (int)i, (i & 1) != 0);
+    });
+
+    // Tag-heavy points: the tag set is rendered once and copied into every point
+    LightweightIoT tagged("token", "org", "bucket");
+    const char* keys[] = {"device", "type", "building", "floor", "room", "zone", "rack", "line", "firmware", "site"};
+    const char* values[] = {"esp32-01", "power meter", "Building A", "Floor 3", "Room-101",
+                            "Zone,North", "R12", "L=4", "1.4.2", "Johannesburg Plant"};
+    for (int t = 0; t < 10; t++) {
+        tagged.addTag(keys[t], values[t]);
+    }
+    encodeCase(bench, "encodePoint 10 tags", iterations, [&](unsigned long i) {
+        return tagged.encodePoint(buffer, sizeof(buffer), "power", "watts", 500.0f + (float)(i % 100));
+    });
+
+    // Changing the tags re-renders the set on the next point; that path may allocate
+    encodeCase(bench, "retag + encode 10 tags", bench.iterations(100000), [&](unsigned long i) {
+        tagged.clearTags();
+        for (int t = 0; t < 10; t++) {
+            tagged.addTag(keys[t], values[t]);
+        }
+        return tagged.encodePoint(buffer, sizeof(buffer), "power", "watts", 500.0f + (float)(i % 100));
+    }, false);
+}
+
+static void benchNumbers(Bench& bench, unsigned long iterations) {
+    static char buffer[64];
+    static float values[256];
+    for (int i = 0; i < 256; i++) {
+        values[i] = (float)(rand() % 100000) / 37.0f - 1000.0f;
+    }
+
+    bench.section("Number formatting (one point = one value)");
+    encodeCase(bench, "formatFloat shortest", iterations, [&](unsigned long i) {
+        return LineProtocol::formatFloat(buffer, values[i & 255], LineProtocol::PRECISION_SHORTEST);
+    });
+    encodeCase(bench, "formatFloat 2 decimals", iterations, [&](unsigned long i) {
+        return LineProtocol::formatFloat(buffer, values[i & 255], 2);
+    });
+    encodeCase(bench, "snprintf %.9g", iterations, [&](unsigned long i) {
+        return (size_t)snprintf(buffer, sizeof(buffer), "%.9g", (double)values[i & 255]);
+    }, false);
+    encodeCase(bench, "formatInt", iterations, [&](unsigned long i) {
+        return LineProtocol::formatInt(buffer, (long)(i * 2654435761UL) - 1000000);
+    });
+    encodeCase(bench, "formatUInt timestamp", iterations, [&](unsigned long i) {
+        return LineProtocol::formatUInt(buffer, TIMESTAMP + i * 7919);
+    });
+}
+
+int main(int argc, char** argv) {
+    Bench bench(argc, argv);
+    unsigned long iterations = bench.iterations(1000000);
+
+    benchEscaping(bench, iterations);
+    benchEncoding(bench, iterations);
+    benchNumbers(bench, iterations);
+    return bench.exitCode();
+}
@@ -0,0 +1,74 @@
+/*
+ * Standalone mock InfluxDB server
+ *
+ * Serves the loopback write API of MockInfluxDB until interrupted, printing
+ * what it received once per second. Useful for pointing a sketch built for
+ * the host, or curl, at a server with controlled latency and failures:
+ *
+ *   ./mock_influxdb --port 8086 --latency 20 --errors 0.05 --throttle 0.1 --retry-after 1
+ *   curl -i -H "Authorization: Token x" --data-binary "m v=1" "http://127.0.0.1:8086/api/v2/write?org=o&bucket=b"
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "MockInfluxDB.h"
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int) {
+    interrupted = 1;
+}
+
+int main(int argc, char** argv) {
+    MockInfluxDB::Options options;
+    options.port = 8086;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--port") == 0) {
+            options.port = (uint16_t)atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            options.latency = (uint32_t)atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--errors") == 0) {
+            options.errorRate = (float)atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--throttle") == 0) {
+            options.throttleRate = (float)atof(argv[i + 1]);
+        } else if (strcmp(argv[i], "--retry-after") == 0) {
+            options.retryAfter = (uint32_t)atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            options.seed = (uint32_t)atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "usage: %s [--port N] [--latency ms] [--errors rate] [--throttle rate] "
+                            "[--retry-after s] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    MockInfluxDB server;
+    if (!server.start(options)) {
+        fprintf(stderr, "cannot listen on port %u\n", (unsigned)options.port);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    printf("listening on %s\n", server.url().c_str());
+
+    MockInfluxDB::Counters last;
+    while (!interrupted) {
+        sleep(1);
+        MockInfluxDB::Counters now = server.counters();
+        if (now.requests != last.requests) {
+            printf("requests %llu (204: %llu, 500: %llu, 429: %llu), lines %llu, bytes %llu, connections %llu\n",
+                   (unsigned long long)now.requests, (unsigned long long)now.accepted,
+                   (unsigned long long)now.errors, (unsigned long long)now.throttled,
+                   (unsigned long long)now.lines, (unsigned long long)now.bytes,
+                   (unsigned long long)now.connections);
+            fflush(stdout);
+        }
+        last = now;
+    }
+    server.stop();
+    return 0;
+}
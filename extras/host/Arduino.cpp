@@ -0,0 +1,58 @@
+#include "Arduino.h"
+
+#include <stdarg.h>
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+HostSerial Serial;
+
+namespace {
+
+const std::chrono::steady_clock::time_point startedAt = std::chrono::steady_clock::now();
+
+std::minstd_rand& generator() {
+    static std::minstd_rand engine;
+    return engine;
+}
+
+} // namespace
+
+unsigned long millis() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - startedAt).count();
+}
+
+unsigned long micros() {
+    return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - startedAt).count();
+}
+
+void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+long random(long max) {
+    return max > 0 ? (long)(generator()() % (unsigned long)max) : 0;
+}
+
+long random(long min, long max) {
+    return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+    generator().seed(seed);
+}
+
+int HostSerial::printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vprintf(format, args);
+    va_end(args);
+    return written;
+}
@@ -0,0 +1,83 @@
+#ifndef LIGHTWEIGHT_IOT_HOST_ARDUINO_H
+#define LIGHTWEIGHT_IOT_HOST_ARDUINO_H
+
+/**
+ * @file Arduino.h
+ * @brief Minimal Arduino core for host builds
+ *
+ * Provides the timing, random number, Stream and Serial parts the library uses,
+ * so it can be compiled and measured on a development machine. Strings are
+ * std::string on host builds (see LightweightIoT.h).
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+/**
+ * @brief Byte source, as HTTPClient::sendRequest() reads a request body from
+ *
+ * Only the reading side of the Arduino Stream; write() stands in for Print.
+ */
+class Stream {
+public:
+    virtual ~Stream() {}
+
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t write(uint8_t value) = 0;
+
+    virtual size_t readBytes(char* buffer, size_t length) {
+        size_t n = 0;
+        int value;
+        while (n < length && (value = read()) >= 0) {
+            buffer[n++] = (char)value;
+        }
+        return n;
+    }
+};
+
+/**
+ * @brief Serial port writing to standard output
+ */
+class HostSerial {
+public:
+    void begin(unsigned long) {}
+
+    void print(const char* value) { fputs(value, stdout); }
+    void print(const std::string& value) { fputs(value.c_str(), stdout); }
+    void print(char value) { fputc(value, stdout); }
+    void print(long value) { printf("%ld", value); }
+    void print(unsigned long value) { printf("%lu", value); }
+    void print(int value) { print((long)value); }
+    void print(unsigned int value) { print((unsigned long)value); }
+    void print(double value) { printf("%.2f", value); }
+
+    template <typename T>
+    void println(const T& value) {
+        print(value);
+        println();
+    }
+    void println() { fputc('\n', stdout); }
+
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,219 @@
+#include "HTTPClient.h"
+
+#include <strings.h>
+
+HTTPClient::HTTPClient()
+    : client(nullptr), reuse(true), serverKeepAlive(false), timeoutMs(5000), port(0) {}
+
+HTTPClient::~HTTPClient() {
+    end();
+}
+
+bool HTTPClient::begin(WiFiClient& client, const std::string& url) {
+    requestHeaders.clear();
+    responseHeaders.clear();
+    body.clear();
+
+    size_t hostStart;
+    if (url.compare(0, 7, "http://") == 0) {
+        hostStart = 7;
+        port = 80;
+    } else if (url.compare(0, 8, "https://") == 0) {
+        // No TLS on host builds; the scheme only selects the default port
+        hostStart = 8;
+        port = 443;
+    } else {
+        return false;
+    }
+    size_t pathStart = url.find('/', hostStart);
+    std::string authority = url.substr(hostStart, pathStart == std::string::npos ? std::string::npos
+                                                                                   : pathStart - hostStart);
+    path = pathStart == std::string::npos ? "/" : url.substr(pathStart);
+
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos) {
+        port = (uint16_t)strtoul(authority.c_str() + colon + 1, nullptr, 10);
+        authority.resize(colon);
+    }
+    if (authority.empty() || port == 0) {
+        return false;
+    }
+    if (authority != host && client.connected()) {
+        client.stop();
+    }
+    host = authority;
+    this->client = &client;
+    return true;
+}
+
+bool HTTPClient::begin(const std::string& url) {
+    return begin(ownClient, url);
+}
+
+void HTTPClient::end() {
+    if (client != nullptr && (!reuse || !serverKeepAlive)) {
+        client->stop();
+    }
+    requestHeaders.clear();
+}
+
+void HTTPClient::addHeader(const std::string& name, const std::string& value) {
+    requestHeaders += name;
+    requestHeaders += ": ";
+    requestHeaders += value;
+    requestHeaders += "\r\n";
+}
+
+void HTTPClient::collectHeaders(const char* keys[], size_t count) {
+    collectKeys.assign(keys, keys + count);
+}
+
+std::string HTTPClient::header(const char* name) const {
+    for (const std::pair<std::string, std::string>& entry : responseHeaders) {
+        if (strcasecmp(entry.first.c_str(), name) == 0) {
+            return entry.second;
+        }
+    }
+    return std::string();
+}
+
+int HTTPClient::POST(uint8_t* payload, size_t length) {
+    return sendPayload("POST", payload, length);
+}
+
+int HTTPClient::POST(const std::string& payload) {
+    return sendPayload("POST", (const uint8_t*)payload.data(), payload.size());
+}
+
+int HTTPClient::GET() {
+    return sendPayload("GET", nullptr, 0);
+}
+
+int HTTPClient::sendPayload(const char* method, const uint8_t* payload, size_t length) {
+    int code = sendHead(method, length);
+    if (code < 0) {
+        return code;
+    }
+    if (length > 0 && client->write(payload, length) != length) {
+        client->stop();
+        return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+    }
+    return finishRequest();
+}
+
+int HTTPClient::sendRequest(const char* type, Stream* stream, size_t size) {
+    int code = sendHead(type, size);
+    if (code < 0) {
+        return code;
+    }
+    // Written in TCP segment sized pieces, like the ESP32 client
+    uint8_t chunk[1460];
+    while (size > 0) {
+        int available = stream->available();
+        size_t n = 0;
+        if (available > 0) {
+            n = stream->readBytes((char*)chunk, (size_t)available < sizeof(chunk) ? (size_t)available : sizeof(chunk));
+        }
+        if (n == 0 || n > size || client->write(chunk, n) != n) {
+            client->stop();
+            return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+        }
+        size -= n;
+    }
+    return finishRequest();
+}
+
+int HTTPClient::sendHead(const char* method, size_t length) {
+    responseHeaders.clear();
+    body.clear();
+    if (client == nullptr) {
+        return HTTPC_ERROR_NOT_CONNECTED;
+    }
+    client->setTimeout(timeoutMs);
+    if (!client->connected() && !client->connect(host.c_str(), port)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+
+    char line[160];
+    snprintf(line, sizeof(line), "%s %s HTTP/1.1\r\nHost: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n",
+             method, path.c_str(), host.c_str(), length, reuse ? "keep-alive" : "close");
+    std::string head = line;
+    head += requestHeaders;
+    head += "\r\n";
+    if (client->write((const uint8_t*)head.data(), head.size()) != head.size()) {
+        client->stop();
+        return HTTPC_ERROR_SEND_HEADER_FAILED;
+    }
+    return 0;
+}
+
+int HTTPClient::finishRequest() {
+    int code = readResponse();
+    if (code < 0) {
+        client->stop();
+    }
+    return code;
+}
+
+int HTTPClient::readResponse() {
+    // Read up to the end of the header block
+    std::string data;
+    size_t headerEnd;
+    uint8_t chunk[1024];
+    while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos) {
+        size_t n = client->read(chunk, sizeof(chunk));
+        if (n == 0) {
+            return data.empty() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+        }
+        data.append((const char*)chunk, n);
+    }
+
+    int code = 0;
+    if (sscanf(data.c_str(), "HTTP/1.%*d %d", &code) != 1) {
+        return HTTPC_ERROR_CONNECTION_LOST;
+    }
+
+    long contentLength = -1;
+    serverKeepAlive = true;
+    size_t lineStart = data.find("\r\n") + 2;
+    while (lineStart < headerEnd) {
+        size_t lineEnd = data.find("\r\n", lineStart);
+        size_t colon = data.find(':', lineStart);
+        if (colon != std::string::npos && colon < lineEnd) {
+            std::string name = data.substr(lineStart, colon - lineStart);
+            size_t valueStart = data.find_first_not_of(' ', colon + 1);
+            std::string value = data.substr(valueStart, lineEnd - valueStart);
+            if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+                contentLength = strtol(value.c_str(), nullptr, 10);
+            } else if (strcasecmp(name.c_str(), "Connection") == 0 && strcasecmp(value.c_str(), "close") == 0) {
+                serverKeepAlive = false;
+            }
+            for (const std::string& key : collectKeys) {
+                if (strcasecmp(key.c_str(), name.c_str()) == 0) {
+                    responseHeaders.push_back(std::make_pair(name, value));
+                }
+            }
+        }
+        lineStart = lineEnd + 2;
+    }
+
+    body = data.substr(headerEnd + 4);
+    if (contentLength < 0) {
+        // No length: the body runs until the server closes the connection
+        serverKeepAlive = false;
+        size_t n;
+        while ((n = client->read(chunk, sizeof(chunk))) > 0) {
+            body.append((const char*)chunk, n);
+        }
+        return code;
+    }
+    while (body.size() < (size_t)contentLength) {
+        size_t n = client->read(chunk, sizeof(chunk));
+        if (n == 0) {
+            return HTTPC_ERROR_CONNECTION_LOST;
+        }
+        body.append((const char*)chunk, n);
+    }
+    body.resize(contentLength);
+    return code;
+}
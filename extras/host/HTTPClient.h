@@ -0,0 +1,96 @@
+#ifndef LIGHTWEIGHT_IOT_HOST_HTTP_CLIENT_H
+#define LIGHTWEIGHT_IOT_HOST_HTTP_CLIENT_H
+
+/**
+ * @file HTTPClient.h
+ * @brief HTTP/1.1 client for host builds
+ *
+ * Implements the subset of the ESP32 HTTPClient API the library uses, over
+ * WiFiClient, including keep-alive reuse of the connection between requests.
+ * The whole response is read by POST()/GET(), so the connection is ready for
+ * the next request as soon as they return.
+ */
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "WiFi.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+class HTTPClient {
+public:
+    HTTPClient();
+    ~HTTPClient();
+
+    HTTPClient(const HTTPClient&) = delete;
+    HTTPClient& operator=(const HTTPClient&) = delete;
+
+    /**
+     * @brief Prepares a request to an http:// URL over the given client
+     */
+    bool begin(WiFiClient& client, const std::string& url);
+
+    /**
+     * @brief Prepares a request over a connection owned by the HTTPClient
+     */
+    bool begin(const std::string& url);
+
+    /**
+     * @brief Finishes the request; the connection stays open if it can be reused
+     */
+    void end();
+
+    void setReuse(bool reuse) { this->reuse = reuse; }
+    void setTimeout(uint16_t timeoutMs) { this->timeoutMs = timeoutMs; }
+    void addHeader(const std::string& name, const std::string& value);
+    void collectHeaders(const char* keys[], size_t count);
+
+    /**
+     * @brief Returns a response header requested with collectHeaders()
+     */
+    std::string header(const char* name) const;
+
+    int POST(uint8_t* payload, size_t length);
+    int POST(const std::string& payload);
+    int GET();
+
+    /**
+     * @brief Sends a request whose body of `size` bytes is read from a stream as it is written
+     *
+     * As on ESP32, the stream ends the body early by returning -1 from available().
+     */
+    int sendRequest(const char* type, Stream* stream, size_t size);
+
+    /**
+     * @brief Returns the body of the last response
+     */
+    std::string getString() const { return body; }
+
+private:
+    int sendPayload(const char* method, const uint8_t* payload, size_t length);
+    int sendHead(const char* method, size_t length);
+    int finishRequest();
+    int readResponse();
+
+    WiFiClient* client;
+    WiFiClient ownClient;
+    bool reuse;
+    bool serverKeepAlive;
+    uint16_t timeoutMs;
+    std::string host;
+    uint16_t port;
+    std::string path;
+    std::string requestHeaders;
+    std::vector<std::string> collectKeys;
+    std::vector<std::pair<std::string, std::string>> responseHeaders;
+    std::string body;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "WiFi.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiClass WiFi;
+
+WiFiClient::WiFiClient() : fd(-1), timeoutMs(5000) {}
+
+WiFiClient::~WiFiClient() {
+    stop();
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    stop();
+    char service[8];
+    snprintf(service, sizeof(service), "%u", (unsigned)port);
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+        return 0;
+    }
+    for (addrinfo* address = addresses; address != nullptr && fd < 0; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        return 0;
+    }
+    // Requests are written in one piece; do not hold back the last segment
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 1;
+}
+
+bool WiFiClient::connected() {
+    if (fd < 0) {
+        return false;
+    }
+    // A readable socket with nothing to read has been closed by the peer
+    pollfd entry = {fd, POLLIN, 0};
+    if (poll(&entry, 1, 0) > 0) {
+        char probe;
+        ssize_t n = recv(fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+void WiFiClient::stop() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+size_t WiFiClient::write(const uint8_t* data, size_t length) {
+    size_t written = 0;
+    while (fd >= 0 && written < length) {
+        ssize_t n = send(fd, data + written, length - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        written += n;
+    }
+    return written;
+}
+
+size_t WiFiClient::read(uint8_t* data, size_t length) {
+    if (fd < 0) {
+        return 0;
+    }
+    pollfd entry = {fd, POLLIN, 0};
+    if (poll(&entry, 1, (int)timeoutMs) <= 0) {
+        return 0;
+    }
+    ssize_t n = recv(fd, data, length, 0);
+    return n > 0 ? (size_t)n : 0;
+}
@@ -0,0 +1,71 @@
+#ifndef LIGHTWEIGHT_IOT_HOST_WIFI_H
+#define LIGHTWEIGHT_IOT_HOST_WIFI_H
+
+/**
+ * @file WiFi.h
+ * @brief WiFi and TCP client for host builds
+ *
+ * The link is reported as up once WiFi.begin() has been called, so code that
+ * never calls it sees the same NOT_CONNECTED behaviour as a device without
+ * WiFi. WiFiClient is a blocking POSIX TCP socket.
+ */
+
+#include "Arduino.h"
+
+enum wl_status_t {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+};
+
+class WiFiClass {
+public:
+    WiFiClass() : linkStatus(WL_IDLE_STATUS) {}
+
+    wl_status_t begin(const char* = nullptr, const char* = nullptr) {
+        linkStatus = WL_CONNECTED;
+        return linkStatus;
+    }
+    bool disconnect() {
+        linkStatus = WL_DISCONNECTED;
+        return true;
+    }
+    wl_status_t status() const { return linkStatus; }
+
+private:
+    wl_status_t linkStatus;
+};
+
+extern WiFiClass WiFi;
+
+class WiFiClient {
+public:
+    WiFiClient();
+    virtual ~WiFiClient();
+
+    WiFiClient(const WiFiClient&) = delete;
+    WiFiClient& operator=(const WiFiClient&) = delete;
+
+    int connect(const char* host, uint16_t port);
+    bool connected();
+    void stop();
+
+    /**
+     * @brief Writes all bytes, or fails
+     */
+    size_t write(const uint8_t* data, size_t length);
+
+    /**
+     * @brief Reads up to length bytes, waiting at most the timeout for the first one
+     * @return Bytes read, 0 on timeout or when the peer closed the connection
+     */
+    size_t read(uint8_t* data, size_t length);
+
+    void setTimeout(unsigned long ms) { timeoutMs = ms; }
+
+private:
+    int fd;
+    unsigned long timeoutMs;
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef LIGHTWEIGHT_IOT_HOST_WIFI_CLIENT_SECURE_H
+#define LIGHTWEIGHT_IOT_HOST_WIFI_CLIENT_SECURE_H
+
+#include "WiFi.h"
+
+/**
+ * @brief TLS client stand-in for host builds
+ *
+ * There is no TLS on host builds: connections are plain TCP. Benchmarks run
+ * against the local mock server over http://.
+ */
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setCACert(const char*) {}
+    void setInsecure() {}
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "unity.h"
+
+#include <stdio.h>
+
+namespace {
+
+struct TestFailure {};
+
+const char* currentTest = "";
+int testsRun = 0;
+int testsFailed = 0;
+bool currentFailed = false;
+
+} // namespace
+
+void unityBegin() {
+    testsRun = 0;
+    testsFailed = 0;
+}
+
+int unityEnd() {
+    printf("\n-----------------------\n%d Tests %d Failures 0 Ignored\n%s\n", testsRun, testsFailed,
+           testsFailed == 0 ? "OK" : "FAIL");
+    return testsFailed;
+}
+
+void unityRun(void (*test)(void), const char* name, int line) {
+    currentTest = name;
+    currentFailed = false;
+    testsRun++;
+    try {
+        setUp();
+        test();
+    } catch (const TestFailure&) {
+    }
+    try {
+        tearDown();
+    } catch (const TestFailure&) {
+    }
+    if (currentFailed) {
+        testsFailed++;
+    } else {
+        printf("test:%d:%s:PASS\n", line, name);
+    }
+}
+
+void unityFail(const char* file, int line, const std::string& message) {
+    printf("%s:%d:%s:FAIL: %s\n", file, line, currentTest, message.c_str());
+    currentFailed = true;
+    throw TestFailure();
+}
+
+void unityAssertEqualString(const char* expected, const char* actual, const char* file, int line) {
+    if (actual == nullptr || strcmp(expected, actual) != 0) {
+        unityFail(file, line, std::string("Expected \"") + expected + "\" Was \"" + (actual ? actual : "NULL") + "\"");
+    }
+}
+
+void unityAssertEqualStringLen(const char* expected, const char* actual, size_t length, const char* file, int line) {
+    if (actual == nullptr || strncmp(expected, actual, length) != 0) {
+        unityFail(file, line, std::string("Expected \"") + std::string(expected, strnlen(expected, length)) +
+                                  "\" Was \"" + (actual ? std::string(actual, strnlen(actual, length)) : "NULL") + "\"");
+    }
+}
+
+void unityAssertEqualMemory(const void* expected, const void* actual, size_t length, const char* file, int line) {
+    if (actual == nullptr || memcmp(expected, actual, length) != 0) {
+        unityFail(file, line, "Memory Mismatch");
+    }
+}
+
+int main() {
+    setup();
+    return testsFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#ifndef LIGHTWEIGHT_IOT_HOST_UNITY_H
+#define LIGHTWEIGHT_IOT_HOST_UNITY_H
+
+/**
+ * @file unity.h
+ * @brief Unity-compatible assertions for running the on-target tests on a host
+ *
+ * Covers the subset of Unity used by test/test_LightweightIoT.cpp. The test
+ * file's setup() runs the tests; main() is provided by unity.cpp and returns
+ * the number of failed tests.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+void setUp(void);
+void tearDown(void);
+void setup();
+
+void unityBegin();
+int unityEnd();
+void unityRun(void (*test)(void), const char* name, int line);
+void unityFail(const char* file, int line, const std::string& message);
+
+template <typename E, typename A>
+void unityAssertEqual(E expected, A actual, const char* file, int line) {
+    // Like Unity, compare as wide integers
+    if ((long long)expected != (long long)actual) {
+        unityFail(file, line, "Expected " + std::to_string((long long)expected) + " Was " +
+                                  std::to_string((long long)actual));
+    }
+}
+
+template <typename E, typename A>
+void unityAssertNotEqual(E expected, A actual, const char* file, int line) {
+    if ((long long)expected == (long long)actual) {
+        unityFail(file, line, "Expected Not-Equal " + std::to_string((long long)actual));
+    }
+}
+
+template <typename T, typename A>
+void unityAssertGreaterThan(T threshold, A actual, const char* file, int line) {
+    if (!(actual > (A)threshold)) {
+        unityFail(file, line, "Expected greater than " + std::to_string((long long)threshold));
+    }
+}
+
+void unityAssertEqualString(const char* expected, const char* actual, const char* file, int line);
+void unityAssertEqualStringLen(const char* expected, const char* actual, size_t length, const char* file, int line);
+void unityAssertEqualMemory(const void* expected, const void* actual, size_t length, const char* file, int line);
+
+#define UNITY_BEGIN() unityBegin()
+#define UNITY_END() unityEnd()
+#define RUN_TEST(test) unityRun(test, #test, __LINE__)
+
+#define TEST_ASSERT_TRUE(condition) \
+    do { if (!(condition)) unityFail(__FILE__, __LINE__, "Expected TRUE Was FALSE"); } while (0)
+#define TEST_ASSERT_FALSE(condition) \
+    do { if (condition) unityFail(__FILE__, __LINE__, "Expected FALSE Was TRUE"); } while (0)
+#define TEST_ASSERT_NULL(pointer) \
+    do { if ((pointer) != nullptr) unityFail(__FILE__, __LINE__, "Expected NULL"); } while (0)
+#define TEST_ASSERT_NOT_NULL(pointer) \
+    do { if ((pointer) == nullptr) unityFail(__FILE__, __LINE__, "Expected Non-NULL"); } while (0)
+#define TEST_ASSERT_EQUAL(expected, actual) unityAssertEqual((expected), (actual), __FILE__, __LINE__)
+#define TEST_ASSERT_EQUAL_HEX(expected, actual) unityAssertEqual((expected), (actual), __FILE__, __LINE__)
+#define TEST_ASSERT_EQUAL_HEX8(expected, actual) unityAssertEqual((expected), (actual), __FILE__, __LINE__)
+#define TEST_ASSERT_NOT_EQUAL(expected, actual) unityAssertNotEqual((expected), (actual), __FILE__, __LINE__)
+#define TEST_ASSERT_GREATER_THAN(threshold, actual) \
+    unityAssertGreaterThan((threshold), (actual), __FILE__, __LINE__)
+#define TEST_ASSERT_FLOAT_WITHIN(delta, expected, actual) \
+    do { if (!(fabs((double)(actual) - (double)(expected)) <= (double)(delta))) \
+        unityFail(__FILE__, __LINE__, "Values Not Within Delta"); } while (0)
+#define TEST_ASSERT_EQUAL_STRING(expected, actual) \
+    unityAssertEqualString((expected), (actual), __FILE__, __LINE__)
+#define TEST_ASSERT_EQUAL_STRING_LEN(expected, actual, length) \
+    unityAssertEqualStringLen((expected), (actual), (length), __FILE__, __LINE__)
+#define TEST_ASSERT_EQUAL_MEMORY(expected, actual, length) \
+    unityAssertEqualMemory((expected), (actual), (length), __FILE__, __LINE__)
+
+#endif
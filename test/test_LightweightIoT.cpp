@@ -1,5 +1,10 @@
 #include <unity.h>
 #include "LightweightIoT.h"
+#include "LightweightIoTSchema.h"
+
+#ifndef ARDUINO
+    #include <thread>
+#endif
 
 LightweightIoT* iot;
 
@@ -39,24 +44,846 @@ void test_measurement_validation(void) {
     TEST_ASSERT_FALSE(invalidMeasurement.isValid());
 }
 
+void test_key_table(void) {
+    KeyTable& keys = KeyTable::shared();
+    KeyTable::Id room = keys.intern("room temp", LineProtocol::ESCAPE_MEASUREMENT);
+    TEST_ASSERT_NOT_EQUAL(KeyTable::NONE, room);
+    TEST_ASSERT_EQUAL(room, keys.intern("room temp", LineProtocol::ESCAPE_MEASUREMENT));
+    TEST_ASSERT_NOT_EQUAL(room, keys.intern("room temp", LineProtocol::ESCAPE_KEY));
+    TEST_ASSERT_EQUAL_STRING("room temp", keys.text(room));
+    TEST_ASSERT_EQUAL_STRING("room\\ temp", keys.escaped(room));
+    TEST_ASSERT_EQUAL(10, keys.escapedLength(room));
+    TEST_ASSERT_EQUAL(KeyTable::NONE, keys.intern("", LineProtocol::ESCAPE_KEY));
+    TEST_ASSERT_FALSE(KeyTable::isKey(KeyTable::FULL));
+
+    // Measurements are 16-byte records of IDs (24 with a 64-bit string pointer), written with the names escaped once
+    LightweightIoT::Measurement samples[] = {
+        {"room temp", "value", 21.5f, 1000, LightweightIoT::SECONDS},
+        {"pump", "state", "on \"high\"", 1000, LightweightIoT::SECONDS},
+        {"pump", "cycles", 42, 1000, LightweightIoT::SECONDS},
+    };
+    TEST_ASSERT_EQUAL(sizeof(void*) > 4 ? 24 : 16, sizeof(samples[0]));
+    TEST_ASSERT_EQUAL(room, samples[0].name);
+    TEST_ASSERT_EQUAL(samples[1].name, samples[2].name);
+
+    LightweightIoT::Config config;
+    config.writePrecision = LightweightIoT::SECONDS;
+    iot->setConfig(config);
+    iot->addTag("site", "a=b");
+    char buffer[128];
+    TEST_ASSERT_EQUAL(36, iot->encodePoint(buffer, sizeof(buffer), samples[0]));
+    TEST_ASSERT_EQUAL_STRING("room\\ temp,site=a\\=b value=21.5 1000", buffer);
+    iot->encodePoint(buffer, sizeof(buffer), samples[1]);
+    TEST_ASSERT_EQUAL_STRING("pump,site=a\\=b state=\"on \\\"high\\\"\" 1000", buffer);
+    iot->encodePoint(buffer, sizeof(buffer), samples[2]);
+    TEST_ASSERT_EQUAL_STRING("pump,site=a\\=b cycles=42i 1000", buffer);
+
+    // An empty string is a legal field value
+    LightweightIoT::Measurement empty("pump", "state", "", 1000, LightweightIoT::SECONDS);
+    TEST_ASSERT_TRUE(empty.isValid());
+    iot->encodePoint(buffer, sizeof(buffer), empty);
+    TEST_ASSERT_EQUAL_STRING("pump,site=a\\=b state=\"\" 1000", buffer);
+
+    // Tags and string values stay out of the shared table
+    size_t interned = keys.size();
+    char tag[8];
+    for (int i = 0; i < 8; i++) {
+        snprintf(tag, sizeof(tag), "s%d", i);
+        LightweightIoT::Measurement status("pump", "state", tag);
+        TEST_ASSERT_TRUE(status.isValid());
+    }
+    LightweightIoT other("test_token", "test_org", "test_bucket");
+    TEST_ASSERT_TRUE(other.addTag("site", "b"));
+    TEST_ASSERT_EQUAL(interned, keys.size());
+    iot->encodePoint(buffer, sizeof(buffer), samples[2]);
+    TEST_ASSERT_EQUAL_STRING("pump,site=a\\=b cycles=42i 1000", buffer);
+
+    // Tag text that does not fit is reported instead of being left out
+    char value[201];
+    memset(value, 'v', 200);
+    value[200] = '\0';
+    TEST_ASSERT_TRUE(other.addTag("a", value));
+    TEST_ASSERT_TRUE(other.addTag("b", value));
+    TEST_ASSERT_FALSE(other.addTag("c", value));
+    TEST_ASSERT_EQUAL(LightweightIoT::MEMORY_ERROR, other.getLastError());
+    TEST_ASSERT_FALSE(other.addTag("d", ""));
+    TEST_ASSERT_EQUAL(LightweightIoT::INVALID_DATA, other.getLastError());
+}
+
 void test_memory_check(void) {
     size_t memory = iot->checkMemory();
     TEST_ASSERT_GREATER_THAN(0, memory);
 }
 
 void test_batch_memory(void) {
-    // Fill batch to test memory management
+    // Batch capacity is measured in bytes, sized from Config::staticBufferSize
+    LightweightIoT::Config config;
+    config.staticBufferSize = 1024;
+    iot->setConfig(config);
+
     iot->beginBatch();
-    for (int i = 0; i < 50; i++) {
-        bool result = iot->writePoint("test", "value", i);
-        if (i < LightweightIoT::MAX_BATCH_SIZE) {
-            TEST_ASSERT_TRUE(result);
-        } else {
-            TEST_ASSERT_FALSE(result);
+    for (int i = 0; i < 500; i++) {
+        // A full batch is flushed to make room; without a link the flush
+        // fails and the point is rejected instead of growing the buffer
+        if (!iot->writePoint("test", "value", i)) {
+            TEST_ASSERT_EQUAL(LightweightIoT::BATCH_FULL, iot->getLastError());
+        }
+        TEST_ASSERT_TRUE(iot->getBatchBytes() <= config.staticBufferSize);
+    }
+    iot->clearBatch();
+    TEST_ASSERT_EQUAL(0, iot->getBatchSize());
+}
+
+void test_flush_policy(void) {
+    LightweightIoT::Config config;
+    config.flushPoints = 5;
+    iot->setConfig(config);
+
+    // Any flush threshold queues writes without beginBatch()
+    for (int i = 0; i < 4; i++) {
+        iot->writePoint("test", "value", i);
+    }
+    TEST_ASSERT_EQUAL(4, iot->getBatchSize());
+
+    // The fifth point triggers a flush; with no WiFi the batch is kept for a retry
+    TEST_ASSERT_EQUAL(0, iot->getNextRetryTime());
+    iot->writePoint("test", "value", 4);
+    TEST_ASSERT_EQUAL(LightweightIoT::NOT_CONNECTED, iot->getLastError());
+    TEST_ASSERT_NOT_EQUAL(0, iot->getNextRetryTime());
+}
+
+void test_batch_swap(void) {
+    BatchBuffer front;
+    BatchBuffer back;
+    TEST_ASSERT_TRUE(front.allocate(64));
+    TEST_ASSERT_TRUE(back.allocate(64));
+    TEST_ASSERT_TRUE(front.append("a v=1", 5));
+
+    // The sender takes the queued points while writes continue in the other buffer
+    front.swap(back);
+    TEST_ASSERT_TRUE(front.empty());
+    TEST_ASSERT_EQUAL(1, back.points());
+    TEST_ASSERT_TRUE(front.append("b v=2", 5));
+
+    const char* data;
+    TEST_ASSERT_EQUAL(6, back.peek(&data));
+    TEST_ASSERT_EQUAL_MEMORY("a v=1\n", data, 6);
+}
+
+void test_retry_keeps_point(void) {
+    // Without WiFi the point is kept and retried later instead of blocking
+    TEST_ASSERT_EQUAL(0, iot->getNextRetryTime());
+    TEST_ASSERT_TRUE(iot->writePoint("test", "value", 1));
+    TEST_ASSERT_EQUAL(LightweightIoT::NOT_CONNECTED, iot->getLastError());
+    TEST_ASSERT_EQUAL(1, iot->getBatchSize());
+    TEST_ASSERT_NOT_EQUAL(0, iot->getNextRetryTime());
+
+    // Further writes queue behind it
+    TEST_ASSERT_TRUE(iot->writePoint("test", "value", 2));
+    TEST_ASSERT_EQUAL(2, iot->getBatchSize());
+}
+
+#ifdef ARDUINO
+static const char* SPOOL_TEST_PATH = "/lwiot_test";
+#else
+static const char* SPOOL_TEST_PATH = "lwiot_test";
+#endif
+
+void test_spool_roundtrip(void) {
+    char buffer[64];
+    {
+        Spool spool;
+        TEST_ASSERT_TRUE(spool.begin(SPOOL_TEST_PATH, 4096, 1024));
+        TEST_ASSERT_TRUE(spool.append("a v=1\n", 6));
+        TEST_ASSERT_TRUE(spool.append("b v=2\n", 6));
+    }
+
+    // Records survive reopening and come back oldest first
+    Spool spool;
+    TEST_ASSERT_TRUE(spool.begin(SPOOL_TEST_PATH, 4096, 1024));
+    TEST_ASSERT_EQUAL(6, spool.peek(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_MEMORY("a v=1\n", buffer, 6);
+    spool.consume();
+    TEST_ASSERT_EQUAL(6, spool.peek(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL_MEMORY("b v=2\n", buffer, 6);
+    spool.consume();
+    TEST_ASSERT_TRUE(spool.empty());
+}
+
+void test_encode_point(void) {
+    char buffer[128];
+    iot->addTag("device", "esp32");
+
+    size_t length = iot->encodePoint(buffer, sizeof(buffer), "temperature", "value", 42);
+    TEST_ASSERT_EQUAL(strlen(buffer), length);
+    TEST_ASSERT_EQUAL_STRING_LEN("temperature,device=esp32 value=42i ", buffer, 35);
+
+    // Points that do not fit are rejected without writing
+    TEST_ASSERT_EQUAL(0, iot->encodePoint(buffer, 16, "temperature", "value", 42));
+}
+
+void test_write_precision(void) {
+    char buffer[128];
+    LightweightIoT::Config config;
+    config.writePrecision = LightweightIoT::SECONDS;
+    iot->setConfig(config);
+
+    // Whole seconds: the timestamp is the uptime in seconds, not nanoseconds
+    LightweightIoT::Point point("temperature");
+    point.addField("value", 42).setTimestamp(1700000000);
+    iot->encodePoint(buffer, sizeof(buffer), point);
+    TEST_ASSERT_EQUAL_STRING("temperature value=42i 1700000000", buffer);
+
+    // The time of writing is in seconds too
+    iot->encodePoint(buffer, sizeof(buffer), "temperature", "value", 42);
+    unsigned long long seconds = strtoull(strrchr(buffer, ' ') + 1, nullptr, 10);
+    TEST_ASSERT_TRUE(seconds <= millis() / 1000 && seconds + 1 >= millis() / 1000);
+
+    // Server-side timestamps leave it out
+    config.writePrecision = LightweightIoT::MILLISECONDS;
+    config.serverTimestamps = true;
+    iot->setConfig(config);
+    size_t length = iot->encodePoint(buffer, sizeof(buffer), "temperature", "value", 42);
+    TEST_ASSERT_EQUAL_STRING("temperature value=42i", buffer);
+    TEST_ASSERT_EQUAL(21, length);
+}
+
+void test_multi_field_point(void) {
+    char buffer[128];
+    LightweightIoT::Point point("climate");
+    point.addField("temp", 21.5f).addField("count", 3).addField("ok", true).addField("room", "lab");
+    point.setTimestamp(1000);
+
+    size_t length = iot->encodePoint(buffer, sizeof(buffer), point);
+    TEST_ASSERT_EQUAL(strlen(buffer), length);
+    TEST_ASSERT_EQUAL_STRING("climate temp=21.5,count=3i,ok=true,room=\"lab\" 1000", buffer);
+
+    // One failed reading does not drop the rest of the sample
+    point.clearFields();
+    point.addField("temp", NAN).addField("humidity", 40.0f);
+    length = iot->encodePoint(buffer, sizeof(buffer), point);
+    TEST_ASSERT_EQUAL_STRING("climate humidity=40 1000", buffer);
+}
+
+LWIOT_FIELD(SchemaVoltage, "voltage", float);
+LWIOT_FIELD(SchemaCycles, "cycle count", int);
+LWIOT_FIELD(SchemaRelay, "relay", bool);
+LWIOT_SERIES(SchemaEnergy, "energy,main", SchemaVoltage, SchemaCycles, SchemaRelay);
+
+void test_series_schema(void) {
+    char buffer[128];
+    iot->addTag("device", "esp32");
+
+    // Names are escaped at compile time
+    size_t length = SchemaEnergy::encode(*iot, buffer, sizeof(buffer), 1000, 230.5f, 12, true);
+    TEST_ASSERT_EQUAL(strlen(buffer), length);
+    TEST_ASSERT_EQUAL_STRING("energy\\,main,device=esp32 voltage=230.5,cycle\\ count=12i,relay=true 1000", buffer);
+
+    TEST_ASSERT_EQUAL(0, SchemaEnergy::encode(*iot, buffer, 32, 1000, 230.5f, 12, true));
+}
+
+void test_stats(void) {
+    LightweightIoT::Histogram histogram;
+    histogram.add(0);
+    histogram.add(1);
+    histogram.add(3);
+    histogram.add(4);
+    histogram.add(1000);
+    TEST_ASSERT_EQUAL(1, histogram.buckets[0]);
+    TEST_ASSERT_EQUAL(2, histogram.buckets[1]);
+    TEST_ASSERT_EQUAL(1, histogram.buckets[2]);
+    TEST_ASSERT_EQUAL(1, histogram.buckets[5]);
+    TEST_ASSERT_EQUAL(1000, histogram.max);
+    TEST_ASSERT_EQUAL(201, histogram.mean());
+
+    iot->writePoint("test", "value", NAN);
+    iot->writePoint("test", "value", 1);
+    LightweightIoT::Stats stats = iot->getStats();
+    TEST_ASSERT_EQUAL(1, stats.pointsRejected);
+    TEST_ASSERT_EQUAL(1, stats.pointsEncoded);
+    TEST_ASSERT_EQUAL(1, stats.encodeMicros.count);
+    TEST_ASSERT_TRUE(stats.bytesEncoded > 0);
+
+    iot->resetStats();
+    TEST_ASSERT_EQUAL(0, iot->getStats().pointsEncoded);
+}
+
+void test_deadband(void) {
+    TEST_ASSERT_TRUE(iot->setDeadband(nullptr, "temperature", LightweightIoT::Deadband(0.5f)));
+    TEST_ASSERT_TRUE(iot->setDeadband("power", nullptr, LightweightIoT::Deadband(0, 10, 20)));
+
+    // The first value of a series is reported, then only moves beyond the deadband
+    float temperatures[] = {21.0f, 21.3f, 20.6f, 21.6f, 21.6f};
+    for (float temperature : temperatures) {
+        TEST_ASSERT_TRUE(iot->writePoint("room", "temperature", temperature));
+    }
+    TEST_ASSERT_EQUAL(2, iot->getStats().pointsEncoded);
+    TEST_ASSERT_EQUAL(3, iot->getStats().pointsSuppressed);
+
+    // Each tag set is a series of its own; fields without a deadband are always written
+    iot->addTag("room", "kitchen");
+    iot->writePoint("room", "temperature", 21.6f);
+    iot->writePoint("room", "humidity", 40);
+    iot->writePoint("room", "humidity", 40);
+    TEST_ASSERT_EQUAL(5, iot->getStats().pointsEncoded);
+
+    // Percent deadband, state changes and the heartbeat
+    iot->writePoint("power", "watts", 100);
+    iot->writePoint("power", "watts", 105);
+    iot->writePoint("power", "watts", 111);
+    iot->writePoint("power", "state", "idle");
+    iot->writePoint("power", "state", "idle");
+    iot->writePoint("power", "state", "busy");
+    TEST_ASSERT_EQUAL(9, iot->getStats().pointsEncoded);
+    delay(25);
+    iot->writePoint("power", "watts", 111);
+    TEST_ASSERT_EQUAL(10, iot->getStats().pointsEncoded);
+
+    // A point is written when any of its fields is due
+    iot->writePoint("power", {{"watts", 111}, {"state", "off"}});
+    TEST_ASSERT_EQUAL(11, iot->getStats().pointsEncoded);
+
+    // A block whose samples were all suppressed has still been written
+    iot->clearBatch();
+    LightweightIoT::Measurement repeats[] = {{"room", "temperature", 21.6f}, {"room", "temperature", 21.7f}};
+    TEST_ASSERT_TRUE(iot->writeMeasurements(repeats, 2));
+    TEST_ASSERT_EQUAL(11, iot->getStats().pointsEncoded);
+
+    iot->clearDeadbands();
+    iot->writePoint("room", "temperature", 21.6f);
+    TEST_ASSERT_EQUAL(12, iot->getStats().pointsEncoded);
+
+    // Tiny tables keep a free entry, and a full one reports instead of probing forever
+    for (size_t series = 0; series <= 3; series++) {
+        ReportFilter filter;
+        TEST_ASSERT_TRUE(filter.allocate(series));
+        TEST_ASSERT_TRUE(ReportFilter::storageSize(series) > series * sizeof(ReportFilter::Entry));
+        bool created;
+        for (uint32_t key = 1; key <= series; key++) {
+            TEST_ASSERT_NOT_NULL(filter.find(key, &created));
+            TEST_ASSERT_TRUE(created);
         }
+        TEST_ASSERT_NULL(filter.find(100, &created));
+        TEST_ASSERT_NULL(filter.find(101, &created));
+        if (series > 0) {
+            TEST_ASSERT_NOT_NULL(filter.find(1, &created));
+        }
+    }
+
+    // Series beyond a full table of Config::deadbandSeries are always written
+    LightweightIoT small("test_token", "test_org", "test_bucket");
+    LightweightIoT::Config config;
+    config.deadbandSeries = 1;
+    small.setConfig(config);
+    TEST_ASSERT_TRUE(small.setDeadband(nullptr, "t", LightweightIoT::Deadband(1.0f)));
+    TEST_ASSERT_TRUE(small.writePoint("a", "t", 1.0f));
+    TEST_ASSERT_TRUE(small.writePoint("b", "t", 1.0f));
+    TEST_ASSERT_TRUE(small.writePoint("c", "t", 1.0f));
+    TEST_ASSERT_TRUE(small.writePoint("c", "t", 1.0f));
+    TEST_ASSERT_EQUAL(4, small.getStats().pointsEncoded);
+}
+
+void test_aggregation(void) {
+    Aggregation window;
+    window.configure("power", "watts", 1000, true);
+    double samples[] = {2, 4, 4, 4, 5, 5, 7, 9};
+    for (int i = 0; i < 8; i++) {
+        window.add(samples[i], 5000 + i);
+    }
+    TEST_ASSERT_FALSE(window.due(5999));
+    TEST_ASSERT_TRUE(window.due(6000));
+
+    Aggregation::Summary summary = window.take();
+    TEST_ASSERT_TRUE(window.empty());
+    TEST_ASSERT_EQUAL(5000, summary.start);
+    TEST_ASSERT_EQUAL(8, summary.count);
+    TEST_ASSERT_FLOAT_WITHIN(1e-9, 2, summary.min);
+    TEST_ASSERT_FLOAT_WITHIN(1e-9, 9, summary.max);
+    TEST_ASSERT_FLOAT_WITHIN(1e-9, 5, summary.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1e-9, 9, summary.last);
+    TEST_ASSERT_FLOAT_WITHIN(1e-9, sqrt(32.0 / 7), summary.stddev);
+
+    LineProtocol::Field fields[Aggregation::MAX_FIELDS];
+    TEST_ASSERT_EQUAL(6, window.render(summary, fields));
+    TEST_ASSERT_EQUAL_STRING("watts_count", fields[3].key);
+    TEST_ASSERT_EQUAL(8, fields[3].i);
+    TEST_ASSERT_EQUAL_STRING("watts_stddev", fields[5].key);
+
+    // Through the client the samples are folded, other fields are written as usual
+    TEST_ASSERT_TRUE(iot->setAggregation("power", "watts", 60000));
+    TEST_ASSERT_TRUE(iot->writePoint("power", "watts", 100));
+    TEST_ASSERT_TRUE(iot->writePoint("power", {{"watts", 300}, {"relay", true}}));
+    TEST_ASSERT_EQUAL(2, iot->getStats().samplesAggregated);
+    TEST_ASSERT_EQUAL(1, iot->getStats().pointsEncoded);
+
+    // The open window is written before it is removed
+    iot->clearAggregations();
+    TEST_ASSERT_EQUAL(2, iot->getStats().pointsEncoded);
+    TEST_ASSERT_EQUAL(2, iot->getBatchSize());
+}
+
+void test_column_batch(void) {
+    // Samples are 8-byte records; a pause over 65 s takes one more
+    KeyTable& keys = KeyTable::shared();
+    KeyTable::Id room = keys.intern("room", LineProtocol::ESCAPE_MEASUREMENT);
+    KeyTable::Id temperature = keys.intern("temperature", LineProtocol::ESCAPE_KEY);
+    KeyTable::Id count = keys.intern("count", LineProtocol::ESCAPE_KEY);
+    ColumnBatch columns;
+    TEST_ASSERT_TRUE(columns.allocate(64));
+    TEST_ASSERT_EQUAL(ColumnBatch::ADDED, columns.add(room, temperature, LineProtocol::Field("t", 21.5f), 1000));
+    TEST_ASSERT_EQUAL(ColumnBatch::ADDED, columns.add(room, count, LineProtocol::Field("c", 7), 1010));
+    TEST_ASSERT_EQUAL(ColumnBatch::ADDED, columns.add(room, temperature, LineProtocol::Field("t", 22.0f), 100000));
+    TEST_ASSERT_EQUAL(ColumnBatch::UNTRACKED, columns.add(room, count, LineProtocol::Field("c", "on"), 100000));
+    TEST_ASSERT_EQUAL(3, columns.samples());
+    TEST_ASSERT_EQUAL(32, columns.bytes());
+
+    ColumnBatch::Sample sample;
+    TEST_ASSERT_TRUE(columns.front(&sample));
+    TEST_ASSERT_EQUAL(1000, sample.time);
+    TEST_ASSERT_FLOAT_WITHIN(0, 21.5, sample.value.f);
+    columns.pop();
+    TEST_ASSERT_TRUE(columns.front(&sample));
+    TEST_ASSERT_EQUAL(count, sample.series->field);
+    TEST_ASSERT_EQUAL(7, sample.value.i);
+    columns.pop();
+    TEST_ASSERT_TRUE(columns.front(&sample));
+    TEST_ASSERT_EQUAL(100000, sample.time);
+    columns.pop();
+    TEST_ASSERT_FALSE(columns.front(&sample));
+
+    // Batched numbers are held raw and only formatted when flushed
+    LightweightIoT::Config config;
+    config.columnBatchSize = 4096;
+    config.serverTimestamps = true;
+    iot->setConfig(config);
+    iot->beginBatch();
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_TRUE(iot->writePoint("room", "temperature", 21.5f));
+    }
+    TEST_ASSERT_TRUE(iot->writePoint("room", "state", "open"));
+    TEST_ASSERT_EQUAL(101, iot->getBatchSize());
+    TEST_ASSERT_EQUAL(1, iot->getStats().pointsEncoded);
+    iot->clearBatch();
+    TEST_ASSERT_EQUAL(0, iot->getBatchSize());
+
+    // A flush renders them; without WiFi they stay queued as text
+    LightweightIoT::Point point("room");
+    point.addField("temperature", 21.5f);
+    size_t line = iot->getPointSize(point) + 1;
+    for (int i = 0; i < 3; i++) {
+        iot->writePoint("room", "temperature", 21.5f);
     }
+    TEST_ASSERT_EQUAL(24, iot->getBatchBytes());
+    TEST_ASSERT_FALSE(iot->flushBatch());
+    TEST_ASSERT_EQUAL(3 * line, iot->getBatchBytes());
+    TEST_ASSERT_EQUAL(4, iot->getStats().pointsEncoded);
+
+    // Held samples are rendered with the tags they were written under
     iot->clearBatch();
+    iot->writePoint("room", "temperature", 21.5f);
+    iot->addTag("device", "esp32");
+    TEST_ASSERT_EQUAL(line, iot->getBatchBytes());
+}
+
+void test_static_buffer(void) {
+    // Aligned buffers carved in order until the region is used up
+    Arena arena;
+    TEST_ASSERT_TRUE(arena.reserve(256));
+    char* first = (char*)arena.allocate(10);
+    char* second = (char*)arena.allocate(1);
+    TEST_ASSERT_EQUAL(Arena::padded(10), second - first);
+    TEST_ASSERT_TRUE(arena.owns(second));
+    TEST_ASSERT_NULL(arena.allocate(250));
+    TEST_ASSERT_NOT_NULL(arena.allocate(200));
+    TEST_ASSERT_EQUAL(224, arena.used());
+
+    // begin() carves every buffer from one region; it fails later for want of WiFi
+    LightweightIoT::Config config;
+    config.useStaticBuffer = true;
+    config.compress = true;
+    config.flushPoints = 100;
+    config.serverTimestamps = true;
+    iot->setConfig(config);
+    iot->addTag("device", "esp32");
+    TEST_ASSERT_FALSE(iot->begin("http://localhost:8086"));
+    TEST_ASSERT_NOT_EQUAL(LightweightIoT::MEMORY_ERROR, iot->getLastError());
+
+    // getPointSize() is the exact encoded size
+    char buffer[128];
+    LightweightIoT::Point point("climate");
+    point.addField("temperature", 21.5f).addField("door", true).setTimestamp(1700000000);
+    TEST_ASSERT_EQUAL(iot->encodePoint(buffer, sizeof(buffer), point), iot->getPointSize(point));
+    TEST_ASSERT_EQUAL(iot->encodePoint(buffer, sizeof(buffer), "status", "state", "on \"hot\""),
+                      iot->getPointSize("status", "state", "on \"hot\""));
+    for (int i = 0; i < 20; i++) {
+        TEST_ASSERT_TRUE(iot->writePoint("climate", "temperature", 20.0f + i));
+    }
+    TEST_ASSERT_EQUAL(20, iot->getBatchSize());
+
+    // The region can only be swapped while nothing is queued
+    TEST_ASSERT_FALSE(iot->reserveBuffer());
+    TEST_ASSERT_EQUAL(LightweightIoT::INVALID_CONFIG, iot->getLastError());
+    iot->freeBuffer();
+    TEST_ASSERT_EQUAL(0, iot->getBatchSize());
+    TEST_ASSERT_EQUAL(20, iot->getStats().pointsDropped);
+    TEST_ASSERT_TRUE(iot->reserveBuffer(iot->requiredBufferSize()));
+}
+
+// Keeps request bodies in place of a server
+class CaptureTransport : public Transport {
+public:
+    char body[512];
+    size_t length = 0;
+    int requests = 0;
+    bool chunked = false;
+    const char* encoding = nullptr;
+    size_t announced = 0;
+
+    bool linkUp() override { return true; }
+    bool chunks() const override { return chunked; }
+    int send(const Request& request, Response* response) override {
+        for (size_t i = 0; i < request.bodyCount && length + request.body[i].length < sizeof(body); i++) {
+            memcpy(body + length, request.body[i].data, request.body[i].length);
+            length += request.body[i].length;
+        }
+        // Sources are read in small pieces, as a socket write would
+        long n = 1;
+        for (bool more = request.source != nullptr && request.source->rewind(); more && n > 0;) {
+            n = request.source->read(body + length, sizeof(body) - 1 - length < 16 ? sizeof(body) - 1 - length : 16);
+            length += n > 0 ? n : 0;
+            more = length < sizeof(body) - 1;
+        }
+        encoding = request.contentEncoding;
+        announced = request.sourceLength;
+        body[length] = '\0';
+        requests++;
+        response->status = 204;
+        return 204;
+    }
+    void close() override {}
+    void reset() {
+        length = 0;
+        requests = 0;
+        encoding = nullptr;
+        announced = 0;
+    }
+};
+
+void test_write_series(void) {
+    CaptureTransport transport;
+    LightweightIoT::Config config;
+    config.transport = &transport;
+    config.writePrecision = LightweightIoT::MILLISECONDS;
+    iot->setConfig(config);
+    iot->addTag("device", "esp32");
+
+    // Without batching a block is one request; counted timestamps carry across digits
+    float wave[] = {0.5f, -1.25f, 3.0f};
+    TEST_ASSERT_TRUE(iot->writeSeries("vibration", "x", wave, 3, 1700000000995ULL, 5));
+    TEST_ASSERT_EQUAL(1, transport.requests);
+    TEST_ASSERT_EQUAL_STRING("vibration,device=esp32 x=0.5 1700000000995\n"
+                             "vibration,device=esp32 x=-1.25 1700000001000\n"
+                             "vibration,device=esp32 x=3 1700000001005\n",
+                             transport.body);
+    TEST_ASSERT_EQUAL(3, iot->getStats().pointsEncoded);
+
+    // Timestamp arrays are scaled to the write precision; NaN samples are left out
+    transport.reset();
+    int32_t counts[] = {7, -3};
+    uint64_t times[] = {5000, 9000};
+    TEST_ASSERT_TRUE(iot->writeSeries("adc", "raw", counts, 2, times, LightweightIoT::MICROSECONDS));
+    TEST_ASSERT_EQUAL_STRING("adc,device=esp32 raw=7i 5\nadc,device=esp32 raw=-3i 9\n", transport.body);
+    wave[1] = NAN;
+    TEST_ASSERT_FALSE(iot->writeSeries("vibration", "x", wave, 3, times));
+    TEST_ASSERT_EQUAL(1, iot->getStats().pointsRejected);
+
+    // A block ending now that would start before the clock's zero is rejected, not wrapped
+    transport.reset();
+    uint64_t uptime = millis();
+    TEST_ASSERT_FALSE(iot->writeSeries("m", "x", wave, 3, 0, (uint32_t)uptime + 1000));
+    TEST_ASSERT_EQUAL(LightweightIoT::INVALID_DATA, iot->getLastError());
+    TEST_ASSERT_EQUAL(0, transport.requests);
+
+    // With server timestamps a block ending now carries none, and 0 is never written
+    config.serverTimestamps = true;
+    iot->setConfig(config);
+    float one[] = {1.0f};
+    TEST_ASSERT_TRUE(iot->writeSeries("m", "x", one, 1, 0, 1000));
+    TEST_ASSERT_EQUAL_STRING("m,device=esp32 x=1\n", transport.body);
+    config.serverTimestamps = false;
+    iot->setConfig(config);
+    transport.reset();
+    uint64_t zero[] = {0};
+    TEST_ASSERT_TRUE(iot->writeSeries("m", "x", one, 1, zero));
+    TEST_ASSERT_EQUAL_STRING("m,device=esp32 x=1\n", transport.body);
+
+    // A failed writeMeasurements() sends what it accepted and ends batch mode
+    transport.reset();
+    LightweightIoT::Measurement samples[] = {{"room", "t", 1.0f, 1000}, {"", "t", 2.0f, 1000}};
+    TEST_ASSERT_FALSE(iot->writeMeasurements(samples, 2));
+    TEST_ASSERT_EQUAL(1, transport.requests);
+    TEST_ASSERT_TRUE(iot->writeMeasurement(samples[0]));
+    TEST_ASSERT_EQUAL(2, transport.requests);
+
+    // Samples the flush policy already sent leave nothing to send at the end
+    transport.reset();
+    config.flushPoints = 2;
+    iot->setConfig(config);
+    LightweightIoT::Measurement pair[] = {{"room", "t", 1.0f, 1000}, {"room", "t", 2.0f, 2000}};
+    TEST_ASSERT_TRUE(iot->writeMeasurements(pair, 2));
+    TEST_ASSERT_EQUAL(1, transport.requests);
+
+    // Blocks larger than the flush budget go out in chunks as it fills
+    transport.reset();
+    config.flushPoints = 4;
+    iot->setConfig(config);
+    float block[10] = {};
+    TEST_ASSERT_TRUE(iot->writeSeries("vibration", "x", block, 10, 1000, 1));
+    TEST_ASSERT_EQUAL(2, transport.requests);
+    TEST_ASSERT_EQUAL(2, iot->getBatchSize());
+}
+
+void test_streamed_gzip(void) {
+    CaptureTransport transport;
+    LightweightIoT::Config config;
+    config.transport = &transport;
+    config.compress = true;
+    config.compressThreshold = 64;
+    iot->setConfig(config);
+
+    // The compressed body is produced while it is read; without chunking its length comes first
+    float block[40] = {};
+    TEST_ASSERT_TRUE(iot->writeSeries("room", "temp", block, 40, 1700000000000ULL, 1000));
+    TEST_ASSERT_EQUAL(1, transport.requests);
+    TEST_ASSERT_EQUAL_STRING("gzip", transport.encoding);
+    TEST_ASSERT_EQUAL_HEX8(0x1f, (uint8_t)transport.body[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x8b, (uint8_t)transport.body[1]);
+    TEST_ASSERT_EQUAL(transport.announced, transport.length);
+    TEST_ASSERT_TRUE(transport.length * 2 < 40 * strlen("room temp=0 1700000000\n"));
+    size_t measured = transport.length;
+
+    // A chunking transport gets the same bytes without the measuring pass
+    transport.reset();
+    transport.chunked = true;
+    TEST_ASSERT_TRUE(iot->writeSeries("room", "temp", block, 40, 1700000000000ULL, 1000));
+    TEST_ASSERT_EQUAL(0, transport.announced);
+    TEST_ASSERT_EQUAL(measured, transport.length);
+}
+
+void test_float_formatting(void) {
+    char buffer[LineProtocol::MAX_NUMBER_LENGTH];
+    size_t length = LineProtocol::formatFloat(buffer, 21.37f);
+    TEST_ASSERT_EQUAL_STRING_LEN("21.37", buffer, length);
+    length = LineProtocol::formatFloat(buffer, 21.37f, 1);
+    TEST_ASSERT_EQUAL_STRING_LEN("21.4", buffer, length);
+    length = LineProtocol::formatFloat(buffer, -0.5f, 3);
+    TEST_ASSERT_EQUAL_STRING_LEN("-0.5", buffer, length);
+    length = LineProtocol::formatFloat(buffer, 1e-10f);
+    TEST_ASSERT_EQUAL_STRING_LEN("1e-10", buffer, length);
+
+    // NaN cannot be written, so the point is rejected
+    TEST_ASSERT_FALSE(iot->writePoint("test", "value", NAN));
+    TEST_ASSERT_EQUAL(LightweightIoT::INVALID_DATA, iot->getLastError());
+}
+
+void test_tag_set_sorted(void) {
+    char buffer[128];
+    iot->addTag("zone", "north");
+    iot->addTag("building", "Building A");
+
+    size_t length = iot->encodePoint(buffer, sizeof(buffer), "power", "value", 1);
+    TEST_ASSERT_TRUE(length > 0);
+    TEST_ASSERT_EQUAL_STRING_LEN("power,building=Building\\ A,zone=north value=1i ", buffer, 47);
+
+    // Changing the tags re-renders the cached tag set
+    iot->clearTags();
+    length = iot->encodePoint(buffer, sizeof(buffer), "power", "value", 1);
+    TEST_ASSERT_EQUAL_STRING_LEN("power value=1i ", buffer, 15);
+}
+
+void test_escape_contexts(void) {
+    char buffer[64];
+    const char* input = "a b,c=\"d\"\\";
+    size_t len = strlen(input);
+
+    char* end = LineProtocol::escape(buffer, input, len, LineProtocol::ESCAPE_MEASUREMENT);
+    TEST_ASSERT_EQUAL_STRING_LEN("a\\ b\\,c=\"d\"\\", buffer, end - buffer);
+
+    end = LineProtocol::escape(buffer, input, len, LineProtocol::ESCAPE_KEY);
+    TEST_ASSERT_EQUAL_STRING_LEN("a\\ b\\,c\\=\"d\"\\", buffer, end - buffer);
+
+    end = LineProtocol::escape(buffer, input, len, LineProtocol::ESCAPE_STRING);
+    TEST_ASSERT_EQUAL_STRING_LEN("a b,c=\\\"d\\\"\\\\", buffer, end - buffer);
+    TEST_ASSERT_EQUAL(end - buffer, LineProtocol::escapedLength(input, len, LineProtocol::ESCAPE_STRING));
+}
+
+static uint8_t gzipOutput[1024];
+static size_t gzipLength = 0;
+
+static bool collectGzip(void*, const uint8_t* data, size_t length) {
+    if (gzipLength + length > sizeof(gzipOutput)) {
+        return false;
+    }
+    memcpy(gzipOutput + gzipLength, data, length);
+    gzipLength += length;
+    return true;
+}
+
+void test_gzip_payload(void) {
+    static GzipWriter gzip;
+    const char* line = "temperature,device=esp32,room=101 value=23.50 1700000000000000000\n";
+
+    gzipLength = 0;
+    gzip.begin(collectGzip, nullptr);
+    for (int i = 0; i < 20; i++) {
+        TEST_ASSERT_TRUE(gzip.write((const uint8_t*)line, strlen(line)));
+    }
+    TEST_ASSERT_TRUE(gzip.finish());
+
+    // gzip magic, and repeated lines compress well
+    TEST_ASSERT_EQUAL_HEX8(0x1f, gzipOutput[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x8b, gzipOutput[1]);
+    TEST_ASSERT_TRUE(gzipLength * 5 < strlen(line) * 20);
+
+    // A batch whose lines differ in tags, values and timestamps still finds
+    // its matches, which takes a hash over all three bytes of each string
+    gzipLength = 0;
+    size_t input = 0;
+    char varied[128];
+    gzip.begin(collectGzip, nullptr);
+    for (int i = 0; i < 40; i++) {
+        int length = snprintf(varied, sizeof(varied),
+                              "environment,device=esp32-%d,room=lab temperature=%d.%d,humidity=%di %llu\n", i % 4,
+                              20 + i % 7, i % 10, 40 + i % 13, 1700000000000ULL + i * 1000ULL);
+        TEST_ASSERT_TRUE(gzip.write((const uint8_t*)varied, length));
+        input += length;
+    }
+    TEST_ASSERT_TRUE(gzip.finish());
+    TEST_ASSERT_TRUE(gzipLength * 9 < input * 2);
+}
+
+void test_batch_runs(void) {
+    BatchBuffer buffer;
+    const char* runs[2];
+    size_t lengths[2];
+    TEST_ASSERT_TRUE(buffer.allocate(32));
+    TEST_ASSERT_EQUAL(0, buffer.peekRuns(runs, lengths));
+
+    // Fill the end of the region, free its front, then wrap a point around
+    TEST_ASSERT_TRUE(buffer.append("aaaaaaaaa", 9));
+    TEST_ASSERT_TRUE(buffer.append("bbbbbbbbb", 9));
+    TEST_ASSERT_TRUE(buffer.append("ccccccccc", 9));
+    buffer.consume(20);
+    TEST_ASSERT_TRUE(buffer.append("ddddddddd", 9));
+
+    TEST_ASSERT_EQUAL(2, buffer.peekRuns(runs, lengths));
+    TEST_ASSERT_EQUAL(10, lengths[0]);
+    TEST_ASSERT_EQUAL('c', runs[0][0]);
+    TEST_ASSERT_EQUAL(10, lengths[1]);
+    TEST_ASSERT_EQUAL('d', runs[1][0]);
+    TEST_ASSERT_EQUAL(2, buffer.points());
+}
+
+#ifdef LWIOT_HAS_THREADS
+void test_point_queue(void) {
+    PointQueue queue;
+    const char* data;
+    uint32_t micros;
+    size_t tickets[4];
+    TEST_ASSERT_TRUE(queue.allocate(3, 16));
+    TEST_ASSERT_EQUAL(4, queue.slots());
+
+    // Full after four claims; points come out in claim order once published
+    for (int i = 0; i < 4; i++) {
+        char* slot = queue.claim(&tickets[i]);
+        TEST_ASSERT_NOT_NULL(slot);
+        slot[0] = (char)('a' + i);
+    }
+    size_t extra;
+    TEST_ASSERT_NULL(queue.claim(&extra));
+    queue.publish(tickets[1], 1, 0);
+    TEST_ASSERT_EQUAL(-1, queue.front(&data, &micros));
+    queue.publish(tickets[0], 1, 7);
+    TEST_ASSERT_EQUAL(1, queue.front(&data, &micros));
+    TEST_ASSERT_EQUAL('a', data[0]);
+    TEST_ASSERT_EQUAL(7, micros);
+    queue.pop();
+    TEST_ASSERT_NOT_NULL(queue.claim(&extra));
+    TEST_ASSERT_EQUAL(1, queue.front(&data, &micros));
+    TEST_ASSERT_EQUAL('b', data[0]);
+    queue.pop();
+
+    // An abandoned slot comes out empty
+    queue.publish(tickets[2], 0, 0);
+    TEST_ASSERT_EQUAL(0, queue.front(&data, &micros));
+
+#ifndef ARDUINO
+    // Several producers against one consumer: nothing lost, each producer's points in order
+    const int producers = 4;
+    const int perProducer = 20000;
+    TEST_ASSERT_TRUE(queue.allocate(64, 8));
+    std::thread threads[producers];
+    for (int p = 0; p < producers; p++) {
+        threads[p] = std::thread([&queue, p]() {
+            for (int i = 0; i < perProducer; i++) {
+                size_t ticket;
+                char* slot;
+                while ((slot = queue.claim(&ticket)) == nullptr) {
+                    std::this_thread::yield();
+                }
+                memcpy(slot, &i, sizeof(i));
+                slot[4] = (char)p;
+                queue.publish(ticket, 5, 0);
+            }
+        });
+    }
+    int next[producers] = {};
+    int received = 0;
+    bool ordered = true;
+    while (received < producers * perProducer) {
+        if (queue.front(&data, &micros) < 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        int value;
+        memcpy(&value, data, sizeof(value));
+        ordered = ordered && value == next[(int)data[4]]++;
+        queue.pop();
+        received++;
+    }
+    for (int p = 0; p < producers; p++) {
+        threads[p].join();
+    }
+    TEST_ASSERT_TRUE(ordered);
+#endif
+}
+#endif
+
+#ifndef ARDUINO
+void test_posix_transport_url(void) {
+    PosixTransport transport;
+    Transport::Request request;
+    Transport::Response response;
+
+    // No TLS in the native transport
+    request.url = "https://example.com/api/v2/write";
+    TEST_ASSERT_EQUAL(Transport::ERROR_INVALID_URL, transport.send(request, &response));
+    request.url = "http://localhost:99999/api/v2/write";
+    TEST_ASSERT_EQUAL(Transport::ERROR_INVALID_URL, transport.send(request, &response));
+    TEST_ASSERT_TRUE(transport.ready());
+
+    // A transport that could not set itself up is refused by begin(), not mistaken for an outage
+    class BrokenTransport : public CaptureTransport {
+    public:
+        bool ready() const override { return false; }
+    } broken;
+    LightweightIoT::Config config;
+    config.transport = &broken;
+    iot->setConfig(config);
+    TEST_ASSERT_FALSE(iot->begin("http://localhost:8086"));
+    TEST_ASSERT_EQUAL(LightweightIoT::INVALID_CONFIG, iot->getLastError());
 }
+#endif
 
 void setup() {
     delay(2000);
@@ -64,8 +891,35 @@ void setup() {
     RUN_TEST(test_location_validation);
     RUN_TEST(test_device_validation);
     RUN_TEST(test_measurement_validation);
+    RUN_TEST(test_key_table);
     RUN_TEST(test_memory_check);
     RUN_TEST(test_batch_memory);
+    RUN_TEST(test_flush_policy);
+    RUN_TEST(test_batch_swap);
+    RUN_TEST(test_retry_keeps_point);
+    RUN_TEST(test_spool_roundtrip);
+    RUN_TEST(test_encode_point);
+    RUN_TEST(test_write_precision);
+    RUN_TEST(test_multi_field_point);
+    RUN_TEST(test_series_schema);
+    RUN_TEST(test_stats);
+    RUN_TEST(test_deadband);
+    RUN_TEST(test_aggregation);
+    RUN_TEST(test_column_batch);
+    RUN_TEST(test_static_buffer);
+    RUN_TEST(test_write_series);
+    RUN_TEST(test_streamed_gzip);
+    RUN_TEST(test_float_formatting);
+    RUN_TEST(test_tag_set_sorted);
+    RUN_TEST(test_escape_contexts);
+    RUN_TEST(test_gzip_payload);
+    RUN_TEST(test_batch_runs);
+#ifdef LWIOT_HAS_THREADS
+    RUN_TEST(test_point_queue);
+#endif
+#ifndef ARDUINO
+    RUN_TEST(test_posix_transport_url);
+#endif
     UNITY_END();
 }
 